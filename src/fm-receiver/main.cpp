@@ -29,8 +29,10 @@
 
 #include <hvylya/pipelines/async/pipeline.h>
 
+#include <fm-receiver/sharded_processing.h>
 #include <fm-receiver/stations.h>
 
+#include <fstream>
 // TODO: remove, for debugging only.
 #include <iostream>
 
@@ -85,6 +87,30 @@ void dumpSnrStats(const FmReceiver<float>& fm_receiver)
         std::endl;
 }
 
+void dumpPipelineStats(const Pipeline& pipeline)
+{
+    for (const auto& stats: pipeline.stats())
+    {
+        std::cout << stats.name <<
+            ": calls = " << stats.calls <<
+            ", wall time = " << stats.wall_time.count() / 1000000 << "ms" <<
+            ", CPU time = " << stats.cpu_time.count() / 1000000 << "ms" <<
+            ", queued time = " << stats.queued_time.count() / 1000000 << "ms";
+
+        for (std::size_t i = 0; i < stats.consumed_samples.size(); ++i)
+        {
+            std::cout << ", in" << i << " = " << stats.consumed_samples[i];
+        }
+
+        for (std::size_t i = 0; i < stats.produced_samples.size(); ++i)
+        {
+            std::cout << ", out" << i << " = " << stats.produced_samples[i];
+        }
+
+        std::cout << std::endl;
+    }
+}
+
 void runScanPipeline(const char* device)
 {
     SdrKernelSource<float> source(device);
@@ -125,10 +151,14 @@ void updateFrequency(Pipeline& pipeline, SdrKernelSource<float>& source, std::si
     pipeline.resume();
 }
 
-void runLivePipeline(std::size_t frequency)
+void runLivePipeline(std::size_t frequency, std::size_t latency_budget_ms)
 {
-    // Increase extra queue depth to avoid too many threads wake ups.
-    Pipeline pipeline(10);
+    Pipeline pipeline;
+    pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::Latency);
+    // Real-time decoding needs only a part of the cores.
+    pipeline.setElasticThreads(true);
+    // Bursts let the cores sleep longer, but must fit into the sink delay below.
+    pipeline.setLatencyBudget(std::chrono::milliseconds(std::min<std::size_t>(latency_budget_ms, 150)));
 
     FmReceiver<float> fm_receiver;
 
@@ -201,6 +231,10 @@ void runLivePipeline(std::size_t frequency)
                 fm_receiver.rdsState().dump();
                 break;
 
+            case 'p':
+                dumpPipelineStats(pipeline);
+                break;
+
             case 'q':
             case 'x':
                 running = false;
@@ -267,6 +301,9 @@ void runTestPipeline()
         std::cout << samples[i] << ":" << std::endl;
 
         Pipeline pipeline;
+        pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::Throughput);
+        // FM band filter alone would otherwise limit the whole pipeline to a single core.
+        pipeline.setBlockReplicas(4);
 
 #ifdef RDS_DUMP_CLOCK_STATS
         for (std::size_t j = 0; j < 16 * 4; ++j)
@@ -310,10 +347,44 @@ void runTestPipeline()
     std::cout << std::endl;
 }
 
+void runTracePipeline(const char* file_path, const char* trace_path, std::size_t max_events_per_thread)
+{
+    Pipeline pipeline;
+    pipeline.setTraceCapacity(max_events_per_thread);
+
+    FmReceiver<float> fm_receiver;
+    FileSource<std::complex<float>> source(file_path, false);
+    NullSink<float, 2> sink;
+
+    connect(source, fm_receiver);
+
+    connect(makeChannel<0>(fm_receiver), makeChannel<0>(sink));
+    connect(makeChannel<1>(fm_receiver), makeChannel<1>(sink));
+
+    pipeline.add(source);
+    pipeline.run();
+
+    std::ofstream trace(trace_path);
+    pipeline.writeTrace(trace);
+
+    dumpPipelineStats(pipeline);
+}
+
+void runBatchPipeline(const char* file_path, const char* output_path, std::size_t segments_count, std::size_t warm_up_ms)
+{
+    auto result = processRecordingSharded(file_path, output_path, segments_count, 0, warm_up_ms);
+
+    std::cout << "Output frames: " << result.output_frames << std::endl;
+    dumpRdsStats(result.rds_decoding_stats);
+    result.rds_state.dump();
+}
+
 void runLoadPipeline(const char* file_path)
 {
-    // Increase extra queue depth to avoid too many threads wake ups.
-    Pipeline pipeline(10);
+    Pipeline pipeline;
+    pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::Latency);
+    // Real-time decoding needs only a part of the cores.
+    pipeline.setElasticThreads(true);
 
     FmReceiver<float> fm_receiver;
 
@@ -358,6 +429,10 @@ void runLoadPipeline(const char* file_path)
                 fm_receiver.rdsState().dump();
                 break;
 
+            case 'p':
+                dumpPipelineStats(pipeline);
+                break;
+
             case 'q':
             case 'x':
                 running = false;
@@ -380,9 +455,9 @@ int main(int argc, char* argv[])
 {
     google::InitGoogleLogging(argv[0]);
 
-    if (argc == 3 && !strcmp(argv[1], "live"))
+    if ((argc == 3 || argc == 4) && !strcmp(argv[1], "live"))
     {
-        runLivePipeline(std::size_t(std::atoi(argv[2])));
+        runLivePipeline(std::size_t(std::atoi(argv[2])), argc > 3 ? std::size_t(std::atoi(argv[3])) : 0);
     }
     else if ((argc == 2 || argc == 3) && !strcmp(argv[1], "scan"))
     {
@@ -396,6 +471,19 @@ int main(int argc, char* argv[])
     {
         runTestPipeline();
     }
+    else if ((argc == 4 || argc == 5) && !strcmp(argv[1], "trace"))
+    {
+        runTracePipeline(argv[2], argv[3], argc > 4 ? std::size_t(std::atoi(argv[4])) : 1 << 16);
+    }
+    else if (argc >= 4 && argc <= 6 && !strcmp(argv[1], "batch"))
+    {
+        runBatchPipeline(
+            argv[2],
+            argv[3],
+            argc > 4 ? std::size_t(std::atoi(argv[4])) : 0,
+            argc > 5 ? std::size_t(std::atoi(argv[5])) : 5000
+        );
+    }
     else if (argc == 3 && !strcmp(argv[1], "load"))
     {
         runLoadPipeline(argv[2]);
@@ -0,0 +1,336 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <fm-receiver/sharded_processing.h>
+
+#include <hvylya/filters/fm/fm_constants.h>
+#include <hvylya/filters/fm/fm_receiver.h>
+#include <hvylya/filters/connect.h>
+#include <hvylya/filters/file_source.h>
+#include <hvylya/filters/filter_generic.h>
+
+#include <hvylya/pipelines/async/pipeline.h>
+
+#include <condition_variable>
+#include <fstream>
+#include <limits>
+#include <numeric>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+using namespace hvylya::filters::fm;
+using namespace hvylya::pipelines::async;
+
+using namespace fm_receiver;
+
+namespace {
+
+// Each segment also decodes a short tail past its end, so that the delays of the audio path
+// filters don't leave its last output frames without the input they depend on.
+const std::size_t SegmentTailMs = 20;
+
+// Drops the specified number of audio frames and collects up to the specified number
+// of the following ones as interleaved stereo samples.
+template <typename T>
+class SegmentSink:
+    public FilterGeneric<
+        TypeList<T, T>,
+        TypeList<>
+    >
+{
+  public:
+    typedef typename FilterBaseType<SegmentSink>::Type Base;
+
+    SegmentSink(std::size_t skipped_frames, std::size_t kept_frames, std::size_t expected_frames, std::vector<T>& output):
+        skipped_frames_(skipped_frames),
+        kept_frames_(kept_frames),
+        output_(output)
+    {
+        output_.reserve(output_.size() + 2 * std::min(kept_frames_, expected_frames));
+    }
+
+    virtual void process(const typename Base::Inputs& input, typename Base::Outputs& /* output */) override
+    {
+        const auto& left = std::get<0>(input);
+        const auto& right = std::get<1>(input);
+        std::size_t input_data_size = std::min(left.size(), right.size());
+
+        std::size_t skipped_size = std::min(input_data_size, skipped_frames_);
+        skipped_frames_ -= skipped_size;
+
+        std::size_t kept_size = std::min(input_data_size - skipped_size, kept_frames_);
+        kept_frames_ -= kept_size;
+
+        std::size_t output_offset = output_.size();
+        output_.resize(output_offset + 2 * kept_size);
+        for (std::size_t i = 0; i < kept_size; ++i)
+        {
+            output_[output_offset + 2 * i] = left[skipped_size + i];
+            output_[output_offset + 2 * i + 1] = right[skipped_size + i];
+        }
+
+        left.advance(input_data_size);
+        right.advance(input_data_size);
+    }
+
+  private:
+    std::size_t skipped_frames_, kept_frames_;
+    std::vector<T>& output_;
+};
+
+struct Segment
+{
+    std::vector<float> output;
+    RdsState rds_state;
+    RdsDecodingStats rds_decoding_stats;
+    bool finished = false;
+};
+
+std::size_t inputToOutputFrames(std::size_t input_samples)
+{
+    return input_samples * OutputAudioSamplingRate / InputSamplingRate;
+}
+
+// Decodes [begin, end) samples of the recording, keeping the audio frames as specified for SegmentSink.
+void runReceiver(
+    FmReceiver<float>& fm_receiver,
+    const char* input_path,
+    std::size_t begin,
+    std::size_t end,
+    std::size_t skipped_frames,
+    std::size_t kept_frames,
+    std::vector<float>& output
+)
+{
+    // Pipelines of the concurrently processed segments share the hardware threads.
+    Pipeline pipeline;
+    pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::Throughput);
+    pipeline.setExecutor(&Executor::shared());
+
+    FileSource<std::complex<float>> source(input_path, false, begin, end - begin);
+    SegmentSink<float> sink(skipped_frames, kept_frames, inputToOutputFrames(end - begin), output);
+
+    connect(source, fm_receiver);
+
+    connect(makeChannel<0>(fm_receiver), makeChannel<0>(sink));
+    connect(makeChannel<1>(fm_receiver), makeChannel<1>(sink));
+
+    pipeline.add(source);
+    pipeline.run();
+}
+
+void processSegment(
+    Segment& segment,
+    const char* input_path,
+    std::size_t warm_up_offset,
+    std::size_t offset,
+    std::size_t size,
+    std::size_t tail_size,
+    std::size_t total_size
+)
+{
+    // All boundaries are aligned, so the output frames of the segment line up exactly
+    // with those of the single run over the whole recording. The last segment keeps
+    // everything the filters flush at the end of the recording.
+    std::size_t end = std::min(offset + size + tail_size, total_size);
+    bool last = offset + size == total_size;
+
+    FmReceiver<float> fm_receiver;
+    runReceiver(
+        fm_receiver,
+        input_path,
+        warm_up_offset,
+        end,
+        inputToOutputFrames(offset - warm_up_offset),
+        last ? std::numeric_limits<std::size_t>::max() : inputToOutputFrames(size),
+        segment.output
+    );
+
+    segment.rds_state = fm_receiver.rdsState();
+    segment.rds_decoding_stats = fm_receiver.rdsDecodingStats();
+
+    if (offset)
+    {
+        // RDS blocks decoded up to the end of the previous segment tail are counted by the previous
+        // segment, so decode them separately and exclude from the stats of this segment.
+        FmReceiver<float> warm_up_receiver;
+        std::vector<float> warm_up_output;
+        runReceiver(warm_up_receiver, input_path, warm_up_offset, std::min(offset + tail_size, end), 0, 0, warm_up_output);
+
+        RdsDecodingStats warm_up_stats = warm_up_receiver.rdsDecodingStats();
+        segment.rds_decoding_stats.failed_blocks -= std::min(segment.rds_decoding_stats.failed_blocks, warm_up_stats.failed_blocks);
+        segment.rds_decoding_stats.corrected_blocks -= std::min(segment.rds_decoding_stats.corrected_blocks, warm_up_stats.corrected_blocks);
+        segment.rds_decoding_stats.valid_blocks -= std::min(segment.rds_decoding_stats.valid_blocks, warm_up_stats.valid_blocks);
+        segment.rds_decoding_stats.skipped_bits -= std::min(segment.rds_decoding_stats.skipped_bits, warm_up_stats.skipped_bits);
+        segment.rds_decoding_stats.tentative_skipped_bits -= std::min(segment.rds_decoding_stats.tentative_skipped_bits, warm_up_stats.tentative_skipped_bits);
+    }
+}
+
+} // anonymous namespace
+
+ShardedProcessingResult fm_receiver::processRecordingSharded(
+    const char* input_path,
+    const char* output_path,
+    std::size_t segments_count,
+    std::size_t parallelism,
+    std::size_t warm_up_ms
+)
+{
+    std::size_t hardware_threads = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    segments_count = segments_count ? segments_count : hardware_threads;
+    parallelism = std::min(parallelism ? parallelism : hardware_threads, segments_count);
+
+    // Segments boundaries must map to the whole number of output frames and keep the decimators
+    // and the resampler of the audio path in the same phase as in the single run over the whole
+    // recording, for the outputs of the consecutive segments to line up.
+    std::size_t alignment = std::lcm(
+        InputSamplingRate / std::gcd(InputSamplingRate, OutputAudioSamplingRate),
+        IntermediateDecimationRatio * AudioDecimationRatio * AudioResamplerDecimationRatio
+    );
+    std::size_t total_size = FileSource<std::complex<float>>::samplesCount(input_path);
+    std::size_t segment_size = std::max(alignment, roundUp((total_size + segments_count - 1) / segments_count, alignment));
+    std::size_t warm_up_size = roundUp(warm_up_ms * InputSamplingRate / 1000, alignment);
+    std::size_t tail_size = roundUp(SegmentTailMs * InputSamplingRate / 1000, alignment);
+    segments_count = (total_size + segment_size - 1) / segment_size;
+
+    std::unique_ptr<std::ofstream> output;
+    if (output_path)
+    {
+        output = std::make_unique<std::ofstream>(output_path, std::ios::out | std::ios::binary);
+        if (!*output)
+        {
+            THROW(IoError()) << fmt::format("Failed to open the file {0} for writing", output_path);
+        }
+    }
+
+    std::vector<Segment> segments(segments_count);
+    std::mutex segments_mutex;
+    std::condition_variable segment_changed;
+    std::size_t next_segment = 0, written_segments = 0;
+    std::exception_ptr error;
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < parallelism; ++i)
+    {
+        threads.emplace_back(
+            [&]
+            {
+                std::unique_lock<std::mutex> lock(segments_mutex);
+                while (true)
+                {
+                    // Don't let the outputs of too many segments pile up while the earlier ones are still processed.
+                    segment_changed.wait(
+                        lock,
+                        [&]
+                        {
+                            return error || next_segment >= segments_count || next_segment < written_segments + 2 * parallelism;
+                        }
+                    );
+
+                    if (error || next_segment >= segments_count)
+                    {
+                        break;
+                    }
+
+                    std::size_t index = next_segment++;
+                    lock.unlock();
+
+                    std::size_t offset = index * segment_size;
+                    try
+                    {
+                        processSegment(
+                            segments[index],
+                            input_path,
+                            offset - std::min(offset, warm_up_size),
+                            offset,
+                            std::min(segment_size, total_size - offset),
+                            tail_size,
+                            total_size
+                        );
+                    }
+                    catch (...)
+                    {
+                        lock.lock();
+                        error = std::current_exception();
+                        segment_changed.notify_all();
+                        break;
+                    }
+
+                    lock.lock();
+                    segments[index].finished = true;
+                    segment_changed.notify_all();
+                }
+            }
+        );
+    }
+
+    ShardedProcessingResult result;
+    result.output_frames = 0;
+
+    for (auto& segment: segments)
+    {
+        std::unique_lock<std::mutex> lock(segments_mutex);
+        segment_changed.wait(lock, [&] { return error || segment.finished; });
+
+        if (error)
+        {
+            break;
+        }
+
+        lock.unlock();
+
+        try
+        {
+            if (output)
+            {
+                output->write(reinterpret_cast<const char*>(segment.output.data()), std::streamsize(segment.output.size() * sizeof(float)));
+                if (!*output)
+                {
+                    THROW(IoError()) << fmt::format("Failed to write to the file {0}", output_path);
+                }
+            }
+        }
+        catch (...)
+        {
+            lock.lock();
+            error = std::current_exception();
+            segment_changed.notify_all();
+            break;
+        }
+
+        result.output_frames += segment.output.size() / 2;
+        result.rds_state.merge(segment.rds_state);
+        result.rds_decoding_stats.merge(segment.rds_decoding_stats);
+        std::vector<float>().swap(segment.output);
+
+        lock.lock();
+        ++written_segments;
+        segment_changed.notify_all();
+    }
+
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    return result;
+}
@@ -0,0 +1,52 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/filters/fm/rds_decoding_stats.h>
+#include <hvylya/filters/fm/rds_state.h>
+
+namespace fm_receiver {
+
+struct ShardedProcessingResult
+{
+    hvylya::filters::RdsState rds_state;
+    hvylya::filters::RdsDecodingStats rds_decoding_stats;
+    // Number of stereo frames written to the output.
+    std::size_t output_frames;
+};
+
+// Processes the recording of FM band IQ samples as the specified number of segments
+// (0 means the number of hardware threads), running up to the specified number
+// of independent pipelines concurrently (0 means the number of hardware threads).
+//
+// Each segment starts processing warm_up_ms earlier than its own samples begin,
+// so that PLL, CMA equalizer and RDS synchronization settle before its output
+// is used, and ends a bit later to cover the delays of the filters. The audio produced
+// outside of the segment is dropped and the rest is written to output_path (unless it's
+// nullptr) in the order of the segments, as interleaved stereo float samples, lining up
+// with the output of the single run over the whole recording. RDS decoding stats exclude
+// the warm-ups, RDS states of later segments take precedence over the earlier ones.
+ShardedProcessingResult processRecordingSharded(
+    const char* input_path,
+    const char* output_path,
+    std::size_t segments_count = 0,
+    std::size_t parallelism = 0,
+    std::size_t warm_up_ms = 5000
+);
+
+} // namespace fm_receiver
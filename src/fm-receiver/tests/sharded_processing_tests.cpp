@@ -0,0 +1,138 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <fm-receiver/sharded_processing.h>
+
+#include <hvylya/filters/fm/fm_receiver.h>
+#include <hvylya/filters/file_source.h>
+#include <hvylya/filters/filter_generic.h>
+#include <hvylya/filters/connect.h>
+
+#include <hvylya/pipelines/async/pipeline.h>
+
+// Include environment cleaner.
+#include <hvylya/filters/tests/fft_test_utils.h>
+
+#include <hvylya/core/tests/common.h>
+
+#include <fstream>
+
+#include <unistd.h>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+using namespace hvylya::filters::fm;
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+const char* Sample = "/usr/src/carpc.extra/samples/hvylya/sample_signal10_generated_piano2-f32x2@1000000.bin";
+
+// Collects the audio as interleaved stereo samples, like the sharded processing writes it.
+class StereoCollector:
+    public FilterGeneric<
+        TypeList<float, float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<StereoCollector>::Type Base;
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        const auto& left = std::get<0>(input);
+        const auto& right = std::get<1>(input);
+        std::size_t input_data_size = std::min(left.size(), right.size());
+
+        for (std::size_t i = 0; i < input_data_size; ++i)
+        {
+            output_.push_back(left[i]);
+            output_.push_back(right[i]);
+        }
+
+        left.advance(input_data_size);
+        right.advance(input_data_size);
+    }
+
+    const std::vector<float>& output() const
+    {
+        return output_;
+    }
+
+  private:
+    std::vector<float> output_;
+};
+
+std::vector<float> readSamples(const char* file_path)
+{
+    std::ifstream file(file_path, std::ios::in | std::ios::binary | std::ios::ate);
+    EXPECT_TRUE(file);
+
+    std::vector<float> samples(std::size_t(file.tellg()) / sizeof(float));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(samples.data()), std::streamsize(samples.size() * sizeof(float)));
+    EXPECT_TRUE(file);
+
+    return samples;
+}
+
+} // anonymous namespace
+
+TEST(ShardedProcessing, MatchesSingleRun)
+{
+    Pipeline pipeline;
+
+    FileSource<std::complex<float>> file_source(Sample, false);
+    FmReceiver<float> fm_receiver;
+    StereoCollector sink;
+
+    connect(file_source, fm_receiver);
+
+    connect(makeChannel<0>(fm_receiver), makeChannel<0>(sink));
+    connect(makeChannel<1>(fm_receiver), makeChannel<1>(sink));
+
+    pipeline.add(file_source);
+    pipeline.run();
+
+    const std::vector<float>& expected = sink.output();
+    EXPECT_EQ(2 * 302485, expected.size());
+
+    char output_path[] = "/tmp/sharded_processing_tests.XXXXXX";
+    int fd = mkstemp(output_path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    // Short warm-ups make the later segments start in the middle of the recording.
+    auto result = fm_receiver::processRecordingSharded(Sample, output_path, 4, 2, 1000);
+    std::vector<float> output = readSamples(output_path);
+    unlink(output_path);
+
+    EXPECT_EQ(expected.size() / 2, result.output_frames);
+    ASSERT_EQ(expected.size(), output.size());
+
+    // Shifted or duplicated frames at the seams would show up as the large mismatch
+    // for the piano recording, while the adaptive parts of the receiver converge
+    // to nearly the same state during the warm-up.
+    double error_energy = 0, signal_energy = 0;
+    for (std::size_t i = 0; i < expected.size(); ++i)
+    {
+        error_energy += sqr(double(output[i]) - double(expected[i]));
+        signal_energy += sqr(double(expected[i]));
+    }
+
+    EXPECT_LT(error_energy, 1e-4 * signal_energy);
+}
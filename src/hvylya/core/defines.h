@@ -38,3 +38,6 @@
 
 #define ENABLE_WARNING_POP() \
     PRAGMA_STRINGIFIED(clang diagnostic pop)
+
+// Used to keep the data written by different threads on separate cache lines.
+#define CACHE_LINE_SIZE 64
@@ -151,6 +151,12 @@ void AlsaSink<T, ChannelsCount>::reset()
     }
 }
 
+template <typename T, std::size_t ChannelsCount>
+bool AlsaSink<T, ChannelsCount>::ioBound() const
+{
+    return true;
+}
+
 template <typename T, std::size_t ChannelsCount>
 void AlsaSink<T, ChannelsCount>::process(const typename Base::Inputs& input, typename Base::Outputs& /* output */)
 {
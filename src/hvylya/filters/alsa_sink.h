@@ -53,6 +53,9 @@ class AlsaSink:
 
     virtual void reset() override;
 
+    // Blocks in snd_pcm_writen() until the device has enough space.
+    virtual bool ioBound() const override;
+
     virtual void process(const typename Base::Inputs& input, typename Base::Outputs& /* output */) override;
 
   private:
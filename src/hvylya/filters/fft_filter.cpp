@@ -30,6 +30,8 @@ FftFilter<SampleType, TapType>::FftFilter(
 ):
     FftFilter(taps_count, compensate_delay, decimation_rate)
 {
+    taps_.assign(&taps[0], &taps[taps_count]);
+
     // Alignment is not so much a problem here, but we need to pad taps with zeros anyway,
     // plus conversion to ResultType is required.
     AlignedVector<ResultType> tmp_taps(block_size_);
@@ -51,6 +53,17 @@ void FftFilter<SampleType, TapType>::reset()
     remaining_skip_ = 0;
 }
 
+template <typename SampleType, typename TapType>
+std::unique_ptr<IFilter> FftFilter<SampleType, TapType>::replicate() const
+{
+    if (taps_.empty() || decimation_rate_ != 1)
+    {
+        return nullptr;
+    }
+
+    return std::make_unique<FftFilter>(&taps_[0], taps_.size(), compensate_delay_, decimation_rate_);
+}
+
 template <typename SampleType, typename TapType>
 void FftFilter<SampleType, TapType>::process(const typename Base::Inputs& input, typename Base::Outputs& output)
 {
@@ -161,6 +174,13 @@ FftFilter<SampleType, TapType>::FftFilter(
     Base::inputState(0).setRequiredSize(output_block_size_);
     Base::outputState(0).setRequiredSize((output_block_size_ + (decimation_rate_ - 1)) / decimation_rate_);
 
+    // Otherwise the number of samples produced per block varies with the decimation phase.
+    if (!(output_block_size_ % decimation_rate_))
+    {
+        Base::inputState(0).setRate(decimation_rate_);
+        Base::outputState(0).setRate(1);
+    }
+
     if (compensate_delay_)
     {
         Base::inputState(0).setDelay((taps_count - 1) / 2);
@@ -49,6 +49,10 @@ class FftFilter:
 
     virtual void reset() override;
 
+    // Only the filters without decimation can be replicated, as the decimation
+    // phase depends on all the previously processed samples.
+    virtual std::unique_ptr<IFilter> replicate() const override;
+
     virtual void process(const typename Base::Inputs& input, typename Base::Outputs& output) override;
 
   protected:
@@ -62,6 +66,8 @@ class FftFilter:
         BlockShiftAlignmentInElements = TapVector::Elements > SampleVector::Elements ? TapVector::Elements : SampleVector::Elements
     };
 
+    // Kept for replication, empty if the derived filter has set up the FFT taps itself.
+    std::vector<TapType> taps_;
     // Alignment is needed for vectorized version.
     core::AlignedVector<SampleType> history_;
     core::AlignedVector<ResultType> transformed_samples_;
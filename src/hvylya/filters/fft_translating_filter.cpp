@@ -52,6 +52,12 @@ void FftTranslatingFilter<SampleType, TapType>::reset()
     rotator_.reset();
 }
 
+template <typename SampleType, typename TapType>
+std::unique_ptr<IFilter> FftTranslatingFilter<SampleType, TapType>::replicate() const
+{
+    return nullptr;
+}
+
 template <typename SampleType, typename TapType>
 void FftTranslatingFilter<SampleType, TapType>::postProcess(ResultType* output, std::size_t output_size)
 {
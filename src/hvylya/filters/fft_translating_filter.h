@@ -49,6 +49,9 @@ class FftTranslatingFilter:
 
     virtual void reset() override;
 
+    // The rotator phase depends on all the previously processed samples.
+    virtual std::unique_ptr<IFilter> replicate() const override;
+
   protected:
     Rotator<ScalarType> rotator_;
 
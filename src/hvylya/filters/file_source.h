@@ -34,15 +34,39 @@ class FileSource:
   public:
     typedef typename FilterBaseType<FileSource>::Type Base;
 
-    FileSource(const char* file_path, bool loop = false):
+    // Reads (and optionally loops over) the range of samples that starts at the specified offset
+    // and has the specified size, which may extend past the end of the file.
+    FileSource(
+        const char* file_path,
+        bool loop = false,
+        std::size_t offset = 0,
+        std::size_t size = std::numeric_limits<std::size_t>::max()
+    ):
         file_(file_path, std::ios::in | std::ios::binary),
         file_path_(file_path),
-        loop_(loop)
+        loop_(loop),
+        offset_(offset),
+        size_(size),
+        remaining_size_(size)
     {
         if (!file_)
         {
             THROW(core::IoError()) << fmt::format("Failed to open the file {0} for reading", file_path_);
         }
+
+        seek();
+    }
+
+    // Number of samples in the file.
+    static std::size_t samplesCount(const char* file_path)
+    {
+        std::ifstream file(file_path, std::ios::in | std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            THROW(core::IoError()) << fmt::format("Failed to open the file {0} for reading", file_path);
+        }
+
+        return std::size_t(file.tellg()) / sizeof(T);
     }
 
     virtual void process(const typename Base::Inputs& /* input */, typename Base::Outputs& output) override
@@ -50,33 +74,13 @@ class FileSource:
         auto& output_data = std::get<0>(output);
         std::size_t output_size = std::min(Base::outputState(0).suggestedSize(), output_data.size());
 
-        std::size_t read_data =
-            std::size_t(
-                file_.read(
-                    reinterpret_cast<char*>(&output_data[0]),
-                    std::streamsize(output_size * sizeof(T))
-                ).gcount()
-            );
+        std::size_t read_data = read(output_data, output_size);
 
-        if (!file_)
+        if (read_data < sizeof(T) && loop_)
         {
-            if (!file_.eof())
-            {
-                THROW(core::IoError()) << fmt::format("Error while reading the file {0}", file_path_);
-            }
-
-            if (loop_)
-            {
-                file_.clear();
-                file_.seekg(0, std::ios::beg);
-                read_data =
-                    std::size_t(
-                        file_.read(
-                            reinterpret_cast<char*>(&output_data[0]),
-                            std::streamsize(output_size * sizeof(T))
-                        ).gcount()
-                    );
-            }
+            file_.clear();
+            seek();
+            read_data = read(output_data, output_size);
         }
 
         if (read_data < sizeof(T))
@@ -86,6 +90,7 @@ class FileSource:
         else
         {
             output_data.advance(read_data / sizeof(T));
+            remaining_size_ -= read_data / sizeof(T);
         }
     }
 
@@ -93,6 +98,37 @@ class FileSource:
     std::ifstream file_;
     std::string file_path_;
     bool loop_;
+    std::size_t offset_, size_, remaining_size_;
+
+    void seek()
+    {
+        file_.seekg(std::streamoff(offset_ * sizeof(T)), std::ios::beg);
+        remaining_size_ = size_;
+    }
+
+    template <typename Output>
+    std::size_t read(Output& output_data, std::size_t output_size)
+    {
+        if (!remaining_size_)
+        {
+            return 0;
+        }
+
+        std::size_t read_data =
+            std::size_t(
+                file_.read(
+                    reinterpret_cast<char*>(&output_data[0]),
+                    std::streamsize(std::min(output_size, remaining_size_) * sizeof(T))
+                ).gcount()
+            );
+
+        if (!file_ && !file_.eof())
+        {
+            THROW(core::IoError()) << fmt::format("Error while reading the file {0}", file_path_);
+        }
+
+        return read_data;
+    }
 };
 
 } // namespace filters
@@ -116,6 +116,27 @@ class FilterGeneric: public IFilter
         // Do nothing in the base version for now.
     }
 
+    virtual std::unique_ptr<IFilter> replicate() const override
+    {
+        // Filters are stateful by default.
+        return nullptr;
+    }
+
+    virtual bool ioBound() const override
+    {
+        return false;
+    }
+
+    virtual int pollDescriptor() const override
+    {
+        return -1;
+    }
+
+    virtual std::uint32_t pollEvents() const override
+    {
+        return 0;
+    }
+
     virtual void process(const Inputs& input, Outputs& output) = 0;
 
   protected:
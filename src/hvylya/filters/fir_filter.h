@@ -113,6 +113,8 @@ class FirFilterBase:
         // We want to have enough input elements to produce at least one output sample.
         Base::inputState(0).setRequiredSize(decimation_rate);
         Base::inputState(0).setPadding(Padding);
+        Base::inputState(0).setRate(decimation_rate);
+        Base::outputState(0).setRate(1);
 
         if (compensate_delay_)
         {
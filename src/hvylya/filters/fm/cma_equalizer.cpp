@@ -89,6 +89,9 @@ FmCmaEqualizer<T>::FmCmaEqualizer(std::size_t taps_count):
     CHECK_GT(taps_count, 0) << "Taps count must be positive!";
     CHECK_EQ(taps_count % ComplexVector::Elements, 0) << "Taps count must be multiple of ComplexVector::Elements!";
 
+    Base::inputState(0).setRate(1);
+    Base::outputState(0).setRate(1);
+
     taps_.resize(taps_count_, ValueType(0));
     taps_indices_.resize(taps_count_, 0);
     taps_enabled_.resize(taps_count_, false);
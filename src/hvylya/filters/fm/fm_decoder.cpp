@@ -35,6 +35,8 @@ FmDecoder<T>::FmDecoder(uint32_t sample_rate):
     Base::inputState(0).setHistorySize(1);
     Base::inputState(0).setRequiredSize(2 * ComplexVector::Elements);
     Base::outputState(0).setRequiredSize(ScalarVector::Elements);
+    Base::inputState(0).setRate(1);
+    Base::outputState(0).setRate(1);
 }
 
 template <typename T>
@@ -29,6 +29,10 @@ FmDeemphasizer<T>::FmDeemphasizer(uint32_t sample_rate, T tau):
 {
     CHECK_NE(sample_rate, 0) << "sample_rate cannot be zero";
     CHECK_GT(tau, 0) << "tau must be > 0";
+
+    Base::inputState(0).setRate(1);
+    Base::outputState(0).setRate(1);
+    Base::outputState(0).setInPlaceInput(0);
 }
 
 template <typename T>
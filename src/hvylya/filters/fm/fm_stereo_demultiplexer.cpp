@@ -24,6 +24,13 @@ template <typename T>
 FmStereoDemultiplexer<T>::FmStereoDemultiplexer(T stereo_weight)
 {
     setStereoWeight(stereo_weight);
+
+    Base::inputState(0).setRate(1);
+    Base::inputState(1).setRate(1);
+    Base::outputState(0).setRate(1);
+    Base::outputState(1).setRate(1);
+    Base::outputState(0).setInPlaceInput(0);
+    Base::outputState(1).setInPlaceInput(1);
 }
 
 template <typename T>
@@ -23,6 +23,10 @@ using namespace hvylya::filters;
 template <typename T>
 FmStereoExtractor<T>::FmStereoExtractor()
 {
+    Base::inputState(0).setRate(1);
+    Base::inputState(1).setRate(1);
+    Base::outputState(0).setRate(1);
+    Base::outputState(0).setInPlaceInput(1);
 }
 
 template <typename T>
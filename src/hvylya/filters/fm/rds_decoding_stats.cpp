@@ -32,3 +32,12 @@ void RdsDecodingStats::clear()
     skipped_bits = 0;
     tentative_skipped_bits = 0;
 }
+
+void RdsDecodingStats::merge(const RdsDecodingStats& other)
+{
+    failed_blocks += other.failed_blocks;
+    corrected_blocks += other.corrected_blocks;
+    valid_blocks += other.valid_blocks;
+    skipped_bits += other.skipped_bits;
+    tentative_skipped_bits += other.tentative_skipped_bits;
+}
@@ -30,8 +30,13 @@ struct RdsDecodingStats
 
     RdsDecodingStats(RdsDecodingStats&& other) = default;
 
+    RdsDecodingStats& operator =(const RdsDecodingStats& other) = default;
+
     void clear();
 
+    // Accumulates the stats of another part of the signal.
+    void merge(const RdsDecodingStats& other);
+
     std::size_t failed_blocks, corrected_blocks, valid_blocks, skipped_bits, tentative_skipped_bits;
 };
 
@@ -183,6 +183,113 @@ bool fillString(std::string& str, const Container& container, const char fillCha
     return has_chars;
 }
 
+template <typename T, ValueTag Tag>
+void mergeValue(RdsValue<T, Tag>& value, const RdsValue<T, Tag>& other)
+{
+    value.merge(other);
+}
+
+template <typename T, typename Alloc>
+void mergeContainer(std::vector<T, Alloc>& container, const std::vector<T, Alloc>& other);
+
+template <typename T, typename Alloc>
+void mergeContainerAndAdd(std::vector<T, Alloc>& container, const std::vector<T, Alloc>& other);
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename Allocator>
+void mergeContainerAndAdd(std::unordered_map<Key, T, Hash, KeyEqual, Allocator>& container, const std::unordered_map<Key, T, Hash, KeyEqual, Allocator>& other);
+
+void mergeValue(EonProgrammeInfo& value, const EonProgrammeInfo& other)
+{
+    mergeContainer(value.programme_service_name, other.programme_service_name);
+    mergeContainerAndAdd(value.frequencies, other.frequencies);
+    mergeValue(value.traffic_programme, other.traffic_programme);
+    mergeValue(value.traffic_announcement, other.traffic_announcement);
+    mergeValue(value.programme_type, other.programme_type);
+    mergeValue(value.programme_item_start_time, other.programme_item_start_time);
+    mergeValue(value.linkage_actuator, other.linkage_actuator);
+    mergeValue(value.extended_generic, other.extended_generic);
+    mergeValue(value.i13l_linkage_set, other.i13l_linkage_set);
+    mergeValue(value.linkage_set_number, other.linkage_set_number);
+}
+
+void mergeValue(TmcChannel& value, const TmcChannel& other)
+{
+    mergeContainerAndAdd(value.frequencies, other.frequencies);
+    mergeValue(value.programme_identification, other.programme_identification);
+    mergeValue(value.ltn, other.ltn);
+    mergeValue(value.sid, other.sid);
+    mergeValue(value.scope_i13l, other.scope_i13l);
+    mergeValue(value.scope_national, other.scope_national);
+    mergeValue(value.scope_regional, other.scope_regional);
+    mergeValue(value.scope_urban, other.scope_urban);
+}
+
+// Values of the variable size containers are identified the same way the decoder looks them up.
+template <typename T, ValueTag Tag>
+bool sameItem(const RdsValue<T, Tag>& value, const RdsValue<T, Tag>& other)
+{
+    return value.lastValue() == other.lastValue();
+}
+
+bool sameItem(const TmcChannel& value, const TmcChannel& other)
+{
+    return sameItem(value.programme_identification, other.programme_identification);
+}
+
+template <typename T, typename Alloc>
+void mergeContainer(std::vector<T, Alloc>& container, const std::vector<T, Alloc>& other)
+{
+    CHECK_EQ(container.size(), other.size());
+
+    for (std::size_t i = 0; i < container.size(); ++i)
+    {
+        mergeValue(container[i], other[i]);
+    }
+}
+
+template <typename T, typename Alloc>
+void mergeContainerAndAdd(std::vector<T, Alloc>& container, const std::vector<T, Alloc>& other)
+{
+    for (const auto& other_value: other)
+    {
+        auto it = std::find_if(
+            container.begin(),
+            container.end(),
+            [&other_value](const auto& value)
+            {
+                return sameItem(value, other_value);
+            }
+        );
+
+        if (it != container.end())
+        {
+            mergeValue(*it, other_value);
+        }
+        else
+        {
+            container.push_back(other_value);
+        }
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual, typename Allocator>
+void mergeContainerAndAdd(std::unordered_map<Key, T, Hash, KeyEqual, Allocator>& container, const std::unordered_map<Key, T, Hash, KeyEqual, Allocator>& other)
+{
+    for (const auto& kv: other)
+    {
+        auto it = container.find(kv.first);
+
+        if (it != container.end())
+        {
+            mergeValue(it->second, kv.second);
+        }
+        else
+        {
+            container.insert(kv);
+        }
+    }
+}
+
 } // anonymous namespace
 
 RdsCheckData::RdsCheckData()
@@ -272,6 +379,65 @@ void RdsState::clear(bool everything, std::time_t cutoff_time)
     clearValue(tmc_scope_urban, everything, cutoff_time);
 }
 
+void RdsState::merge(const RdsState& other)
+{
+    mergeContainerAndAdd(alternative_frequencies, other.alternative_frequencies);
+    mergeContainerAndAdd(oda_aids, other.oda_aids);
+    mergeContainerAndAdd(transparent_data_channels, other.transparent_data_channels);
+    mergeContainerAndAdd(eon_mapping, other.eon_mapping);
+    mergeContainerAndAdd(tmc_channels, other.tmc_channels);
+
+    mergeValue(programme_identification, other.programme_identification);
+    mergeValue(programme_type, other.programme_type);
+    mergeValue(traffic_programme, other.traffic_programme);
+
+    mergeValue(traffic_announcement, other.traffic_announcement);
+    mergeValue(music_speech, other.music_speech);
+    mergeValue(stereo, other.stereo);
+    mergeValue(artificial_head, other.artificial_head);
+    mergeValue(compressed, other.compressed);
+    mergeValue(dynamic_pty, other.dynamic_pty);
+    mergeContainer(programme_service_name, other.programme_service_name);
+
+    mergeValue(country, other.country);
+    mergeValue(language, other.language);
+    mergeValue(programme_item_start_time, other.programme_item_start_time);
+    mergeValue(linkage_actuator, other.linkage_actuator);
+
+    mergeContainer(radio_text, other.radio_text);
+    mergeValue(text_ab, other.text_ab);
+
+    mergeValue(oda_message, other.oda_message);
+
+    mergeValue(current_time, other.current_time);
+
+    mergeContainer(programme_type_name, other.programme_type_name);
+    mergeValue(ptn_ab, other.ptn_ab);
+
+    mergeValue(dab_eid, other.dab_eid);
+    mergeValue(dab_sid, other.dab_sid);
+    mergeValue(dab_mode, other.dab_mode);
+    mergeValue(dab_link_linkage_set_number, other.dab_link_linkage_set_number);
+    mergeValue(dab_link_linkage_actuator, other.dab_link_linkage_actuator);
+    mergeValue(dab_link_soft_hard, other.dab_link_soft_hard);
+    mergeValue(dab_link_extended_generic, other.dab_link_extended_generic);
+    mergeValue(dab_link_i13l_linkage_set, other.dab_link_i13l_linkage_set);
+
+    mergeContainer(tmc_service_provider_name, other.tmc_service_provider_name);
+    mergeValue(tmc_ltn, other.tmc_ltn);
+    mergeValue(tmc_gap, other.tmc_gap);
+    mergeValue(tmc_sid, other.tmc_sid);
+    mergeValue(tmc_activity_time, other.tmc_activity_time);
+    mergeValue(tmc_window_time, other.tmc_window_time);
+    mergeValue(tmc_delay_time, other.tmc_delay_time);
+    mergeValue(tmc_afi, other.tmc_afi);
+    mergeValue(tmc_mode, other.tmc_mode);
+    mergeValue(tmc_scope_i13l, other.tmc_scope_i13l);
+    mergeValue(tmc_scope_national, other.tmc_scope_national);
+    mergeValue(tmc_scope_regional, other.tmc_scope_regional);
+    mergeValue(tmc_scope_urban, other.tmc_scope_urban);
+}
+
 void RdsState::dump() const
 {
     if (programme_identification.valid())
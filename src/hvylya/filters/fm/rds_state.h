@@ -118,6 +118,20 @@ class RdsValue
 	}
     }
 
+    // Takes over the other value if it is valid, without emitting any signals.
+    void merge(const RdsValue& other)
+    {
+        if (other.sent_)
+        {
+            has_corrected_ = other.has_corrected_;
+            sent_ = true;
+            sent_value_ = other.sent_value_;
+            last_value_ = other.last_value_;
+            last_check_data_ = other.last_check_data_;
+            last_update_ = other.last_update_;
+        }
+    }
+
     const T& value() const
     {
         CHECK(sent_);
@@ -268,6 +282,10 @@ struct RdsState
 
     void clear(bool everything = true, std::time_t cutoff_time = 0);
 
+    // Combines the state decoded from the later part of the same signal: values valid
+    // in the other state replace the current ones, all the others are kept.
+    void merge(const RdsState& other);
+
     void dump() const;
 
     // Section 2.2
@@ -53,6 +53,23 @@ class IFilter: core::NonCopyable
 
     virtual void process(core::UntypedSlice inputs[], core::UntypedSlice outputs[]) = 0;
 
+    // Returns an independent copy of the filter that can process other parts of the input
+    // concurrently with this one, or nullptr if the filter cannot be replicated. Replicable
+    // filters must have a single input and a single output, keep no state besides the input
+    // history and produce exactly as many samples as they consume, given enough output space.
+    virtual std::unique_ptr<IFilter> replicate() const = 0;
+
+    // Whether process() spends most of its time blocked waiting for a device rather than
+    // computing, so that it should run on the threads not used for processing the data.
+    virtual bool ioBound() const = 0;
+
+    // File descriptor the filter waits on, or -1 if there's none. Filters with the descriptor
+    // must not block in process(): the pipeline runs them only once epoll reports any of
+    // pollEvents() (e.g. EPOLLIN or EPOLLOUT) for the descriptor, and as long as it does.
+    virtual int pollDescriptor() const = 0;
+
+    virtual std::uint32_t pollEvents() const = 0;
+
   protected:
     virtual void addSource(Channel source_output_channel, std::size_t input_channel) = 0;
 
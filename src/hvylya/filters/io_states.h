@@ -31,6 +31,7 @@ class InputState
         required_size_(1),
         suggested_size_(0),
         padding_(0),
+        rate_(0),
         may_consume_nothing_(false)
     {
     }
@@ -65,6 +66,14 @@ class InputState
         return padding_;
     }
 
+    // Fixed rate filters (the ones with non-zero rates on all channels) always consume and produce
+    // the same multiple of the rate on every channel, given enough input data and output space,
+    // e.g. the filter decimating by 4 has the input rate of 4 and the output rate of 1.
+    std::size_t rate() const
+    {
+        return rate_;
+    }
+
     bool mayConsumeNothing() const
     {
         return may_consume_nothing_;
@@ -102,13 +111,18 @@ class InputState
         padding_ = padding;
     }
 
+    void setRate(std::size_t rate)
+    {
+        rate_ = rate;
+    }
+
     void setMayConsumeNothing(bool may_consume_nothing)
     {
         may_consume_nothing_ = may_consume_nothing;
     }
 
   private:
-    std::size_t type_size_, history_size_, delay_, required_size_, suggested_size_, padding_;
+    std::size_t type_size_, history_size_, delay_, required_size_, suggested_size_, padding_, rate_;
     bool may_consume_nothing_;
 };
 
@@ -119,7 +133,10 @@ class OutputState
         required_size_(1),
         provided_size_(1),
         suggested_size_(0),
-        padding_(0)
+        padding_(0),
+        rate_(0),
+        in_place_input_(0),
+        in_place_(false)
     {
         setEof(false);
     }
@@ -149,6 +166,25 @@ class OutputState
         return padding_;
     }
 
+    // See InputState::rate().
+    std::size_t rate() const
+    {
+        return rate_;
+    }
+
+    // Whether the output can be written over the input inPlaceInput() of the same type:
+    // the filter must consume and produce the same number of samples on both of them
+    // and read every input sample before writing the output sample with the same index.
+    bool inPlace() const
+    {
+        return in_place_;
+    }
+
+    std::size_t inPlaceInput() const
+    {
+        return in_place_input_;
+    }
+
     bool eof() const
     {
         return eof_.load();
@@ -181,13 +217,25 @@ class OutputState
         padding_ = padding;
     }
 
+    void setRate(std::size_t rate)
+    {
+        rate_ = rate;
+    }
+
+    void setInPlaceInput(std::size_t input_channel)
+    {
+        in_place_input_ = input_channel;
+        in_place_ = true;
+    }
+
     void setEof(bool eof)
     {
         eof_.store(eof);
     }
 
   private:
-    std::size_t type_size_, required_size_, provided_size_, suggested_size_, padding_;
+    std::size_t type_size_, required_size_, provided_size_, suggested_size_, padding_, rate_, in_place_input_;
+    bool in_place_;
     // Unlike all other values, this one can change while pipeline is running, so make sure
     // we're accessing the consistent version of it.
     std::atomic<bool> eof_;
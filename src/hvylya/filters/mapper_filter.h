@@ -36,11 +36,13 @@ class MapperFilter:
     MapperFilter(Callable callable):
         callable_(callable)
     {
+        setElementwise();
     }
 
     MapperFilter(MapperFilter<Callable>&& filter):
         callable_(std::move(filter.callable_))
     {
+        setElementwise();
     }
 
     virtual void process(const typename Base::Inputs& input, typename Base::Outputs& output) override
@@ -74,6 +76,27 @@ class MapperFilter:
   private:
     Callable callable_;
 
+    // Every call consumes and produces the same number of samples on all channels,
+    // so callables must read their inputs before writing the outputs of the same size,
+    // as these might be written over the inputs.
+    void setElementwise()
+    {
+        for (std::size_t i = 0; i < Base::inputChannelsCount(); ++i)
+        {
+            Base::inputState(i).setRate(1);
+        }
+
+        for (std::size_t i = 0; i < Base::outputChannelsCount(); ++i)
+        {
+            Base::outputState(i).setRate(1);
+
+            if (i < Base::inputChannelsCount() && Base::inputState(i).typeSize() == Base::outputState(i).typeSize())
+            {
+                Base::outputState(i).setInPlaceInput(i);
+            }
+        }
+    }
+
     template <
         std::size_t InputIndex,
         std::size_t OutputIndex,
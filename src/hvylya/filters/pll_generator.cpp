@@ -40,6 +40,9 @@ PllGenerator<T>::PllGenerator(T loop_bandwidth, T min_frequency, T max_frequency
     beta_ = T(4.0 * loop_bandwidth_ * loop_bandwidth_ / denom);
     Base::inputState(0).setRequiredSize(2 * ComplexVector::Elements);
     Base::outputState(0).setRequiredSize(2 * ComplexVector::Elements);
+    Base::inputState(0).setRate(1);
+    Base::outputState(0).setRate(1);
+    Base::outputState(0).setInPlaceInput(0);
 }
 
 template <typename T>
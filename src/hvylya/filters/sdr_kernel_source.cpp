@@ -18,6 +18,7 @@
 #include <hvylya/filters/sdr_kernel_source.h>
 
 #include <libv4l2.h>
+#include <sys/epoll.h>
 #include <sys/mman.h>
 #include <fcntl.h>
 #include <linux/videodev2.h>
@@ -39,9 +40,13 @@ SdrKernelSource<T>::SdrKernelSource(const char* device_name):
     streaming_(false),
     acquired_buffer_(false)
 {
-    // Open device in blocking mode - we're not doing any async processing,
-    // as we currently don't have polling support in the pipeline scheduler.
-    device_ = open(device_name, O_RDWR, 0);
+    // The device might have no filled buffer yet when the source runs.
+    Base::outputState(0).setProvidedSize(0);
+    memset(&reset_timestamp_, 0, sizeof(reset_timestamp_));
+
+    // Open device in non-blocking mode - the pipeline runs the source
+    // only once the device reports the filled buffers.
+    device_ = open(device_name, O_RDWR | O_NONBLOCK, 0);
     if (device_ < 0)
     {
         THROW(IoError()) << fmt::format("Cannot open device {0}", device_name);
@@ -137,6 +142,18 @@ void SdrKernelSource<T>::setGain(T gain)
     ioctlRetry(VIDIOC_S_EXT_CTRLS, &ext_ctrls);
 }
 
+template <typename T>
+int SdrKernelSource<T>::pollDescriptor() const
+{
+    return device_;
+}
+
+template <typename T>
+std::uint32_t SdrKernelSource<T>::pollEvents() const
+{
+    return EPOLLIN;
+}
+
 template <typename T>
 void SdrKernelSource<T>::process(const typename Base::Inputs& /* input */, typename Base::Outputs& output)
 {
@@ -145,9 +162,9 @@ void SdrKernelSource<T>::process(const typename Base::Inputs& /* input */, typen
         startStreaming();
     }
 
-    if (!acquired_buffer_)
+    if (!acquired_buffer_ && !acquireBuffer())
     {
-        acquireBuffer();
+        return;
     }
 
     auto& output_data = std::get<0>(output);
@@ -178,7 +195,11 @@ void SdrKernelSource<T>::process(const typename Base::Inputs& /* input */, typen
         if (output_index < output_size)
         {
             CHECK(!acquired_buffer_);
-            acquireBuffer();
+            if (!acquireBuffer())
+            {
+                // The rest is picked up once the device fills the next buffer.
+                break;
+            }
         }
     }
 
@@ -216,33 +237,60 @@ void SdrKernelSource<T>::reset()
         return;
     }
 
-    if (!acquired_buffer_)
-    {
-        acquireBuffer();
-    }
-
-    timespec current_timestamp;
-    CHECK_EQ(0, clock_gettime(CLOCK_MONOTONIC, &current_timestamp));
+    // Everything captured so far is stale, e.g. received at the frequency before the retune,
+    // so the buffers older than this are dropped once they're acquired.
+    CHECK_EQ(0, clock_gettime(CLOCK_MONOTONIC, &reset_timestamp_));
 
-    while (
-        last_acquired_timestamp_.tv_sec < current_timestamp.tv_sec ||
-        (last_acquired_timestamp_.tv_sec == current_timestamp.tv_sec &&
-         last_acquired_timestamp_.tv_usec * 1000 < current_timestamp.tv_nsec)
-    )
+    if (acquired_buffer_)
     {
         releaseBuffer(current_buffer_index_);
-        acquireBuffer();
     }
 }
 
 template <typename T>
-void SdrKernelSource<T>::acquireBuffer()
+bool SdrKernelSource<T>::acquireBuffer()
 {
     v4l2_buffer buffer;
     memset(&buffer, 0, sizeof(buffer));
     buffer.type = V4L2_BUF_TYPE_SDR_CAPTURE;
     buffer.memory = V4L2_MEMORY_MMAP;
-    ioctlRetry(VIDIOC_DQBUF, &buffer);
+
+    while (true)
+    {
+        int result = 0;
+        do
+        {
+            errno = 0;
+            result = v4l2_ioctl(device_, VIDIOC_DQBUF, &buffer);
+        }
+        while (result == -1 && errno == EINTR);
+
+        if (result == -1)
+        {
+            if (errno == EAGAIN)
+            {
+                return false;
+            }
+
+            THROW(IoError()) <<
+                fmt::format(
+                    "ioctl failure for request {0}, device = {1}",
+                    VIDIOC_DQBUF,
+                    device_name_
+                );
+        }
+
+        if (
+            buffer.timestamp.tv_sec > reset_timestamp_.tv_sec ||
+            (buffer.timestamp.tv_sec == reset_timestamp_.tv_sec &&
+             buffer.timestamp.tv_usec * 1000 >= reset_timestamp_.tv_nsec)
+        )
+        {
+            break;
+        }
+
+        releaseBuffer(buffer.index);
+    }
 
     CHECK_EQ(0, buffer.bytesused % 2);
     // V4L interface doesn't define any other constants for clock types, so if this one
@@ -252,8 +300,9 @@ void SdrKernelSource<T>::acquireBuffer()
     current_buffer_index_ = buffer.index;
     consumed_bytes_ = 0;
     buffers_[current_buffer_index_].size = buffer.bytesused;
-    last_acquired_timestamp_ = buffer.timestamp;
     acquired_buffer_ = true;
+
+    return true;
 }
 
 template <typename T>
@@ -56,17 +56,24 @@ class SdrKernelSource:
 
     virtual void reset() override;
 
+    // The device is polled for the filled buffers, so that VIDIOC_DQBUF doesn't block.
+    virtual int pollDescriptor() const override;
+
+    virtual std::uint32_t pollEvents() const override;
+
     virtual void process(const typename Base::Inputs& /* input */, typename Base::Outputs& output) override;
 
   private:
     std::vector<SdrKernelBuffer> buffers_;
     std::string device_name_;
     std::size_t current_buffer_index_, consumed_bytes_;
-    timeval last_acquired_timestamp_;
+    timespec reset_timestamp_;
     int device_;
     bool streaming_, acquired_buffer_;
 
-    void acquireBuffer();
+    // Drops the buffers captured before the last reset, returns false
+    // if the device has no filled buffer yet.
+    bool acquireBuffer();
 
     void releaseBuffer(std::size_t buffer_index);
 
@@ -0,0 +1,313 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/filters/filter_generic.h>
+
+#include <numeric>
+
+namespace hvylya {
+namespace filters {
+
+// Chunk of samples of the given type on the stack, aligned for SIMD access.
+template <typename T, std::size_t Size>
+struct alignas(core::MaxSimdByteSize) StaticChainBuffer
+{
+    T data[Size];
+};
+
+// Maps the channel type to the chunk buffer of the given size.
+template <std::size_t Size>
+struct StaticChainBufferMapper
+{
+    template <typename T>
+    struct Mapper
+    {
+        typedef StaticChainBuffer<T, Size> Type;
+    };
+};
+
+// Filter running the chain of elementwise filters, each one connected with all of its outputs
+// to the inputs of the next one, directly within its process() call: the members process
+// the data chunk by chunk, passing the chunks to each other through the buffers on the stack
+// rather than through the pipeline buffers, and are called non-virtually, so that
+// the compiler can inline the whole chain into a single loop.
+//
+// Members are referenced rather than owned and must not be connected to anything themselves.
+// All their channels must have the rate of 1 (see InputState::rate()) and no history, delay
+// or padding, which covers the mappers, stereo demultiplexing, deemphasis and alike.
+template <std::size_t ChunkSize, typename... Filters>
+class StaticChainGeneric:
+    public FilterGeneric<
+        typename core::TypeAt<core::TypeList<Filters...>, 0>::Type::InputChannels,
+        typename core::TypeAt<core::TypeList<Filters...>, sizeof...(Filters) - 1>::Type::OutputChannels
+    >
+{
+  public:
+    typedef typename FilterBaseType<StaticChainGeneric>::Type Base;
+
+    enum: std::size_t
+    {
+        FiltersCount = sizeof...(Filters)
+    };
+
+    static_assert(FiltersCount >= 2, "Static chain must have at least two filters");
+    static_assert(Base::InputsCount > 0 && Base::OutputsCount > 0, "Static chain must have both inputs and outputs");
+
+    StaticChainGeneric(Filters&... filters):
+        filters_(filters...),
+        granularity_(1)
+    {
+        checkLinks<0>();
+
+        forEachFilter(
+            [this](const IFilter& filter)
+            {
+                for (std::size_t i = 0; i < filter.inputChannelsCount(); ++i)
+                {
+                    const InputState& state = filter.inputState(i);
+                    CHECK_EQ(state.rate(), 1) << "Static chain members must be elementwise";
+                    CHECK(!state.historySize() && !state.delay() && !state.padding()) << "Static chain members cannot have input history, delay or padding";
+                    granularity_ = std::lcm(granularity_, state.requiredSize());
+                }
+
+                for (std::size_t i = 0; i < filter.outputChannelsCount(); ++i)
+                {
+                    const OutputState& state = filter.outputState(i);
+                    CHECK_EQ(state.rate(), 1) << "Static chain members must be elementwise";
+                    CHECK(!state.padding()) << "Static chain members cannot have output padding";
+                    granularity_ = std::lcm(granularity_, state.requiredSize());
+                }
+            }
+        );
+
+        CHECK_EQ(ChunkSize % granularity_, 0) << "Chunk size " << ChunkSize << " is not a multiple of the required sizes of static chain members";
+
+        for (std::size_t i = 0; i < Base::InputsCount; ++i)
+        {
+            Base::inputState(i).setRate(1);
+            Base::inputState(i).setRequiredSize(granularity_);
+        }
+
+        // The first member reads every chunk of the inputs before the last one writes the same chunk
+        // of the outputs, so the outputs can be written over any inputs of the same type.
+        for (std::size_t i = 0; i < Base::OutputsCount; ++i)
+        {
+            Base::outputState(i).setRate(1);
+            Base::outputState(i).setRequiredSize(granularity_);
+
+            if (i < Base::InputsCount && Base::inputState(i).typeSize() == Base::outputState(i).typeSize())
+            {
+                Base::outputState(i).setInPlaceInput(i);
+            }
+        }
+    }
+
+    virtual void reset() override
+    {
+        Base::reset();
+        forEachFilter([](IFilter& filter) { filter.reset(); });
+    }
+
+    virtual void process(const typename Base::Inputs& input, typename Base::Outputs& output) override
+    {
+        std::size_t data_size = std::numeric_limits<std::size_t>::max();
+
+        auto data_size_calculator =
+            [&data_size](const auto& channel, auto /* channel_index */)
+            {
+                data_size = std::min(data_size, channel.size());
+            };
+
+        core::forEachTupleElement(input, data_size_calculator);
+        core::forEachTupleElement(output, data_size_calculator);
+
+        std::size_t processed_size = 0;
+        while (processed_size < data_size)
+        {
+            std::size_t chunk_size = core::roundDown(std::min(std::size_t(ChunkSize), data_size - processed_size), granularity_);
+            if (!chunk_size)
+            {
+                break;
+            }
+
+            auto inputs = channelSlices(input, processed_size, chunk_size, InputsIndices());
+            std::size_t consumed_size = processFilter<0>(tupleOfConstRefs(inputs, InputsIndices()), output, processed_size);
+
+            processed_size += consumed_size;
+            if (consumed_size < chunk_size)
+            {
+                break;
+            }
+        }
+
+        auto channel_advancer =
+            [processed_size](auto& channel, auto /* channel_index */)
+            {
+                channel.advance(processed_size);
+            };
+
+        core::forEachTupleElement(input, channel_advancer);
+        core::forEachTupleElement(output, channel_advancer);
+    }
+
+  private:
+    typedef std::make_index_sequence<Base::InputsCount> InputsIndices;
+    typedef std::make_index_sequence<Base::OutputsCount> OutputsIndices;
+
+    template <std::size_t Index>
+    using FilterAt = typename core::TypeAt<core::TypeList<Filters...>, Index>::Type;
+
+    std::tuple<Filters&...> filters_;
+    std::size_t granularity_;
+
+    template <
+        std::size_t Index,
+        typename std::enable_if<Index + 1 < FiltersCount>::type* = nullptr
+    >
+    static void checkLinks()
+    {
+        static_assert(
+            std::is_same<typename FilterAt<Index>::OutputChannels, typename FilterAt<Index + 1>::InputChannels>::value,
+            "Outputs of static chain members must match the inputs of the next members"
+        );
+        checkLinks<Index + 1>();
+    }
+
+    template <
+        std::size_t Index,
+        typename std::enable_if<Index + 1 == FiltersCount>::type* = nullptr
+    >
+    static void checkLinks() { }
+
+    template <typename Callable>
+    void forEachFilter(Callable callable)
+    {
+        std::apply([&callable](auto&... filters) { (callable(filters), ...); }, filters_);
+    }
+
+    // Slices of the given part of the channels, the inputs are only read through them.
+    template <typename Channels, std::size_t... Indices>
+    static auto channelSlices(const Channels& channels, std::size_t offset, std::size_t size, std::index_sequence<Indices...>)
+    {
+        return std::make_tuple(
+            core::Slice<typename std::remove_const<typename std::remove_reference<decltype(std::get<Indices>(channels)[0])>::type>::type>(
+                const_cast<typename std::remove_const<typename std::remove_reference<decltype(std::get<Indices>(channels)[0])>::type>::type*>(&std::get<Indices>(channels)[offset]),
+                size
+            )...
+        );
+    }
+
+    template <typename Buffers, std::size_t... Indices>
+    static auto bufferSlices(Buffers& buffers, std::size_t size, std::index_sequence<Indices...>)
+    {
+        return std::make_tuple(core::Slice<typename std::remove_reference<decltype(std::get<Indices>(buffers).data[0])>::type>(std::get<Indices>(buffers).data, size)...);
+    }
+
+    template <typename Slices, std::size_t... Indices>
+    static auto tupleOfRefs(Slices& slices, std::index_sequence<Indices...>)
+    {
+        return std::make_tuple(std::ref(std::get<Indices>(slices))...);
+    }
+
+    template <typename Slices, std::size_t... Indices>
+    static auto tupleOfConstRefs(Slices& slices, std::index_sequence<Indices...>)
+    {
+        return std::make_tuple(std::cref(std::get<Indices>(slices))...);
+    }
+
+    // Returns the advanced size, which must be the same for all the slices.
+    template <typename Slices>
+    static std::size_t advancedSize(const Slices& slices)
+    {
+        std::size_t advanced_size = std::get<0>(slices).advancedSize();
+
+        core::forEachTupleElement(
+            slices,
+            [advanced_size](const auto& slice, auto /* slice_index */)
+            {
+                CHECK_EQ(slice.advancedSize(), advanced_size) << "Static chain members must advance all their channels equally";
+            }
+        );
+
+        return advanced_size;
+    }
+
+    // Runs the member on the chunk of its inputs and passes the results down the chain,
+    // returns the size of the chunk processed.
+    template <
+        std::size_t Index,
+        typename std::enable_if<Index + 1 < FiltersCount>::type* = nullptr
+    >
+    std::size_t processFilter(const typename FilterAt<Index>::Inputs& inputs, typename Base::Outputs& output, std::size_t offset)
+    {
+        typedef FilterAt<Index> Filter;
+        typedef std::make_index_sequence<Filter::OutputsCount> FilterOutputsIndices;
+
+        typename core::TypeListToTuple<
+            typename core::TypeMapper<
+                StaticChainBufferMapper<ChunkSize>::template Mapper,
+                typename Filter::OutputChannels
+            >::Type
+        >::Type buffers;
+
+        std::size_t chunk_size = std::get<0>(inputs).size();
+        auto outputs = bufferSlices(buffers, chunk_size, FilterOutputsIndices());
+        auto outputs_refs = tupleOfRefs(outputs, FilterOutputsIndices());
+
+        std::get<Index>(filters_).Filter::process(inputs, outputs_refs);
+
+        std::size_t produced_size = advancedSize(outputs);
+        CHECK_EQ(advancedSize(inputs), produced_size) << "Static chain members must produce as many samples as they consume";
+
+        if (produced_size)
+        {
+            auto next_inputs = bufferSlices(buffers, produced_size, FilterOutputsIndices());
+            CHECK_EQ(processFilter<Index + 1>(tupleOfConstRefs(next_inputs, FilterOutputsIndices()), output, offset), produced_size)
+                << "Static chain members past the first one must process all their inputs";
+        }
+
+        return produced_size;
+    }
+
+    template <
+        std::size_t Index,
+        typename std::enable_if<Index + 1 == FiltersCount>::type* = nullptr
+    >
+    std::size_t processFilter(const typename FilterAt<Index>::Inputs& inputs, typename Base::Outputs& output, std::size_t offset)
+    {
+        typedef FilterAt<Index> Filter;
+
+        auto outputs = channelSlices(output, offset, std::get<0>(inputs).size(), OutputsIndices());
+        auto outputs_refs = tupleOfRefs(outputs, OutputsIndices());
+
+        std::get<Index>(filters_).Filter::process(inputs, outputs_refs);
+
+        std::size_t produced_size = advancedSize(outputs);
+        CHECK_EQ(advancedSize(inputs), produced_size) << "Static chain members must produce as many samples as they consume";
+
+        return produced_size;
+    }
+};
+
+// Chunks of 512 samples keep the buffers of the typical chains within L1 cache.
+template <typename... Filters>
+using StaticChain = StaticChainGeneric<512, Filters...>;
+
+} // namespace filters
+} // namespace hvylya
@@ -100,3 +100,42 @@ TEST_F(FftFilterRegressionTestComplexFloat, FmBasebandComplexFloat)
 {
     run(1, FirFilterRegressionTapsCount);
 }
+
+TEST(FftFilter, Replication)
+{
+    const float taps[] = { 1.0f, 2.0f, 3.0f, 4.0f };
+    FftFilter<float, float> filter(taps, 4);
+    std::unique_ptr<IFilter> replica = filter.replicate();
+    ASSERT_NE(nullptr, replica);
+
+    // Decimation phase is the state that cannot be replicated.
+    EXPECT_EQ(nullptr, (FftFilter<float, float>(taps, 4, false, 2).replicate()));
+
+    const InputState& state = filter.inputState(0);
+    std::size_t size = 2 * state.requiredSize();
+    AlignedVector<float> input(state.historySize() + size), output(size), replica_output(size);
+    for (std::size_t i = 0; i < input.size(); ++i)
+    {
+        input[i] = float(i + 1);
+    }
+
+    auto process =
+        [&input, size](IFilter& filter_to_run, float* output_data)
+        {
+            UntypedSlice input_slice(reinterpret_cast<std::int8_t*>(&input[0]), input.size());
+            UntypedSlice output_slice(reinterpret_cast<std::int8_t*>(output_data), size);
+            filter_to_run.process(&input_slice, &output_slice);
+
+            // Replicas must consume the whole input and produce as much output.
+            EXPECT_EQ(size, input_slice.advancedSize());
+            EXPECT_EQ(size, output_slice.advancedSize());
+        };
+
+    process(filter, &output[0]);
+    process(*replica, &replica_output[0]);
+
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        EXPECT_EQ(output[i], replica_output[i]);
+    }
+}
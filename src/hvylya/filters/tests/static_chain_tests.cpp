@@ -0,0 +1,156 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/filters/static_chain.h>
+
+#include <hvylya/filters/fm/fm_deemphasizer.h>
+#include <hvylya/filters/mapper_filter.h>
+
+#include <hvylya/core/tests/common.h>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+
+namespace {
+
+const std::size_t SamplesCount = 1000;
+
+void splitter(const int& in, float& out0, float& out1)
+{
+    out0 = in;
+    out1 = 2.0f * in;
+}
+
+void combiner(const float& in0, const float& in1, float& out0, float& out1)
+{
+    out0 = in0 + in1;
+    out1 = in0 * in1;
+}
+
+void scaler(const float& in, float& out)
+{
+    out = 0.5f * in;
+}
+
+}
+
+TEST(StaticChain, Mappers)
+{
+    MapperFilter<decltype(&splitter)> splitter_filter(&splitter);
+    MapperFilter<decltype(&combiner)> combiner_filter(&combiner);
+    StaticChainGeneric<64, decltype(splitter_filter), decltype(combiner_filter)> chain(splitter_filter, combiner_filter);
+
+    AlignedVector<int> input(SamplesCount);
+    AlignedVector<float> output0(SamplesCount), output1(SamplesCount);
+
+    for (std::size_t i = 0; i < SamplesCount; ++i)
+    {
+        input[i] = int(i);
+    }
+
+    // Leave some output space unused to check the chain stops at the shortest channel.
+    Slice<int> input_slice(input);
+    Slice<float> output_slice0(output0), output_slice1(&output1[0], SamplesCount - 1);
+
+    auto input_tuple = std::make_tuple(std::cref(input_slice));
+    auto output_tuple = std::make_tuple(std::ref(output_slice0), std::ref(output_slice1));
+
+    chain.process(input_tuple, output_tuple);
+
+    EXPECT_EQ(SamplesCount - 1, input_slice.advancedSize());
+    EXPECT_EQ(SamplesCount - 1, output_slice0.advancedSize());
+    EXPECT_EQ(SamplesCount - 1, output_slice1.advancedSize());
+
+    for (std::size_t i = 0; i < SamplesCount - 1; ++i)
+    {
+        EXPECT_EQ(3.0f * i, output0[i]);
+        EXPECT_EQ(2.0f * i * i, output1[i]);
+    }
+}
+
+TEST(StaticChain, InPlace)
+{
+    MapperFilter<decltype(&scaler)> scaler_filter0(&scaler), scaler_filter1(&scaler);
+    StaticChainGeneric<64, decltype(scaler_filter0), decltype(scaler_filter1)> chain(scaler_filter0, scaler_filter1);
+
+    EXPECT_TRUE(chain.outputState(0).inPlace());
+    EXPECT_EQ(0, chain.outputState(0).inPlaceInput());
+
+    AlignedVector<float> data(SamplesCount);
+    for (std::size_t i = 0; i < SamplesCount; ++i)
+    {
+        data[i] = 4.0f * i;
+    }
+
+    Slice<float> input_slice(data), output_slice(data);
+
+    auto input_tuple = std::make_tuple(std::cref(input_slice));
+    auto output_tuple = std::make_tuple(std::ref(output_slice));
+
+    chain.process(input_tuple, output_tuple);
+
+    EXPECT_EQ(SamplesCount, output_slice.advancedSize());
+
+    for (std::size_t i = 0; i < SamplesCount; ++i)
+    {
+        EXPECT_EQ(float(i), data[i]);
+    }
+}
+
+TEST(StaticChain, StatefulMembers)
+{
+    const std::size_t sample_rate = 48000;
+
+    // State of the deemphasizer must carry over between the chunks and process() calls.
+    FmDeemphasizer<float> chained_deemphasizer(sample_rate), deemphasizer(sample_rate);
+    MapperFilter<decltype(&scaler)> chained_scaler_filter(&scaler), scaler_filter(&scaler);
+    StaticChain<decltype(chained_deemphasizer), decltype(chained_scaler_filter)> chain(chained_deemphasizer, chained_scaler_filter);
+
+    AlignedVector<float> input(SamplesCount), deemphasized(SamplesCount), expected(SamplesCount), output(SamplesCount);
+    for (std::size_t i = 0; i < SamplesCount; ++i)
+    {
+        input[i] = std::sin(0.1f * i);
+    }
+
+    Slice<float> input_slice(input), deemphasized_slice(deemphasized), deemphasized_input_slice(deemphasized), expected_slice(expected);
+
+    auto input_tuple = std::make_tuple(std::cref(input_slice));
+    auto deemphasized_tuple = std::make_tuple(std::ref(deemphasized_slice));
+    auto deemphasized_input_tuple = std::make_tuple(std::cref(deemphasized_input_slice));
+    auto expected_tuple = std::make_tuple(std::ref(expected_slice));
+
+    deemphasizer.process(input_tuple, deemphasized_tuple);
+    scaler_filter.process(deemphasized_input_tuple, expected_tuple);
+
+    for (std::size_t offset: { std::size_t(0), SamplesCount / 3 })
+    {
+        std::size_t size = offset ? SamplesCount - offset : SamplesCount / 3;
+        Slice<float> chain_input_slice(&input[offset], size), chain_output_slice(&output[offset], size);
+
+        auto chain_input_tuple = std::make_tuple(std::cref(chain_input_slice));
+        auto chain_output_tuple = std::make_tuple(std::ref(chain_output_slice));
+
+        chain.process(chain_input_tuple, chain_output_tuple);
+
+        EXPECT_EQ(size, chain_output_slice.advancedSize());
+    }
+
+    for (std::size_t i = 0; i < SamplesCount; ++i)
+    {
+        EXPECT_EQ(expected[i], output[i]);
+    }
+}
@@ -0,0 +1,136 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/affinity.h>
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <pthread.h>
+#include <sched.h>
+
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+// Parses the kernel CPU list format, e.g. "0-3,8-11".
+std::vector<std::size_t> parseCpuList(const std::string& cpu_list)
+{
+    std::vector<std::size_t> cpus;
+    std::istringstream input(cpu_list);
+    std::string range;
+
+    while (std::getline(input, range, ','))
+    {
+        std::size_t separator = range.find('-');
+        std::size_t first = std::stoul(range.substr(0, separator));
+        std::size_t last = separator != std::string::npos ? std::stoul(range.substr(separator + 1)) : first;
+
+        for (std::size_t cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+std::string nodePath(std::size_t numa_node)
+{
+    return fmt::format("/sys/devices/system/node/node{0}/cpulist", numa_node);
+}
+
+} // anonymous namespace
+
+std::size_t hvylya::pipelines::async::numaNodesCount()
+{
+    std::size_t nodes_count = 0;
+    while (std::ifstream(nodePath(nodes_count)))
+    {
+        ++nodes_count;
+    }
+
+    return std::max<std::size_t>(nodes_count, 1);
+}
+
+std::vector<std::size_t> hvylya::pipelines::async::numaNodeCpus(std::size_t numa_node)
+{
+    std::ifstream file(nodePath(numa_node));
+    std::string cpu_list;
+
+    if (!file || !std::getline(file, cpu_list) || cpu_list.empty())
+    {
+        return {};
+    }
+
+    return parseCpuList(cpu_list);
+}
+
+void hvylya::pipelines::async::pinCurrentThread(const std::vector<std::size_t>& cpus)
+{
+    if (cpus.empty())
+    {
+        return;
+    }
+
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (auto cpu: cpus)
+    {
+        CPU_SET(cpu, &cpu_set);
+    }
+
+    // Failing to pin the thread only affects the performance, so don't treat it as an error.
+    int result = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
+    if (result)
+    {
+        LOG(WARNING) << "Failed to set thread affinity, error = " << result;
+    }
+}
+
+void hvylya::pipelines::async::runPinned(const std::vector<std::size_t>& cpus, const std::function<void ()>& function)
+{
+    if (cpus.empty())
+    {
+        function();
+        return;
+    }
+
+    std::exception_ptr error;
+    std::thread thread(
+        [&]
+        {
+            pinCurrentThread(cpus);
+
+            try
+            {
+                function();
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+        }
+    );
+    thread.join();
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,43 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+#include <functional>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+// Number of NUMA nodes in the system, 1 if the kernel doesn't report them.
+std::size_t numaNodesCount();
+
+// CPUs of the given NUMA node, empty if there's no such node.
+std::vector<std::size_t> numaNodeCpus(std::size_t numa_node);
+
+// Restricts the current thread to the given CPUs, does nothing for the empty set.
+void pinCurrentThread(const std::vector<std::size_t>& cpus);
+
+// Runs the function on a thread restricted to the given CPUs, so that the memory
+// it touches first is allocated on their NUMA node by the default kernel policy.
+void runPinned(const std::vector<std::size_t>& cpus, const std::function<void ()>& function);
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
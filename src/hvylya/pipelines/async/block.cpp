@@ -16,18 +16,41 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <hvylya/pipelines/async/block.h>
+#include <hvylya/pipelines/async/pipeline.h>
 
 #include <hvylya/filters/io_states.h>
 
 #include <sstream>
 
+#include <time.h>
+
 using namespace hvylya::core;
 using namespace hvylya::filters;
 using namespace hvylya::pipelines::async;
 
 namespace {
 
-const std::size_t DefaultBufferScale = 64;
+// Chunk sizes can be tuned up to 16x in either direction, as long as the buffers
+// have enough space for at least 4 tuned chunks.
+const int MaxChunkSizeLevel = 4;
+const std::size_t MinTunedChunksPerBuffer = 4;
+
+std::size_t scaleSize(std::size_t size, int level)
+{
+    return level >= 0 ? size << unsigned(level) : size >> unsigned(-level);
+}
+
+std::uint64_t threadCpuTime()
+{
+    timespec time;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return std::uint64_t(time.tv_sec) * 1000000000 + std::uint64_t(time.tv_nsec);
+}
+
+std::uint64_t elapsedTime(std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end)
+{
+    return std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
 
 } // anonymous namespace
 
@@ -35,25 +58,33 @@ Block::Block(Pipeline& pipeline, IFilter& filter):
     pipeline_(pipeline),
     filter_(filter),
     inputs_(filter_.inputChannelsCount()),
-    outputs_(filter_.outputChannelsCount())
+    outputs_(filter_.outputChannelsCount()),
+    last_consumed_size_(0),
+    last_produced_size_(0),
+    head_(this),
+    fused_blocks_(1, this),
+    sink_distance_(0),
+    burst_gated_(false),
+    burst_held_(false),
+    claimed_size_(0),
+    consumed_samples_(filter_.inputChannelsCount()),
+    produced_samples_(filter_.outputChannelsCount())
 {
     state_.store(Block::State::Idle);
+    critical_path_.store(0);
+    poll_ready_.store(false);
+    poll_armed_.store(false);
+    chunk_size_level_.store(0);
+    resetStats();
 
     for (std::size_t i = 0; i < filter_.inputChannelsCount(); ++i)
     {
-        readers_.emplace_back(CircularBufferReader(pipeline_, *this, i));
+        readers_.emplace_back(CircularBufferReader(*this, i));
     }
 
     for (std::size_t i = 0; i < filter_.outputChannelsCount(); ++i)
     {
-        writers_.emplace_back(
-            CircularBufferWriter(
-                pipeline_,
-                *this,
-                i,
-                DefaultBufferScale * filter_.outputState(i).suggestedSize()
-            )
-        );
+        writers_.emplace_back(CircularBufferWriter(*this, i));
     }
 }
 
@@ -63,9 +94,43 @@ Block::Block(Block&& block):
     readers_(std::move(block.readers_)),
     writers_(std::move(block.writers_)),
     inputs_(std::move(block.inputs_)),
-    outputs_(std::move(block.outputs_))
+    outputs_(std::move(block.outputs_)),
+    last_consumed_size_(block.last_consumed_size_),
+    last_produced_size_(block.last_produced_size_),
+    head_(block.head_ == &block ? this : block.head_),
+    fused_blocks_(std::move(block.fused_blocks_)),
+    sink_distance_(block.sink_distance_),
+    consumers_(std::move(block.consumers_)),
+    period_input_sizes_(std::move(block.period_input_sizes_)),
+    period_output_sizes_(std::move(block.period_output_sizes_)),
+    period_input_remaining_(std::move(block.period_input_remaining_)),
+    period_output_remaining_(std::move(block.period_output_remaining_)),
+    burst_gated_(block.burst_gated_),
+    next_burst_time_(block.next_burst_time_),
+    burst_held_(block.burst_held_.load()),
+    chunk_size_tuner_(block.chunk_size_tuner_),
+    replicas_(std::move(block.replicas_)),
+    parts_mutex_(std::move(block.parts_mutex_)),
+    parts_(std::move(block.parts_)),
+    free_replicas_(std::move(block.free_replicas_)),
+    replicas_outputs_(std::move(block.replicas_outputs_)),
+    claimed_size_(block.claimed_size_),
+    scheduled_time_(block.scheduled_time_),
+    consumed_samples_(std::move(block.consumed_samples_)),
+    produced_samples_(std::move(block.produced_samples_))
 {
     state_.store(block.state_.load());
+    critical_path_.store(block.critical_path_.load());
+    poll_ready_.store(block.poll_ready_.load());
+    poll_armed_.store(block.poll_armed_.load());
+    calls_.store(block.calls_.load());
+    wall_time_.store(block.wall_time_.load());
+    cpu_time_.store(block.cpu_time_.load());
+    queued_time_.store(block.queued_time_.load());
+    steals_.store(block.steals_.load());
+    chunk_size_level_.store(block.chunk_size_level_.load());
+
+    std::replace(fused_blocks_.begin(), fused_blocks_.end(), &block, this);
 }
 
 std::atomic<Block::State>& Block::state()
@@ -73,6 +138,16 @@ std::atomic<Block::State>& Block::state()
     return state_;
 }
 
+std::atomic<bool>& Block::pollReady()
+{
+    return poll_ready_;
+}
+
+std::atomic<bool>& Block::pollArmed()
+{
+    return poll_armed_;
+}
+
 std::size_t Block::inputChannelsCount() const
 {
     return filter_.inputChannelsCount();
@@ -95,6 +170,140 @@ const OutputState& Block::outputState(std::size_t output_channel) const
     return filter_.outputState(output_channel);
 }
 
+std::size_t Block::suggestedInputSize(std::size_t input_channel) const
+{
+    const InputState& state = inputState(input_channel);
+    return std::max(state.requiredSize(), scaleSize(state.suggestedSize(), chunk_size_level_.load(std::memory_order_relaxed)));
+}
+
+std::size_t Block::suggestedOutputSize(std::size_t output_channel) const
+{
+    const OutputState& state = outputState(output_channel);
+    return std::max(state.requiredSize(), scaleSize(state.suggestedSize(), chunk_size_level_.load(std::memory_order_relaxed)));
+}
+
+bool Block::validChunkSizeLevel(int level) const
+{
+    for (std::size_t i = 0; i < readers_.size(); ++i)
+    {
+        const InputState& state = filter_.inputState(i);
+        std::size_t size = scaleSize(state.suggestedSize(), level);
+        if (size < state.requiredSize() || MinTunedChunksPerBuffer * (state.historySize() + size) > readers_[i].bufferSize())
+        {
+            return false;
+        }
+    }
+
+    for (std::size_t i = 0; i < writers_.size(); ++i)
+    {
+        const OutputState& state = filter_.outputState(i);
+        std::size_t size = scaleSize(state.suggestedSize(), level);
+        if (size < state.requiredSize() || MinTunedChunksPerBuffer * size > writers_[i].bufferSize())
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Block::setChunkSizeTuning(ChunkSizeTuning tuning, int min_level, int max_level)
+{
+    CHECK_LE(min_level, max_level);
+
+    int min_valid_level = 0, max_valid_level = 0;
+
+    while (min_valid_level > -MaxChunkSizeLevel && validChunkSizeLevel(min_valid_level - 1))
+    {
+        --min_valid_level;
+    }
+
+    while (max_valid_level < MaxChunkSizeLevel && validChunkSizeLevel(max_valid_level + 1))
+    {
+        ++max_valid_level;
+    }
+
+    // Limits outside of the valid range collapse to its nearest end.
+    min_level = std::clamp(min_level, min_valid_level, max_valid_level);
+    max_level = std::clamp(max_level, min_valid_level, max_valid_level);
+
+    chunk_size_tuner_.reset(tuning, min_level, max_level);
+    chunk_size_level_.store(chunk_size_tuner_.level());
+}
+
+std::size_t Block::sinkDistance() const
+{
+    return sink_distance_;
+}
+
+void Block::setSinkDistance(std::size_t sink_distance)
+{
+    sink_distance_ = sink_distance;
+}
+
+const std::vector<Block*>& Block::consumers() const
+{
+    return consumers_;
+}
+
+void Block::addConsumer(Block& block)
+{
+    if (std::find(consumers_.begin(), consumers_.end(), &block) == consumers_.end())
+    {
+        consumers_.push_back(&block);
+    }
+}
+
+std::chrono::nanoseconds Block::criticalPath() const
+{
+    return std::chrono::nanoseconds(critical_path_.load(std::memory_order_relaxed));
+}
+
+void Block::setCriticalPath(std::chrono::nanoseconds critical_path)
+{
+    critical_path_.store(critical_path.count(), std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds Block::wallTime() const
+{
+    return std::chrono::nanoseconds(wall_time_.load(std::memory_order_relaxed));
+}
+
+std::uint64_t Block::producedSamples(std::size_t output_channel) const
+{
+    return produced_samples_[output_channel].load(std::memory_order_relaxed);
+}
+
+bool Block::burstGated() const
+{
+    return burst_gated_;
+}
+
+void Block::setBurstGated(bool burst_gated)
+{
+    burst_gated_ = burst_gated;
+}
+
+std::chrono::steady_clock::time_point Block::nextBurstTime() const
+{
+    return next_burst_time_;
+}
+
+void Block::setNextBurstTime(std::chrono::steady_clock::time_point next_burst_time)
+{
+    next_burst_time_ = next_burst_time;
+}
+
+bool Block::burstHeld() const
+{
+    return burst_held_.load(std::memory_order_relaxed);
+}
+
+void Block::setBurstHeld(bool burst_held)
+{
+    burst_held_.store(burst_held, std::memory_order_relaxed);
+}
+
 const CircularBufferReader& Block::reader(std::size_t input_channel) const
 {
     CHECK_LT(input_channel, readers_.size());
@@ -124,6 +333,11 @@ const IFilter& Block::filter() const
     return filter_;
 }
 
+IFilter& Block::filter()
+{
+    return filter_;
+}
+
 std::string Block::internalState() const
 {
     std::stringstream os;
@@ -136,9 +350,394 @@ std::string Block::internalState() const
     return os.str();
 }
 
+BlockStats Block::stats() const
+{
+    BlockStats stats;
+    stats.filter = &filter_;
+    stats.name = typeid(filter_).name();
+    stats.calls = calls_.load(std::memory_order_relaxed);
+    stats.wall_time = std::chrono::nanoseconds(wall_time_.load(std::memory_order_relaxed));
+    stats.critical_path = criticalPath();
+    stats.cpu_time = std::chrono::nanoseconds(cpu_time_.load(std::memory_order_relaxed));
+    stats.queued_time = std::chrono::nanoseconds(queued_time_.load(std::memory_order_relaxed));
+    stats.steals = steals_.load(std::memory_order_relaxed);
+
+    for (auto& consumed_samples: consumed_samples_)
+    {
+        stats.consumed_samples.push_back(consumed_samples.load(std::memory_order_relaxed));
+    }
+
+    for (auto& produced_samples: produced_samples_)
+    {
+        stats.produced_samples.push_back(produced_samples.load(std::memory_order_relaxed));
+    }
+
+    return stats;
+}
+
+Block& Block::head()
+{
+    return *head_;
+}
+
+const std::vector<Block*>& Block::fusedBlocks() const
+{
+    CHECK_EQ(this, head_);
+    return fused_blocks_;
+}
+
+void Block::fuse(Block& block)
+{
+    CHECK_EQ(this, head_);
+    CHECK_EQ(&block, block.head_);
+    CHECK_EQ(1, block.fused_blocks_.size());
+
+    block.head_ = this;
+    block.fused_blocks_.clear();
+    fused_blocks_.push_back(&block);
+}
+
+void Block::setPeriod(const std::vector<std::size_t>& input_sizes, const std::vector<std::size_t>& output_sizes)
+{
+    bool periodic = !input_sizes.empty() || !output_sizes.empty();
+    CHECK(!periodic || (input_sizes.size() == readers_.size() && output_sizes.size() == writers_.size()));
+
+    period_input_sizes_ = input_sizes;
+    period_output_sizes_ = output_sizes;
+    period_input_remaining_.resize(input_sizes.size());
+    period_output_remaining_.resize(output_sizes.size());
+}
+
+bool Block::periodic() const
+{
+    return !period_input_sizes_.empty() || !period_output_sizes_.empty();
+}
+
+std::size_t Block::periodInputSize(std::size_t input_channel) const
+{
+    return period_input_sizes_[input_channel];
+}
+
+std::size_t Block::periodOutputSize(std::size_t output_channel) const
+{
+    return period_output_sizes_[output_channel];
+}
+
+bool Block::replicate(std::size_t replicas_count)
+{
+    CHECK_GE(replicas_count, 1);
+    CHECK(parts_.empty());
+
+    bool replicable = readers_.size() == 1 && writers_.size() == 1;
+
+    replicas_.resize(std::min(replicas_.size(), replicas_count - 1));
+    while (replicable && replicas_.size() < replicas_count - 1)
+    {
+        std::unique_ptr<IFilter> replica = filter_.replicate();
+        replicable = replica != nullptr;
+        replicas_.push_back(std::move(replica));
+    }
+
+    if (!replicable)
+    {
+        replicas_.clear();
+    }
+
+    parts_mutex_.reset(replicas_.empty() ? nullptr : new std::mutex());
+    replicas_outputs_.resize(replicas_.empty() ? 0 : replicas_count);
+    resetParts();
+
+    return replicable;
+}
+
+std::size_t Block::replicasCount() const
+{
+    return replicas_.size() + 1;
+}
+
+IFilter& Block::replica(std::size_t index)
+{
+    return index ? *replicas_[index - 1] : filter_;
+}
+
+std::size_t Block::claimableSize(bool relaxed_size) const
+{
+    if (free_replicas_.empty())
+    {
+        return 0;
+    }
+
+    const InputState& state = filter_.inputState(0);
+    std::size_t available_size = readers_[0].availableSize();
+    if (available_size < state.historySize() + claimed_size_ + state.requiredSize())
+    {
+        return 0;
+    }
+
+    // Parts must consist of whole required sizes, so that replicas consume them completely.
+    std::size_t unclaimed_size = roundDown(available_size - state.historySize() - claimed_size_, state.requiredSize());
+    std::size_t suggested_size = std::max(state.requiredSize(), roundDown(suggestedInputSize(0), state.requiredSize()));
+
+    if (unclaimed_size < suggested_size)
+    {
+        return relaxed_size ? unclaimed_size : 0;
+    }
+
+    return suggested_size;
+}
+
+void Block::resetParts()
+{
+    parts_.clear();
+    claimed_size_ = 0;
+    free_replicas_.clear();
+
+    if (parts_mutex_)
+    {
+        // Free replicas are taken from the back, so the filter itself is used first.
+        for (std::size_t i = replicasCount(); i > 0; --i)
+        {
+            free_replicas_.push_back(i - 1);
+        }
+    }
+}
+
+void Block::commitParts()
+{
+    const OutputState& state = filter_.outputState(0);
+
+    while (!parts_.empty() && parts_.front().finished)
+    {
+        Part& part = parts_.front();
+        if (state.eof() || writers_[0].availableSize() < std::max(part.size, state.requiredSize()))
+        {
+            break;
+        }
+
+        UntypedSlice output = writers_[0].slice();
+        std::copy(part.output.data(), part.output.data() + part.size * state.typeSize(), output.data());
+
+        advanceReader(0, part.size);
+        advanceWriter(0, part.size);
+        consumed_samples_[0].fetch_add(part.size, std::memory_order_relaxed);
+        produced_samples_[0].fetch_add(part.size, std::memory_order_relaxed);
+
+        claimed_size_ -= part.size;
+        free_replicas_.push_back(part.replica);
+        parts_.pop_front();
+    }
+}
+
+void Block::advanceReader(std::size_t input_channel, std::size_t size)
+{
+    readers_[input_channel].advance(size);
+
+    // Space is freed in the buffer the output written in place shares with its input.
+    for (const CircularBufferWriter* writer = &readers_[input_channel].writer(); writer; writer = writer->inPlaceReader() ? &writer->inPlaceReader()->writer() : nullptr)
+    {
+        Block* producer = &writer->block().head();
+        if (std::find(advanced_producers_.begin(), advanced_producers_.end(), producer) == advanced_producers_.end())
+        {
+            advanced_producers_.push_back(producer);
+        }
+    }
+}
+
+void Block::advanceWriter(std::size_t output_channel, std::size_t size)
+{
+    writers_[output_channel].advance(size);
+
+    for (auto reader: writers_[output_channel].readers())
+    {
+        Block* consumer = &reader->block().head();
+        if (std::find(advanced_consumers_.begin(), advanced_consumers_.end(), consumer) == advanced_consumers_.end())
+        {
+            advanced_consumers_.push_back(consumer);
+        }
+    }
+}
+
+void Block::notifyAdvancedBlocks()
+{
+    notifyBlocks(advanced_producers_, advanced_consumers_);
+
+    advanced_producers_.clear();
+    advanced_consumers_.clear();
+}
+
+void Block::notifyAdvancedBlocks(std::unique_lock<std::mutex>& lock)
+{
+    std::vector<Block*> advanced_producers, advanced_consumers;
+    advanced_producers.swap(advanced_producers_);
+    advanced_consumers.swap(advanced_consumers_);
+
+    // Scheduling the neighbours might need their parts mutexes, which in turn
+    // might be held by the threads notifying this block.
+    lock.unlock();
+
+    notifyBlocks(advanced_producers, advanced_consumers);
+}
+
+void Block::notifyBlocks(const std::vector<Block*>& producers, const std::vector<Block*>& consumers)
+{
+    for (auto producer: producers)
+    {
+        pipeline_.outputAvailableSizeChanged(*producer);
+    }
+
+    for (auto consumer: consumers)
+    {
+        pipeline_.inputAvailableSizeChanged(*consumer);
+    }
+}
+
+bool Block::replicasSchedulable(bool relaxed_size)
+{
+    std::unique_lock<std::mutex> lock(*parts_mutex_);
+
+    if (!parts_.empty() && parts_.front().finished)
+    {
+        const OutputState& state = filter_.outputState(0);
+        if (!state.eof() && writers_[0].availableSize() >= std::max(parts_.front().size, state.requiredSize()))
+        {
+            return true;
+        }
+    }
+
+    return claimableSize(relaxed_size) > 0;
+}
+
+Block::Part* Block::claimPart(bool relaxed_size)
+{
+    std::unique_lock<std::mutex> lock(*parts_mutex_);
+
+    commitParts();
+
+    std::size_t size = claimableSize(relaxed_size);
+    if (!size)
+    {
+        notifyAdvancedBlocks(lock);
+        return nullptr;
+    }
+
+    const InputState& input_state = filter_.inputState(0);
+    const OutputState& output_state = filter_.outputState(0);
+
+    std::size_t replica = free_replicas_.back();
+    free_replicas_.pop_back();
+
+    AlignedVector<std::int8_t>& output = replicas_outputs_[replica];
+    if (output.size() < (size + output_state.padding()) * output_state.typeSize())
+    {
+        output.resize((size + output_state.padding()) * output_state.typeSize());
+    }
+
+    // The part starts after the input claimed by the previous parts,
+    // which ends with the history of this part.
+    UntypedSlice input = readers_[0].slice();
+    parts_.push_back(
+        Part{
+            replica,
+            size,
+            UntypedSlice(input.data() + claimed_size_ * input_state.typeSize(), input_state.historySize() + size),
+            UntypedSlice(&output[0], size),
+            scheduled_time_,
+            0,
+            false
+        }
+    );
+    claimed_size_ += size;
+
+    // References to the deque elements stay valid when the other parts are added or removed.
+    Part* part = &parts_.back();
+    notifyAdvancedBlocks(lock);
+
+    return part;
+}
+
+void Block::processPart(Part& part)
+{
+    UntypedSlice input = part.input, output = part.output;
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::uint64_t start_cpu_time = threadCpuTime();
+    queued_time_.fetch_add(elapsedTime(part.scheduled_time, start_time), std::memory_order_relaxed);
+
+    replica(part.replica).process(&input, &output);
+
+    part.cpu_time = threadCpuTime() - start_cpu_time;
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    wall_time_.fetch_add(elapsedTime(start_time, std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    cpu_time_.fetch_add(part.cpu_time, std::memory_order_relaxed);
+
+    CHECK_EQ(part.size, input.advancedSize()) << "Replicated filters must consume the whole input";
+    CHECK_EQ(part.size, output.advancedSize()) << "Replicated filters must produce as many samples as they consume";
+}
+
+void Block::finishPart(Part& part)
+{
+    std::unique_lock<std::mutex> lock(*parts_mutex_);
+
+    part.finished = true;
+
+    int chunk_size_level = chunk_size_tuner_.update(part.size, part.cpu_time);
+    chunk_size_level_.store(chunk_size_level, std::memory_order_relaxed);
+
+    commitParts();
+    notifyAdvancedBlocks(lock);
+}
+
+std::size_t Block::lastConsumedSize() const
+{
+    return last_consumed_size_;
+}
+
+std::size_t Block::lastProducedSize() const
+{
+    return last_produced_size_;
+}
+
+void Block::resetStats()
+{
+    calls_.store(0);
+    wall_time_.store(0);
+    cpu_time_.store(0);
+    queued_time_.store(0);
+    steals_.store(0);
+
+    for (auto& consumed_samples: consumed_samples_)
+    {
+        consumed_samples.store(0);
+    }
+
+    for (auto& produced_samples: produced_samples_)
+    {
+        produced_samples.store(0);
+    }
+}
+
+void Block::markScheduled()
+{
+    scheduled_time_ = std::chrono::steady_clock::now();
+}
+
+void Block::markStolen()
+{
+    steals_.fetch_add(1, std::memory_order_relaxed);
+}
+
 void Block::reset()
 {
     filter_.reset();
+    for (auto& replica: replicas_)
+    {
+        replica->reset();
+    }
+
+    resetParts();
+    resetStats();
+    next_burst_time_ = std::chrono::steady_clock::time_point();
+    burst_held_ = false;
 
     for (std::size_t i = 0; i < readers_.size(); ++i)
     {
@@ -155,18 +754,87 @@ void Block::reset()
 
 void Block::process()
 {
+    queued_time_.fetch_add(elapsedTime(scheduled_time_, std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    last_consumed_size_ = last_produced_size_ = 0;
+
+    runFilter(false);
+}
+
+bool Block::processPeriod()
+{
+    CHECK(periodic());
+
+    queued_time_.fetch_add(elapsedTime(scheduled_time_, std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    last_consumed_size_ = last_produced_size_ = 0;
+
+    period_input_remaining_ = period_input_sizes_;
+    period_output_remaining_ = period_output_sizes_;
+
+    while (true)
+    {
+        bool finished = true, available = true;
+
+        for (std::size_t i = 0; i < readers_.size(); ++i)
+        {
+            std::size_t remaining_size = period_input_remaining_[i];
+            const InputState& state = filter_.inputState(i);
+            finished = finished && !remaining_size;
+            available = available && (!remaining_size || (remaining_size >= state.requiredSize() && readers_[i].availableSize() >= state.historySize() + remaining_size));
+        }
+
+        for (std::size_t i = 0; i < writers_.size(); ++i)
+        {
+            std::size_t remaining_size = period_output_remaining_[i];
+            finished = finished && !remaining_size;
+            available = available && (!remaining_size || (remaining_size >= filter_.outputState(i).requiredSize() && writers_[i].availableSize() >= remaining_size));
+        }
+
+        if (finished)
+        {
+            return true;
+        }
+
+        if (!available || !runFilter(true))
+        {
+            return false;
+        }
+    }
+}
+
+bool Block::runFilter(bool period)
+{
+    std::size_t consumed_size = 0, produced_size = 0;
+
     for (std::size_t i = 0; i < readers_.size(); ++i)
     {
         inputs_[i] = readers_[i].slice();
+        if (period)
+        {
+            std::size_t period_size = filter_.inputState(i).historySize() + period_input_remaining_[i];
+            inputs_[i] = UntypedSlice(inputs_[i].data(), std::min(inputs_[i].size(), period_size));
+        }
     }
 
     for (std::size_t i = 0; i < writers_.size(); ++i)
     {
         outputs_[i] = writers_[i].slice();
+        if (period)
+        {
+            outputs_[i] = UntypedSlice(outputs_[i].data(), std::min(outputs_[i].size(), period_output_remaining_[i]));
+        }
     }
 
+    // Only the filter itself is timed, slicing and advancing the buffers is the pipeline overhead.
+    auto start_time = std::chrono::steady_clock::now();
+    std::uint64_t start_cpu_time = threadCpuTime();
+
     filter_.process(inputs_.size() ? &inputs_[0] : nullptr, outputs_.size() ? &outputs_[0] : nullptr);
 
+    std::uint64_t cpu_time = threadCpuTime() - start_cpu_time;
+    calls_.fetch_add(1, std::memory_order_relaxed);
+    wall_time_.fetch_add(elapsedTime(start_time, std::chrono::steady_clock::now()), std::memory_order_relaxed);
+    cpu_time_.fetch_add(cpu_time, std::memory_order_relaxed);
+
     for (std::size_t i = 0; i < inputs_.size(); ++i)
     {
         std::size_t advance_size = inputs_[i].advancedSize();
@@ -176,7 +844,14 @@ void Block::process()
         );
         if (advance_size)
         {
-            readers_[i].advance(advance_size);
+            advanceReader(i, advance_size);
+            consumed_samples_[i].fetch_add(advance_size, std::memory_order_relaxed);
+            consumed_size += advance_size;
+        }
+
+        if (period)
+        {
+            period_input_remaining_[i] -= advance_size;
         }
     }
 
@@ -184,9 +859,30 @@ void Block::process()
     {
         std::size_t advance_size = outputs_[i].advancedSize();
         CHECK(advance_size >= filter_.outputState(i).providedSize() || filter_.outputState(i).eof());
+        if (writers_[i].inPlaceReader())
+        {
+            CHECK_EQ(inputs_[filter_.outputState(i).inPlaceInput()].advancedSize(), advance_size);
+        }
         if (advance_size)
         {
-            writers_[i].advance(advance_size);
+            advanceWriter(i, advance_size);
+            produced_samples_[i].fetch_add(advance_size, std::memory_order_relaxed);
+            produced_size += advance_size;
+        }
+
+        if (period)
+        {
+            period_output_remaining_[i] -= advance_size;
         }
     }
+
+    last_consumed_size_ += consumed_size;
+    last_produced_size_ += produced_size;
+
+    notifyAdvancedBlocks();
+
+    int chunk_size_level = chunk_size_tuner_.update(readers_.empty() ? produced_size : consumed_size, cpu_time);
+    chunk_size_level_.store(chunk_size_level, std::memory_order_relaxed);
+
+    return consumed_size || produced_size;
 }
@@ -18,12 +18,36 @@
 #pragma once
 
 #include <hvylya/filters/ifilter.h>
+#include <hvylya/pipelines/async/chunk_size_tuner.h>
 #include <hvylya/pipelines/async/circular_buffer.h>
 
+#include <chrono>
+
 namespace hvylya {
 namespace pipelines {
 namespace async {
 
+class Pipeline;
+
+// Snapshot of the block execution statistics accumulated since the last reset.
+struct BlockStats
+{
+    const filters::IFilter* filter;
+    std::string name;
+    std::uint64_t calls;
+    // Time spent in IFilter::process().
+    std::chrono::nanoseconds wall_time, cpu_time;
+    // Time the block spent scheduled, but waiting for a thread to run it.
+    std::chrono::nanoseconds queued_time;
+    // Number of times the block was stolen by a work stealing thread from the queue of another one.
+    std::uint64_t steals;
+    // Wall time the most expensive chain of blocks from a source to a sink going through
+    // the block takes per 1000 samples of the sources, as last measured by the critical
+    // path scheduling policy, with the chains feeding real-time sinks weighted up.
+    std::chrono::nanoseconds critical_path;
+    std::vector<std::uint64_t> consumed_samples, produced_samples;
+};
+
 class Block: core::NonCopyable
 {
   public:
@@ -35,12 +59,31 @@ class Block: core::NonCopyable
         Running
     };
 
+    // Replicated blocks process their input in parts, each by its own replica of the filter:
+    // parts cover consecutive ranges of the input, preceded by their history, and are
+    // processed into private outputs, which are committed in order once they are finished.
+    struct Part
+    {
+        std::size_t replica, size;
+        core::UntypedSlice input, output;
+        std::chrono::steady_clock::time_point scheduled_time;
+        std::uint64_t cpu_time;
+        bool finished;
+    };
+
+    // Output buffers are allocated later by the pipeline, once all readers are connected.
     Block(Pipeline& pipeline, filters::IFilter& filter);
 
     Block(Block&& block);
 
     std::atomic<State>& state();
 
+    // For the blocks with the poll descriptor: whether epoll has reported it ready
+    // since the block last ran, and whether the descriptor is currently waited for.
+    std::atomic<bool>& pollReady();
+
+    std::atomic<bool>& pollArmed();
+
     std::size_t inputChannelsCount() const;
 
     std::size_t outputChannelsCount() const;
@@ -49,6 +92,53 @@ class Block: core::NonCopyable
 
     const filters::OutputState& outputState(std::size_t output_channel) const;
 
+    // Suggested sizes of the filter adjusted by the chunk size tuning.
+    std::size_t suggestedInputSize(std::size_t input_channel) const;
+
+    std::size_t suggestedOutputSize(std::size_t output_channel) const;
+
+    // Must be called after all the blocks are connected, while the pipeline is stopped.
+    // Levels limits are clamped to the chunk sizes the buffers can accommodate.
+    void setChunkSizeTuning(ChunkSizeTuning tuning, int min_level, int max_level);
+
+    // The smallest number of blocks the output of this block passes through before
+    // reaching a sink, used to prioritize blocks in latency-oriented scheduling.
+    std::size_t sinkDistance() const;
+
+    void setSinkDistance(std::size_t sink_distance);
+
+    // Blocks consuming the outputs of this one.
+    const std::vector<Block*>& consumers() const;
+
+    void addConsumer(Block& block);
+
+    // See BlockStats::critical_path.
+    std::chrono::nanoseconds criticalPath() const;
+
+    void setCriticalPath(std::chrono::nanoseconds critical_path);
+
+    // Time spent in IFilter::process() since the last reset.
+    std::chrono::nanoseconds wallTime() const;
+
+    // Number of samples produced on the given output channel since the last reset.
+    std::uint64_t producedSamples(std::size_t output_channel) const;
+
+    // Blocks consuming the output of the sources directly, which hold it back
+    // between the bursts when the pipeline has a latency budget.
+    bool burstGated() const;
+
+    void setBurstGated(bool burst_gated);
+
+    // Time the gated block can start its next burst at.
+    std::chrono::steady_clock::time_point nextBurstTime() const;
+
+    void setNextBurstTime(std::chrono::steady_clock::time_point next_burst_time);
+
+    // Whether the gated block holds its input back until the next burst time.
+    bool burstHeld() const;
+
+    void setBurstHeld(bool burst_held);
+
     const CircularBufferReader& reader(std::size_t input_channel) const;
 
     CircularBufferReader& reader(std::size_t input_channel);
@@ -59,19 +149,143 @@ class Block: core::NonCopyable
 
     const filters::IFilter& filter() const;
 
+    filters::IFilter& filter();
+
+    // Blocks fused into a chain are scheduled as a single unit represented
+    // by the head of the chain. Unfused blocks are heads of their own chains.
+    Block& head();
+
+    // All the blocks of the chain in execution order, starting from the head.
+    // Can be called on the head only.
+    const std::vector<Block*>& fusedBlocks() const;
+
+    // Appends the given unfused block to the chain of this head block.
+    void fuse(Block& block);
+
+    // Number of samples the filter consumes / produces on each channel per period
+    // of its static schedule, see processPeriod(). Empty sizes disable the periods.
+    void setPeriod(const std::vector<std::size_t>& input_sizes, const std::vector<std::size_t>& output_sizes);
+
+    bool periodic() const;
+
+    std::size_t periodInputSize(std::size_t input_channel) const;
+
+    std::size_t periodOutputSize(std::size_t output_channel) const;
+
+    // Sets the number of parts that can be processed concurrently, creating the replicas of
+    // the filter as needed. Returns false and leaves the block unreplicated if the filter
+    // cannot be replicated.
+    // Must be called while the pipeline is stopped.
+    bool replicate(std::size_t replicas_count);
+
+    std::size_t replicasCount() const;
+
+    // Whether there's either a part to claim or a finished part that can be committed.
+    bool replicasSchedulable(bool relaxed_size);
+
+    // Commits the finished parts and claims the next one, if possible.
+    // Must be called by the thread running the block.
+    Part* claimPart(bool relaxed_size);
+
+    // Can be called concurrently for different parts.
+    void processPart(Part& part);
+
+    void finishPart(Part& part);
+
     std::string internalState() const;
 
+    BlockStats stats() const;
+
+    // Total number of samples consumed / produced on all channels by the last process() call.
+    std::size_t lastConsumedSize() const;
+
+    std::size_t lastProducedSize() const;
+
+    // Must be called right before the block is put into the queue.
+    void markScheduled();
+
+    // Must be called by the thread that has just stolen the block.
+    void markStolen();
+
     void reset();
 
     void process();
 
+    // Processes exactly one period, calling the filter as many times as it takes, e.g. when
+    // the period crosses the end of the buffer. Returns false if the filter stops short
+    // of the period, as its buffers don't have it available.
+    bool processPeriod();
+
   private:
     Pipeline& pipeline_;
     filters::IFilter& filter_;
     std::atomic<State> state_;
+    std::atomic<bool> poll_ready_, poll_armed_;
     std::vector<CircularBufferReader> readers_;
     std::vector<CircularBufferWriter> writers_;
     std::vector<core::UntypedSlice> inputs_, outputs_;
+    std::size_t last_consumed_size_, last_produced_size_;
+    Block* head_;
+    std::vector<Block*> fused_blocks_;
+    std::size_t sink_distance_;
+    std::vector<Block*> consumers_;
+    // Heads of the chains on the other ends of the buffers advanced by the current step,
+    // each listed once, no matter how many of its channels the step has advanced.
+    std::vector<Block*> advanced_producers_, advanced_consumers_;
+    std::vector<std::size_t> period_input_sizes_, period_output_sizes_;
+    // Parts of the current period still to be processed.
+    std::vector<std::size_t> period_input_remaining_, period_output_remaining_;
+    std::atomic<std::int64_t> critical_path_;
+    bool burst_gated_;
+    // Protected by the bursts mutex of the pipeline.
+    std::chrono::steady_clock::time_point next_burst_time_;
+    std::atomic<bool> burst_held_;
+    ChunkSizeTuner chunk_size_tuner_;
+    // Replicas of the filter other than the filter itself, which is replica 0.
+    std::vector<std::unique_ptr<filters::IFilter>> replicas_;
+    // Everything below is protected by the mutex, which exists for replicated blocks only.
+    // Other blocks must never be notified with it held, as that might need their mutexes.
+    std::unique_ptr<std::mutex> parts_mutex_;
+    std::deque<Part> parts_;
+    std::vector<std::size_t> free_replicas_;
+    std::vector<core::AlignedVector<std::int8_t>> replicas_outputs_;
+    // Size of the input claimed by the parts that are not committed yet.
+    std::size_t claimed_size_;
+    // Used by other threads for scheduling decisions.
+    std::atomic<int> chunk_size_level_;
+    // Statistics are updated only by the thread running the block,
+    // atomics are used so that they can be read concurrently.
+    std::chrono::steady_clock::time_point scheduled_time_;
+    std::atomic<std::uint64_t> calls_, wall_time_, cpu_time_, queued_time_, steals_;
+    std::vector<std::atomic<std::uint64_t>> consumed_samples_, produced_samples_;
+
+    void resetStats();
+
+    // Limits the slices to the rest of the period if requested, returns whether anything was processed.
+    bool runFilter(bool period);
+
+    bool validChunkSizeLevel(int level) const;
+
+    filters::IFilter& replica(std::size_t index);
+
+    // Size of the part that can be claimed next, 0 if there's none.
+    std::size_t claimableSize(bool relaxed_size) const;
+
+    void resetParts();
+
+    void commitParts();
+
+    void advanceReader(std::size_t input_channel, std::size_t size);
+
+    void advanceWriter(std::size_t output_channel, std::size_t size);
+
+    // Lets the pipeline reconsider each of the blocks affected by the current step once.
+    void notifyAdvancedBlocks();
+
+    // Same for the parts committed under the lock, which is released before notifying.
+    void notifyAdvancedBlocks(std::unique_lock<std::mutex>& lock);
+
+    void notifyBlocks(const std::vector<Block*>& producers, const std::vector<Block*>& consumers);
 };
 
 } // namespace async
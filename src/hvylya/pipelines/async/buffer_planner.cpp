@@ -0,0 +1,188 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/buffer_planner.h>
+
+#include <hvylya/filters/io_states.h>
+
+#include <unistd.h>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+// Lets the writer run far ahead of the readers, so that they are scheduled rarely.
+const std::size_t DefaultBufferScale = 64;
+// Enough for the writer and the readers to always get suggested sizes
+// when they run back to back.
+const std::size_t EfficientBufferScale = 4;
+// Used when the size of L2 cache cannot be detected.
+const std::size_t DefaultCacheSize = 256 * 1024;
+
+std::size_t interpolate(std::size_t from, std::size_t to, double fraction)
+{
+    return from + std::size_t(double(to - from) * fraction);
+}
+
+} // anonymous namespace
+
+BufferPlanner::BufferPlanner(BufferBackend buffer_backend, std::size_t memory_budget, bool cache_aware):
+    buffer_backend_(buffer_backend),
+    memory_budget_(memory_budget),
+    cache_aware_(cache_aware)
+{
+}
+
+std::size_t BufferPlanner::cacheSize()
+{
+    long cache_size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+    return cache_size > 0 ? std::size_t(cache_size) : DefaultCacheSize;
+}
+
+void BufferPlanner::addBuffer(Block& block, std::size_t output_channel, bool fused, std::size_t sink_replicas, std::size_t period_size)
+{
+    CircularBufferWriter& writer = block.writer(output_channel);
+    const IFilter& filter = block.filter();
+    std::size_t suggested_size = filter.outputState(output_channel).suggestedSize();
+
+    std::size_t max_input_size = 0, max_history_size = 0;
+    for (auto& sink: filter.sinks(output_channel))
+    {
+        const InputState& sink_state = std::get<0>(sink).inputState(std::get<1>(sink));
+        max_input_size = std::max(max_input_size, sink_state.historySize() + sink_state.suggestedSize());
+        max_history_size = std::max(max_history_size, sink_state.historySize());
+    }
+
+    Buffer buffer;
+    buffer.writer = &writer;
+    buffer.buffer_backend = sink_replicas > 1 ? BufferBackend::Mirrored : buffer_backend_;
+    buffer.layout.filter = &filter;
+    buffer.layout.name = typeid(filter).name();
+    buffer.layout.output_channel = output_channel;
+    buffer.layout.type_size = writer.typeSize();
+    buffer.layout.min_size = writer.minBufferSize(buffer.buffer_backend);
+    buffer.layout.efficient_size =
+        std::max(
+            buffer.layout.min_size,
+            roundUp(EfficientBufferScale * sink_replicas * std::max(suggested_size, max_input_size), std::size_t(MaxSimdByteSize))
+        );
+    buffer.layout.size = 0;
+
+    if (period_size)
+    {
+        // Deterministic size: the budget never scales it, as it's efficient and preferred at the same time.
+        buffer.layout.efficient_size =
+            std::max(buffer.layout.min_size, roundUp(period_size + max_history_size, std::size_t(MaxSimdByteSize)));
+        buffer.preferred_size = buffer.layout.efficient_size;
+        buffers_.push_back(std::move(buffer));
+        return;
+    }
+
+    buffer.preferred_size =
+        fused ?
+        buffer.layout.efficient_size :
+        std::max(buffer.layout.efficient_size, DefaultBufferScale * suggested_size);
+
+    if (cache_aware_)
+    {
+        std::size_t cache_limit = roundDown(cacheSize() / 2 / buffer.layout.type_size, std::size_t(MaxSimdByteSize));
+        buffer.preferred_size = std::max(buffer.layout.efficient_size, std::min(buffer.preferred_size, cache_limit));
+    }
+
+    buffers_.push_back(std::move(buffer));
+}
+
+std::vector<BufferLayout> BufferPlanner::allocate()
+{
+    std::size_t total_min_size = 0, total_efficient_size = 0, total_preferred_size = 0;
+    for (auto& buffer: buffers_)
+    {
+        if (buffer.writer->inPlaceReader())
+        {
+            continue;
+        }
+
+        total_min_size += buffer.layout.min_size * buffer.layout.type_size;
+        total_efficient_size += buffer.layout.efficient_size * buffer.layout.type_size;
+        total_preferred_size += buffer.preferred_size * buffer.layout.type_size;
+    }
+
+    if (memory_budget_ && total_min_size > memory_budget_)
+    {
+        LOG(WARNING) <<
+            fmt::format(
+                "Minimal buffers size = {0} exceeds the memory budget = {1}, using the minimal sizes",
+                total_min_size,
+                memory_budget_
+            );
+    }
+
+    std::vector<BufferLayout> layout;
+    std::size_t total_size = 0;
+
+    for (auto& buffer: buffers_)
+    {
+        if (buffer.writer->inPlaceReader())
+        {
+            if (buffer.writer->shareBuffer())
+            {
+                continue;
+            }
+
+            LOG(WARNING) << "Mirrored buffer is not available, not writing " << buffer.layout.name << " output in place";
+            buffer.layout.size = buffer.layout.efficient_size;
+        }
+        else if (!memory_budget_ || total_preferred_size <= memory_budget_)
+        {
+            buffer.layout.size = buffer.preferred_size;
+        }
+        else if (total_efficient_size <= memory_budget_)
+        {
+            buffer.layout.size =
+                interpolate(
+                    buffer.layout.efficient_size,
+                    buffer.preferred_size,
+                    double(memory_budget_ - total_efficient_size) / double(total_preferred_size - total_efficient_size)
+                );
+        }
+        else if (total_min_size <= memory_budget_)
+        {
+            buffer.layout.size =
+                interpolate(
+                    buffer.layout.min_size,
+                    buffer.layout.efficient_size,
+                    double(memory_budget_ - total_min_size) / double(total_efficient_size - total_min_size)
+                );
+        }
+        else
+        {
+            buffer.layout.size = buffer.layout.min_size;
+        }
+
+        buffer.layout.size = buffer.writer->allocate(buffer.layout.size, buffer.buffer_backend);
+        total_size += buffer.layout.size * buffer.layout.type_size;
+
+        layout.push_back(buffer.layout);
+    }
+
+    LOG(INFO) << fmt::format("Allocated {0} buffers, total size = {1}", layout.size(), total_size);
+
+    buffers_.clear();
+    return layout;
+}
@@ -0,0 +1,87 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/pipelines/async/block.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+// Sizes are in elements of the corresponding output.
+struct BufferLayout
+{
+    const filters::IFilter* filter;
+    std::string name;
+    std::size_t output_channel, type_size;
+    // The smallest size the filters can work with, the size that lets them always
+    // get their suggested chunks and the size that was actually allocated.
+    std::size_t min_size, efficient_size, size;
+};
+
+// Decides on the sizes of all output buffers of the blocks at once,
+// then allocates them:
+//
+// * Every buffer starts from its preferred size: a large multiple of the suggested
+//   output size to decouple the writer from the readers, or just a few chunks for
+//   fused blocks, which run back to back anyway.
+// * Cache-aware sizing caps the preferred size at half of the L2 cache, so that
+//   the data written by the producer is still cached when the consumer reads it,
+//   but never below the efficient size.
+// * Buffers between the filters of the same static schedule hold exactly one period
+//   of the schedule plus the history of the readers, with neither caps nor scaling.
+// * If the total exceeds the memory budget, all buffers shrink proportionally
+//   towards their efficient sizes first and towards their minimal sizes next.
+// * Outputs written in place share the buffers of their inputs and get none
+//   of their own, unless the shared buffer turns out to be a copying one.
+class BufferPlanner: core::NonCopyable
+{
+  public:
+    // Memory budget is in bytes, 0 means unlimited.
+    BufferPlanner(BufferBackend buffer_backend, std::size_t memory_budget, bool cache_aware);
+
+    // Must be called after all readers of the output are connected. Outputs read by
+    // the replicated blocks always use the mirrored backend and fit all their replicas.
+    // Period size is the number of samples the output gets per period of its static
+    // schedule, 0 if it's not within one. Outputs written in place must be added after
+    // the outputs whose buffers they share.
+    void addBuffer(Block& block, std::size_t output_channel, bool fused, std::size_t sink_replicas, std::size_t period_size);
+
+    std::vector<BufferLayout> allocate();
+
+    // Returns the size of L2 cache in bytes or the reasonable default if it's not known.
+    static std::size_t cacheSize();
+
+  private:
+    struct Buffer
+    {
+        CircularBufferWriter* writer;
+        BufferBackend buffer_backend;
+        BufferLayout layout;
+        std::size_t preferred_size;
+    };
+
+    BufferBackend buffer_backend_;
+    std::size_t memory_budget_;
+    bool cache_aware_;
+    std::vector<Buffer> buffers_;
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
@@ -0,0 +1,202 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/chunk_size_tuner.h>
+
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+// Number of calls to average before making the decision.
+const std::size_t WindowCalls = 32;
+
+// The per-sample cost must improve at least that much to move to another level.
+const double MinCostImprovement = 0.03;
+
+// Maximal share of the per-call overhead in the call time for latency tuning.
+const double LatencyOverheadShare = 0.25;
+
+// Levels with chunks sizes closer than that cannot be used for fitting the model.
+const double MinSamplesDifference = 0.1;
+
+} // anonymous namespace
+
+ChunkSizeTuner::ChunkSizeTuner()
+{
+    reset(ChunkSizeTuning::Disabled, 0, 0);
+}
+
+void ChunkSizeTuner::reset(ChunkSizeTuning tuning, int min_level, int max_level)
+{
+    CHECK_LE(min_level, max_level);
+
+    tuning_ = tuning;
+    min_level_ = min_level;
+    max_level_ = max_level;
+    level_ = std::clamp(0, min_level_, max_level_);
+    window_calls_ = 0;
+    window_samples_ = 0;
+    window_time_ = 0;
+    measurements_.assign(std::size_t(max_level_ - min_level_ + 1), Measurement{0, 0, false});
+}
+
+int ChunkSizeTuner::level() const
+{
+    return level_;
+}
+
+int ChunkSizeTuner::update(std::size_t samples, std::uint64_t time)
+{
+    if (tuning_ == ChunkSizeTuning::Disabled)
+    {
+        return level_;
+    }
+
+    window_samples_ += double(samples);
+    window_time_ += double(time);
+
+    if (++window_calls_ < WindowCalls)
+    {
+        return level_;
+    }
+
+    measurements_[std::size_t(level_ - min_level_)] =
+        Measurement{window_samples_ / double(window_calls_), window_time_ / double(window_calls_), true};
+    window_calls_ = 0;
+    window_samples_ = 0;
+    window_time_ = 0;
+
+    if (measurement(level_).samples > 0)
+    {
+        level_ = tuning_ == ChunkSizeTuning::Throughput ? throughputLevel() : latencyLevel();
+    }
+
+    return level_;
+}
+
+const ChunkSizeTuner::Measurement& ChunkSizeTuner::measurement(int level) const
+{
+    static const Measurement Invalid{0, 0, false};
+    return level >= min_level_ && level <= max_level_ ? measurements_[std::size_t(level - min_level_)] : Invalid;
+}
+
+int ChunkSizeTuner::throughputLevel() const
+{
+    auto cost =
+        [this](int level)
+        {
+            const Measurement& m = measurement(level);
+            return m.valid && m.samples > 0 ? m.time / m.samples : std::numeric_limits<double>::infinity();
+        };
+
+    double current_cost = cost(level_);
+    int best_level = level_;
+    double best_cost = current_cost * (1 - MinCostImprovement);
+
+    for (int level: { level_ - 1, level_ + 1 })
+    {
+        if (cost(level) < best_cost)
+        {
+            best_level = level;
+            best_cost = cost(level);
+        }
+    }
+
+    if (best_level != level_)
+    {
+        return best_level;
+    }
+
+    // Explore the unknown neighbours as long as the levels visited so far
+    // improve in their direction, trying larger chunks first.
+    for (int level: { level_ + 1, level_ - 1 })
+    {
+        int opposite_level = 2 * level_ - level;
+        if (level >= min_level_ && level <= max_level_ && !measurement(level).valid && current_cost < cost(opposite_level))
+        {
+            return level;
+        }
+    }
+
+    return level_;
+}
+
+int ChunkSizeTuner::latencyLevel() const
+{
+    const Measurement& current = measurement(level_);
+
+    // Fit the model using the nearest level with sufficiently different chunk size.
+    const Measurement* other = nullptr;
+    bool measured = false;
+    for (int distance = 1; !other && distance <= max_level_ - min_level_; ++distance)
+    {
+        for (int level: { level_ - distance, level_ + distance })
+        {
+            const Measurement& m = measurement(level);
+            measured = measured || m.valid;
+            if (!other && m.valid && std::abs(m.samples - current.samples) >= MinSamplesDifference * current.samples)
+            {
+                other = &m;
+            }
+        }
+    }
+
+    if (!other)
+    {
+        if (measured)
+        {
+            // Chunk size doesn't follow the level, e.g. for sources
+            // that always produce fixed chunks - nothing to tune.
+            return level_;
+        }
+
+        // Probe the neighbour level to get the second point for the model.
+        return level_ > min_level_ ? level_ - 1 : std::min(level_ + 1, max_level_);
+    }
+
+    double sample_cost = (current.time - other->time) / (current.samples - other->samples);
+    double call_overhead = current.time - sample_cost * current.samples;
+
+    if (sample_cost <= 0)
+    {
+        // Overhead dominates so much that the per-sample cost is not even measurable.
+        return std::min(level_ + 1, max_level_);
+    }
+
+    if (call_overhead <= 0)
+    {
+        // No measurable overhead: the smaller chunks, the better.
+        return std::max(level_ - 1, min_level_);
+    }
+
+    double target_samples = call_overhead * (1 - LatencyOverheadShare) / (LatencyOverheadShare * sample_cost);
+    // Chunk sizes are proportional to 2 ^ level, allow some hysteresis around the target.
+    double target_level = double(level_) + std::log2(target_samples / current.samples);
+
+    if (target_level > double(level_) + 0.5)
+    {
+        return std::min(level_ + 1, max_level_);
+    }
+    else if (target_level < double(level_) - 0.5)
+    {
+        return std::max(level_ - 1, min_level_);
+    }
+    else
+    {
+        return level_;
+    }
+}
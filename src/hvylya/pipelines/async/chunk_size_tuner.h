@@ -0,0 +1,83 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+enum class ChunkSizeTuning: std::int8_t
+{
+    // Suggested sizes of the filters are used as is.
+    Disabled,
+    // Chunks grow until the per-call overhead becomes negligible.
+    Throughput,
+    // Chunks stay as small as possible while keeping the per-call overhead moderate.
+    Latency
+};
+
+// Scales the chunk size of a block by powers of two (levels), measuring the average
+// call at each level it visits:
+//
+// * For throughput, it climbs down the per-sample cost (the call time divided by
+//   the chunk size, so that the per-call overhead is amortized), exploring
+//   the neighbour levels for as long as that improves the cost.
+// * For latency, it models the call time as a fixed per-call overhead plus
+//   a per-sample cost, fitting both on the measurements of two levels, and moves
+//   towards the smallest chunk size at which the overhead takes at most a quarter
+//   of the call time.
+class ChunkSizeTuner
+{
+  public:
+    ChunkSizeTuner();
+
+    // Level 0 corresponds to the suggested sizes of the filter. Tuning starts
+    // from the level closest to 0 within the specified limits.
+    void reset(ChunkSizeTuning tuning, int min_level, int max_level);
+
+    int level() const;
+
+    // Accounts the call that has processed the specified number of samples
+    // in the specified time and returns the level to use for the next calls.
+    int update(std::size_t samples, std::uint64_t time);
+
+  private:
+    struct Measurement
+    {
+        double samples, time;
+        bool valid;
+    };
+
+    ChunkSizeTuning tuning_;
+    int min_level_, max_level_, level_;
+    std::size_t window_calls_;
+    double window_samples_, window_time_;
+    std::vector<Measurement> measurements_;
+
+    const Measurement& measurement(int level) const;
+
+    int throughputLevel() const;
+
+    int latencyLevel() const;
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
@@ -20,53 +20,55 @@
 #include <hvylya/filters/io_states.h>
 
 #include <hvylya/pipelines/async/block.h>
-#include <hvylya/pipelines/async/pipeline.h>
 
+#include <numeric>
 #include <sstream>
 
 using namespace hvylya::core;
 using namespace hvylya::pipelines::async;
 
-CircularBufferReader::CircularBufferReader(Pipeline& pipeline, Block& block, std::size_t input_channel):
+CircularBufferReader::CircularBufferReader(Block& block, std::size_t input_channel):
     output_(nullptr),
-    pipeline_(pipeline),
     block_(block),
     input_channel_(input_channel),
     history_size_(block.inputState(input_channel).historySize()),
     delay_(block.inputState(input_channel).delay()),
     min_combined_input_size_(history_size_ + block.inputState(input_channel).requiredSize()),
-    suggested_input_size_(history_size_ + block.inputState(input_channel).suggestedSize()),
-    padding_(block.inputState(input_channel).padding()),
-    input_index_(0),
-    wrap_flag_(false)
+    padding_(block.inputState(input_channel).padding())
 {
-    available_size_.store(0);
-    wrapping_.store(false);
+    input_position_.store(0);
 }
 
 CircularBufferReader::CircularBufferReader(CircularBufferReader&& reader):
     output_(reader.output_),
-    pipeline_(reader.pipeline_),
     block_(reader.block_),
     input_channel_(reader.input_channel_),
     history_size_(reader.history_size_),
     delay_(reader.delay_),
     min_combined_input_size_(reader.min_combined_input_size_),
-    suggested_input_size_(reader.suggested_input_size_),
-    padding_(reader.padding_),
-    input_index_(reader.input_index_),
-    wrap_flag_(reader.wrap_flag_)
+    padding_(reader.padding_)
 {
-    available_size_.store(reader.available_size_.load());
-    wrapping_.store(reader.wrapping_.load());
+    input_position_.store(reader.input_position_.load());
 }
 
 void CircularBufferReader::reset()
 {
-    input_index_ = 0;
-    wrap_flag_ = false;
-    available_size_.store(0);
-    wrapping_.store(false);
+    input_position_.store(output_->initial_position_ + delay_ - history_size_);
+}
+
+Block& CircularBufferReader::block() const
+{
+    return block_;
+}
+
+std::size_t CircularBufferReader::inputChannel() const
+{
+    return input_channel_;
+}
+
+const CircularBufferWriter& CircularBufferReader::writer() const
+{
+    return *output_;
 }
 
 void CircularBufferReader::setWriter(CircularBufferWriter& writer)
@@ -74,315 +76,556 @@ void CircularBufferReader::setWriter(CircularBufferWriter& writer)
     output_ = &writer;
 }
 
-void CircularBufferReader::adjust()
+std::size_t CircularBufferReader::inputOffset(std::size_t input_position, std::size_t base_position, std::size_t previous_size) const
 {
-    if (wrap_flag_ != output_->wrap_flag_)
+    if (output_->mirrored_data_)
     {
-        // Output has wrapped already. Are we close enough to the end of the buffer
-        // to wrap our input as well?
-        if (output_->current_size_ - input_index_ <= output_->overlap_)
-        {
-            input_index_ = output_->overlap_ - (output_->current_size_ - input_index_);
-            wrap_flag_ = !wrap_flag_;
-        }
+        return input_position % output_->buffer_size_;
     }
 
-    available_size_.store(
-        (wrap_flag_ == output_->wrap_flag_) ?
-        output_->output_index_ - input_index_ :
-        output_->current_size_ - input_index_
-    );
-
-    wrapping_.store(
-        (wrap_flag_ == output_->wrap_flag_) ?
-        output_->data_size_ - input_index_ < suggested_input_size_ :
-        output_->current_size_ - input_index_ < suggested_input_size_
-    );
+    // Inputs that have reached the last overlap_ elements of the previous lap
+    // continue from the copy of these elements at the beginning of the buffer.
+    return
+        input_position >= base_position ?
+        input_position - base_position :
+        previous_size - (base_position + output_->overlap_ - input_position);
+}
 
-    // Notify pipeline about input size change.
-    pipeline_.inputAvailableSizeChanged(block_, input_channel_);
+std::size_t CircularBufferReader::availableSize() const
+{
+    // Output position must be loaded before the lap, see CircularBufferWriter::startLap().
+    std::size_t output_position = output_->output_position_.load(std::memory_order_acquire);
+    CircularBufferWriter::Lap lap = output_->currentLap();
+    std::size_t input_position = input_position_.load(std::memory_order_acquire);
+
+    return
+        input_position >= lap.base_position ?
+        output_position - input_position :
+        lap.base_position + output_->overlap_ - input_position;
 }
 
-void CircularBufferReader::advance(std::size_t size)
+std::size_t CircularBufferReader::bufferSize() const
 {
-    std::lock_guard<std::mutex> lock(output_->mutex_);
+    return output_->data_size_;
+}
 
-    output_->verify();
-    CHECK_LE(input_index_ + size, output_->data_size_) << "advance(" << size << "): "<< output_->internalState();
-    CHECK(wrap_flag_ != output_->wrap_flag_ || input_index_ + size <= output_->output_index_) << "advance(" << size << "): "<< output_->internalState();
+bool CircularBufferReader::mirrored() const
+{
+    return output_->mirrored_data_ != nullptr;
+}
 
-    input_index_ += size;
-    adjust();
+bool CircularBufferReader::wrapping(std::size_t suggested_size) const
+{
+    if (output_->mirrored_data_)
+    {
+        return false;
+    }
 
-    // Finished our internal data update - notify output about them.
-    output_->updateMinInputIndex();
+    CircularBufferWriter::Lap lap = output_->currentLap();
+    std::size_t input_position = input_position_.load(std::memory_order_acquire);
 
-    output_->verify();
+    return
+        input_position >= lap.base_position ?
+        output_->data_size_ - (input_position - lap.base_position) < history_size_ + suggested_size :
+        lap.base_position + output_->overlap_ - input_position < history_size_ + suggested_size;
 }
 
-std::size_t CircularBufferReader::availableSize() const
+void CircularBufferReader::advance(std::size_t size)
 {
-    return available_size_.load();
-}
+    std::size_t output_position = output_->output_position_.load(std::memory_order_acquire);
+    CircularBufferWriter::Lap lap = output_->currentLap();
+    std::size_t input_position = input_position_.load(std::memory_order_relaxed);
+    std::size_t input_offset = inputOffset(input_position, lap.base_position, lap.previous_size);
 
-bool CircularBufferReader::wrapping() const
-{
-    return wrapping_.load();
+    if (!output_->mirrored_data_)
+    {
+        CHECK_LE(input_offset + size, output_->data_size_) << "advance(" << size << "): " << output_->internalState();
+    }
+    CHECK_LE(input_position + size, output_position) << "advance(" << size << "): " << output_->internalState();
+
+    // Release the consumed data to the writer.
+    input_position_.store(input_position + size, std::memory_order_release);
 }
 
 UntypedSlice CircularBufferReader::slice()
 {
-    std::lock_guard<std::mutex> lock(output_->mutex_);
-    std::size_t available_size = available_size_.load();
+    std::size_t output_position = output_->output_position_.load(std::memory_order_acquire);
+    CircularBufferWriter::Lap lap = output_->currentLap();
+    std::size_t input_position = input_position_.load(std::memory_order_relaxed);
+    std::size_t input_offset = inputOffset(input_position, lap.base_position, lap.previous_size);
+    std::size_t available_size =
+        input_position >= lap.base_position ?
+        output_position - input_position :
+        lap.base_position + output_->overlap_ - input_position;
 
-    output_->verify();
     CHECK_GE(available_size, min_combined_input_size_) << output_->internalState();
-    CHECK_LE(input_index_ + available_size, output_->data_size_) << output_->internalState();
-    CHECK(wrap_flag_ != output_->wrap_flag_ || input_index_ + available_size <= output_->output_index_) << output_->internalState();
+    if (output_->mirrored_data_)
+    {
+        CHECK_LE(available_size, output_->data_size_) << output_->internalState();
+    }
+    else
+    {
+        CHECK_LE(input_offset + available_size, output_->data_size_) << output_->internalState();
+    }
 
-    return core::UntypedSlice(&output_->data_[input_index_ * output_->type_size_], available_size);
+    return core::UntypedSlice(&output_->buffer_[input_offset * output_->type_size_], available_size);
 }
 
-CircularBufferWriter::CircularBufferWriter(Pipeline& pipeline, Block& block, std::size_t output_channel, std::size_t buffer_size):
-    pipeline_(pipeline),
+CircularBufferWriter::CircularBufferWriter(Block& block, std::size_t output_channel):
+    in_place_reader_(nullptr),
     block_(block),
     output_channel_(output_channel),
     min_output_size_(block.outputState(output_channel).requiredSize()),
-    suggested_output_size_(std::max(min_output_size_, block.outputState(output_channel).suggestedSize())),
     padding_(block.outputState(output_channel).padding()),
-    data_size_(buffer_size - padding_),
-    buffer_size_(buffer_size),
+    data_size_(0),
+    buffer_size_(0),
     overlap_(0),
-    current_size_(data_size_),
-    output_index_(0),
-    min_input_index_(data_size_),
     type_size_(block.outputState(output_channel).typeSize()),
     alignment_(type_size_ < MaxSimdByteSize && !(MaxSimdByteSize % type_size_) ? MaxSimdByteSize / type_size_ : 1),
-    wrap_flag_(false),
-    min_input_wrap_flag_(false),
-    data_(buffer_size * type_size_)
+    initial_position_(0),
+    buffer_(nullptr)
+{
+    laps_count_.store(0);
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        laps_base_positions_[i].store(0);
+        laps_previous_sizes_[i].store(0);
+    }
+    output_position_.store(0);
+}
+
+std::size_t CircularBufferWriter::minBufferSize(BufferBackend buffer_backend) const
+{
+    std::size_t max_combined_input_size = maxCombinedInputSize();
+
+    // Mirrored buffers need no overlap, but the readers and the writer
+    // still must be able to get their minimal slices at the same time.
+    std::size_t min_data_size =
+        buffer_backend == BufferBackend::Mirrored ?
+        max_combined_input_size + min_output_size_ :
+        2 * overlap_ + min_output_size_;
+
+    return roundUp(std::max<std::size_t>(min_data_size, 1), alignment_) + padding_;
+}
+
+std::size_t CircularBufferWriter::typeSize() const
+{
+    return type_size_;
+}
+
+Block& CircularBufferWriter::block() const
 {
-    CHECK_LE(min_output_size_, data_size_);
+    return block_;
+}
+
+std::size_t CircularBufferWriter::outputChannel() const
+{
+    return output_channel_;
+}
+
+std::size_t CircularBufferWriter::allocate(std::size_t buffer_size, BufferBackend buffer_backend)
+{
+    CHECK(!buffer_) << "Buffer is already allocated";
+    CHECK_GE(buffer_size, padding_);
+
+    buffer_size_ = roundUp(buffer_size - padding_, alignment_) + padding_;
+    data_size_ = buffer_size_ - padding_;
+
+    if (buffer_backend == BufferBackend::Mirrored)
+    {
+        try
+        {
+            // Mirrored memory consists of whole pages, which in turn
+            // must consist of whole elements to keep every slice contiguous.
+            std::size_t granularity = std::lcm(MirroredMemory::pageSize(), type_size_);
+            mirrored_data_ = std::make_shared<MirroredMemory>(roundUp(buffer_size_ * type_size_, granularity));
+            buffer_size_ = mirrored_data_->size() / type_size_;
+            data_size_ = buffer_size_ - padding_;
+        }
+        catch (const SystemError& ex)
+        {
+            LOG(WARNING) << "Falling back to copying buffer: " << ex.what();
+            // Copying buffer needs extra space for the overlap.
+            buffer_size_ = std::max(buffer_size_, minBufferSize(BufferBackend::Copying));
+            data_size_ = buffer_size_ - padding_;
+        }
+    }
+
+    if (mirrored_data_)
+    {
+        buffer_ = mirrored_data_->data();
+    }
+    else
+    {
+        data_.resize(buffer_size_ * type_size_);
+        buffer_ = &data_[0];
+    }
+
+    CHECK_LE(minBufferSize(mirrored_data_ ? BufferBackend::Mirrored : BufferBackend::Copying), buffer_size_);
     CHECK_EQ(0, data_size_ % alignment_);
-    available_size_.store(data_size_);
-    wrapping_.store(false);
+    reset();
+
+    return buffer_size_;
 }
 
 CircularBufferWriter::CircularBufferWriter(CircularBufferWriter&& writer):
     readers_(std::move(writer.readers_)),
-    pipeline_(writer.pipeline_),
+    in_place_reader_(writer.in_place_reader_),
+    in_place_writers_(std::move(writer.in_place_writers_)),
     block_(writer.block_),
     output_channel_(writer.output_channel_),
     min_output_size_(writer.min_output_size_),
-    suggested_output_size_(writer.suggested_output_size_),
     padding_(writer.padding_),
     data_size_(writer.data_size_),
     buffer_size_(writer.buffer_size_),
     overlap_(writer.overlap_),
-    current_size_(writer.current_size_),
-    output_index_(writer.output_index_),
-    min_input_index_(writer.min_input_index_),
     type_size_(writer.type_size_),
     alignment_(writer.alignment_),
-    wrap_flag_(writer.wrap_flag_),
-    min_input_wrap_flag_(writer.min_input_wrap_flag_),
-    data_(std::move(writer.data_))
+    initial_position_(writer.initial_position_),
+    data_(std::move(writer.data_)),
+    mirrored_data_(std::move(writer.mirrored_data_)),
+    buffer_(writer.buffer_)
 {
-    available_size_.store(writer.available_size_.load());
-    wrapping_.store(writer.wrapping_.load());
+    laps_count_.store(writer.laps_count_.load());
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        laps_base_positions_[i].store(writer.laps_base_positions_[i].load());
+        laps_previous_sizes_[i].store(writer.laps_previous_sizes_[i].load());
+    }
+    output_position_.store(writer.output_position_.load());
 }
 
 void CircularBufferWriter::reset()
 {
-    current_size_ = data_size_;
-    wrap_flag_ = false;
-    min_input_wrap_flag_ = false;
-    wrapping_.store(false);
-
-    std::size_t max_history_size = 0;
-    for (auto input: readers_)
-    {
-        max_history_size = std::max<std::size_t>(max_history_size, input->history_size_);
-    }
-
-    max_history_size = roundUp(max_history_size, alignment_);
-
-    output_index_ = max_history_size;
-    min_input_index_ = max_history_size;
-    available_size_.store(data_size_ - output_index_);
+    // Start writing after the longest history, so that all inputs
+    // get zero-filled history initially. Output written in place
+    // starts where its input does.
+    initial_position_ =
+        in_place_reader_ ?
+        in_place_reader_->output_->initial_position_ :
+        roundUp(maxHistorySize(), alignment_);
+    CHECK_LT(initial_position_, data_size_);
+
+    laps_count_.store(0);
+    laps_base_positions_[0].store(0);
+    laps_previous_sizes_[0].store(data_size_);
+    output_position_.store(initial_position_);
 
     for (auto input: readers_)
     {
-        input->input_index_ = max_history_size + input->delay_ - input->history_size_;
-        min_input_index_ = std::min(min_input_index_, input->input_index_);
+        input->reset();
     }
-
-    CHECK_LT(min_input_index_, data_size_);
 }
 
 void CircularBufferWriter::addReader(CircularBufferReader& reader)
 {
-    readers_.push_back(&reader);
+    CHECK(!buffer_) << "Readers must be added before the buffer is allocated";
 
+    readers_.push_back(&reader);
     padding_ = std::max(padding_, reader.padding_);
-    data_size_ = buffer_size_ - padding_;
-    current_size_ = data_size_;
-    CHECK_EQ(0, data_size_ % alignment_);
-
     overlap_ = roundUp(std::max(overlap_, reader.min_combined_input_size_), alignment_);
-    CHECK_LE(2 * overlap_ + min_output_size_, data_size_);
+}
 
-    reset();
+const std::vector<CircularBufferReader*>& CircularBufferWriter::readers() const
+{
+    return readers_;
 }
 
-void CircularBufferWriter::verify() const
+void CircularBufferWriter::setInPlaceReader(CircularBufferReader& reader)
 {
-    CHECK_LE(output_index_, data_size_) << internalState();
-    CHECK_LE(current_size_, data_size_) << internalState();
-    CHECK_LE(min_input_index_, current_size_) << internalState();
+    CHECK(!buffer_ && !reader.output_->buffer_) << "In-place output must be set up before the buffers are allocated";
+    CHECK_EQ(&block_, &reader.block_);
+    CHECK_EQ(type_size_, reader.output_->type_size_);
+    CHECK_EQ(0, reader.history_size_ + reader.delay_);
 
-    for (auto input: readers_)
+    in_place_reader_ = &reader;
+    reader.output_->in_place_writers_.push_back(this);
+
+    // Readers of the output read past their slices in the shared buffer.
+    for (CircularBufferWriter* writer = reader.output_; writer; writer = writer->in_place_reader_ ? writer->in_place_reader_->output_ : nullptr)
     {
-        CHECK(wrap_flag_ == input->wrap_flag_ || input->input_index_ >= min_input_index_) << internalState();
-        CHECK_LE(input->input_index_ + input->history_size_, data_size_) << internalState();
-        CHECK(wrap_flag_ == input->wrap_flag_ || input->input_index_ + input->history_size_ <= current_size_) << internalState();
-        CHECK(wrap_flag_ != min_input_wrap_flag_ || output_index_ >= input->input_index_) << internalState();
+        writer->padding_ = std::max(writer->padding_, padding_);
     }
 }
 
-std::string CircularBufferWriter::internalState() const
+const CircularBufferReader* CircularBufferWriter::inPlaceReader() const
 {
-    std::stringstream os;
-    os << "output_index_ = " << output_index_ <<
-        ", current_size_ = " << current_size_ <<
-        ", overlap_ = " << overlap_ <<
-        ", output_channel_ = " << output_channel_ <<
-        ", min_output_size_ = " << min_output_size_ <<
-        ", available_size_ = " << available_size_.load() <<
-        ", min_input_index_ = " << min_input_index_ <<
-        ", wrap_flag_ = " << wrap_flag_ << std::endl;
+    return in_place_reader_;
+}
 
-    for (auto input: readers_)
+bool CircularBufferWriter::shareBuffer()
+{
+    CircularBufferWriter& writer = *in_place_reader_->output_;
+    CHECK(writer.buffer_) << "Shared buffer must be allocated first";
+
+    if (!writer.mirrored_data_)
     {
-        os << "input_channel_ = " << input->input_channel_ <<
-            ", history_size = " << input->history_size_ <<
-            ", delay = " << input->delay_ <<
-            ", min_combined_input_size_ = " << input->min_combined_input_size_ <<
-            ", input_index_ = " << input->input_index_ <<
-            ", available_size_ = " << input->available_size_.load() <<
-            ", wrap_flag_ = " << input->wrap_flag_ << std::endl;
+        writer.in_place_writers_.erase(std::find(writer.in_place_writers_.begin(), writer.in_place_writers_.end(), this));
+        in_place_reader_ = nullptr;
+        return false;
     }
 
-    return os.str();
+    mirrored_data_ = writer.mirrored_data_;
+    buffer_ = writer.buffer_;
+    buffer_size_ = writer.buffer_size_;
+    data_size_ = writer.data_size_;
+    reset();
+
+    return true;
 }
 
-void CircularBufferWriter::adjust()
+CircularBufferWriter::Lap CircularBufferWriter::currentLap() const
 {
-    if (wrap_flag_ == min_input_wrap_flag_ && output_index_ + min_output_size_ > data_size_)
+    while (true)
     {
-        if (min_input_index_ >= overlap_)
+        std::size_t laps_count = laps_count_.load(std::memory_order_acquire);
+        Lap lap
+        {
+            laps_base_positions_[laps_count % 2].load(std::memory_order_relaxed),
+            laps_previous_sizes_[laps_count % 2].load(std::memory_order_relaxed)
+        };
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // The slot could have been reused for the next lap while we were reading it.
+        if (laps_count_.load(std::memory_order_relaxed) == laps_count)
         {
-            current_size_ = output_index_;
-            std::copy(&data_[(output_index_ - overlap_) * type_size_], &data_[output_index_ * type_size_], &data_[0]);
-            output_index_ = overlap_;
-            wrap_flag_ = !wrap_flag_;
+            return lap;
         }
     }
+}
 
-    available_size_.store(
-        (wrap_flag_ == min_input_wrap_flag_) ?
-        data_size_ - output_index_ :
-        min_input_index_ - output_index_
-    );
+void CircularBufferWriter::startLap(const Lap& lap)
+{
+    std::size_t laps_count = laps_count_.load(std::memory_order_relaxed);
+
+    // Makes sure that the readers that see the new lap data
+    // in the reused slot also see the updated laps count.
+    std::atomic_thread_fence(std::memory_order_release);
+    laps_base_positions_[(laps_count + 1) % 2].store(lap.base_position, std::memory_order_relaxed);
+    laps_previous_sizes_[(laps_count + 1) % 2].store(lap.previous_size, std::memory_order_relaxed);
+
+    // Readers load the output position before the lap: since the output position is
+    // published after the lap is, any output position they see is consistent with
+    // the lap they see after it.
+    laps_count_.store(laps_count + 1, std::memory_order_release);
+}
 
-    wrapping_.store(data_size_ - output_index_ < suggested_output_size_);
+std::size_t CircularBufferWriter::minInputPosition() const
+{
+    std::size_t min_input_position = std::numeric_limits<std::size_t>::max();
+    for (auto input: readers_)
+    {
+        min_input_position = std::min(min_input_position, input->input_position_.load(std::memory_order_acquire));
+    }
 
-    // Notify pipeline about output size change.
-    pipeline_.outputAvailableSizeChanged(block_, output_channel_);
+    for (auto writer: in_place_writers_)
+    {
+        min_input_position = std::min(min_input_position, writer->minInputPosition());
+    }
+
+    return min_input_position;
 }
 
-void CircularBufferWriter::advance(std::size_t size)
+std::size_t CircularBufferWriter::maxHistorySize() const
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    std::size_t max_history_size = 0;
+    for (auto input: readers_)
+    {
+        max_history_size = std::max(max_history_size, input->history_size_);
+    }
 
-    verify();
-    CHECK_LE(output_index_ + size, data_size_) << internalState();
-    CHECK(wrap_flag_ == min_input_wrap_flag_ || output_index_ + size <= min_input_index_) << internalState();
+    for (auto writer: in_place_writers_)
+    {
+        max_history_size = std::max(max_history_size, writer->maxHistorySize());
+    }
 
-    output_index_ += size;
-    adjust();
+    return max_history_size;
+}
 
-    // Finished our internal data update - notify inputs about them.
+std::size_t CircularBufferWriter::maxCombinedInputSize() const
+{
+    std::size_t max_combined_input_size = 0;
     for (auto input: readers_)
     {
-        input->adjust();
+        max_combined_input_size = std::max(max_combined_input_size, input->min_combined_input_size_);
     }
 
-    // min_input_index_ might have changed after input->adjust() calls.
-    updateMinInputIndex();
+    for (auto writer: in_place_writers_)
+    {
+        max_combined_input_size = std::max(max_combined_input_size, writer->maxCombinedInputSize());
+    }
 
-    verify();
+    return max_combined_input_size;
 }
 
-void CircularBufferWriter::updateMinInputIndex()
+std::size_t CircularBufferWriter::availableSize(std::size_t output_position, const Lap& lap, bool& wrap) const
 {
-    std::size_t new_min_input_index_above = std::numeric_limits<std::size_t>::max();
-    std::size_t new_min_input_index_below = std::numeric_limits<std::size_t>::max();
+    wrap = false;
 
-    for (auto input: readers_)
+    if (in_place_reader_)
+    {
+        // Output can catch up with the input, which is always mirrored.
+        return in_place_reader_->output_->output_position_.load(std::memory_order_acquire) - output_position;
+    }
+
+    if (mirrored_data_)
     {
-        std::size_t input_index = input->input_index_;
+        // Writer can go as far as data_size_ past the slowest reader.
+        return readers_.empty() ? data_size_ : minInputPosition() + data_size_ - output_position;
+    }
+
+    std::size_t output_offset = output_position - lap.base_position;
+    std::size_t min_previous_offset = std::numeric_limits<std::size_t>::max();
+    std::size_t min_current_offset = std::numeric_limits<std::size_t>::max();
 
-        if (wrap_flag_ != input->wrap_flag_ && input_index < new_min_input_index_above)
+    for (auto input: readers_)
+    {
+        std::size_t input_position = input->input_position_.load(std::memory_order_acquire);
+        std::size_t input_offset = input->inputOffset(input_position, lap.base_position, lap.previous_size);
+        if (input_position < lap.base_position)
         {
-            new_min_input_index_above = input_index;
+            min_previous_offset = std::min(min_previous_offset, input_offset);
         }
-
-        if (wrap_flag_ == input->wrap_flag_ && input_index < new_min_input_index_below)
+        else
         {
-            new_min_input_index_below = input_index;
+            min_current_offset = std::min(min_current_offset, input_offset);
         }
     }
 
-    std::size_t prev_min_input_index = min_input_index_;
-    if (new_min_input_index_above != std::numeric_limits<std::size_t>::max())
+    if (min_previous_offset != std::numeric_limits<std::size_t>::max())
     {
-        min_input_index_ = new_min_input_index_above;
-        min_input_wrap_flag_ = !wrap_flag_;
+        // Some inputs are still reading the previous lap, so we cannot go past them.
+        return min_previous_offset - output_offset;
     }
-    else
+
+    if (output_offset + min_output_size_ > data_size_ && min_current_offset >= overlap_)
     {
-        CHECK_NE(new_min_input_index_below, std::numeric_limits<std::size_t>::max()) << internalState();
-        min_input_index_ = new_min_input_index_below;
-        min_input_wrap_flag_ = wrap_flag_;
+        // Not enough space till the end of the buffer and the beginning of the buffer
+        // is not used by the inputs anymore: can start the next lap. Inputs that are
+        // further than overlap_ from the output stay on the current lap after that.
+        wrap = true;
+
+        std::size_t new_base_position = output_position - overlap_;
+        std::size_t min_offset = std::numeric_limits<std::size_t>::max();
+        for (auto input: readers_)
+        {
+            std::size_t input_position = input->input_position_.load(std::memory_order_acquire);
+            if (input_position < new_base_position)
+            {
+                min_offset = std::min(min_offset, input_position - lap.base_position);
+            }
+        }
+
+        return (min_offset != std::numeric_limits<std::size_t>::max() ? min_offset : data_size_) - overlap_;
     }
 
-    // Notify the output about the change, if there was any.
-    if (prev_min_input_index != min_input_index_)
+    return data_size_ - output_offset;
+}
+
+std::string CircularBufferWriter::internalState() const
+{
+    Lap lap = currentLap();
+    std::stringstream os;
+    os << "output_position_ = " << output_position_.load() <<
+        ", base_position = " << lap.base_position <<
+        ", previous_size = " << lap.previous_size <<
+        ", laps_count_ = " << laps_count_.load() <<
+        ", overlap_ = " << overlap_ <<
+        ", data_size_ = " << data_size_ <<
+        ", output_channel_ = " << output_channel_ <<
+        ", min_output_size_ = " << min_output_size_ <<
+        ", available_size = " << availableSize() << std::endl;
+
+    for (auto input: readers_)
+    {
+        os << "input_channel_ = " << input->input_channel_ <<
+            ", history_size = " << input->history_size_ <<
+            ", delay = " << input->delay_ <<
+            ", min_combined_input_size_ = " << input->min_combined_input_size_ <<
+            ", input_position_ = " << input->input_position_.load() <<
+            ", available_size = " << input->availableSize() << std::endl;
+    }
+
+    return os.str();
+}
+
+void CircularBufferWriter::advance(std::size_t size)
+{
+    bool wrap;
+    std::size_t output_position = output_position_.load(std::memory_order_relaxed);
+    Lap lap = currentLap();
+
+    if (mirrored_data_)
+    {
+        CHECK_LE(size, availableSize(output_position, lap, wrap)) << internalState();
+    }
+    else
     {
-        adjust();
+        CHECK_LE(output_position - lap.base_position + size, data_size_) << internalState();
     }
+
+    // Publish the written data to the readers.
+    output_position_.store(output_position + size, std::memory_order_release);
 }
 
 std::size_t CircularBufferWriter::availableSize() const
 {
-    return available_size_.load();
+    bool wrap;
+    return availableSize(output_position_.load(std::memory_order_acquire), currentLap(), wrap);
 }
 
-bool CircularBufferWriter::wrapping() const
+std::size_t CircularBufferWriter::bufferSize() const
 {
-    return wrapping_.load();
+    return data_size_;
+}
+
+bool CircularBufferWriter::wrapping(std::size_t suggested_size) const
+{
+    if (mirrored_data_)
+    {
+        return false;
+    }
+
+    bool wrap;
+    std::size_t output_position = output_position_.load(std::memory_order_acquire);
+    Lap lap = currentLap();
+    availableSize(output_position, lap, wrap);
+
+    std::size_t output_offset = wrap ? overlap_ : output_position - lap.base_position;
+    return data_size_ - output_offset < std::max(min_output_size_, suggested_size);
 }
 
 UntypedSlice CircularBufferWriter::slice()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
-    std::size_t available_size = availableSize();
+    bool wrap;
+    std::size_t output_position = output_position_.load(std::memory_order_relaxed);
+    Lap lap = currentLap();
+    std::size_t available_size = availableSize(output_position, lap, wrap);
+
+    if (wrap)
+    {
+        // Copy the tail of the current lap to the beginning of the buffer
+        // for the inputs that still need it and start the new lap.
+        std::size_t output_offset = output_position - lap.base_position;
+        std::copy(&buffer_[(output_offset - overlap_) * type_size_], &buffer_[output_offset * type_size_], &buffer_[0]);
+
+        lap.previous_size = output_offset;
+        lap.base_position = output_position - overlap_;
+        startLap(lap);
+    }
 
-    verify();
     CHECK_GE(available_size, min_output_size_) << internalState();
-    CHECK_LE(output_index_ + available_size, data_size_) << internalState();
-    CHECK(wrap_flag_ == min_input_wrap_flag_ || output_index_ + available_size <= min_input_index_) << internalState();
 
-    return core::UntypedSlice(&data_[output_index_ * type_size_], available_size);
+    std::size_t output_offset;
+    if (mirrored_data_)
+    {
+        output_offset = output_position % buffer_size_;
+    }
+    else
+    {
+        output_offset = output_position - lap.base_position;
+        CHECK_LE(output_offset + available_size, data_size_) << internalState();
+    }
+
+    return core::UntypedSlice(&buffer_[output_offset * type_size_], available_size);
 }
@@ -20,31 +20,71 @@
 #include <hvylya/core/aligned_vector.h>
 #include <hvylya/core/untyped_slice.h>
 
-#include <mutex>
+#include <hvylya/pipelines/async/mirrored_memory.h>
 
 namespace hvylya {
 namespace pipelines {
 namespace async {
 
 class CircularBufferWriter;
-class Pipeline;
 class Block;
 
+// Both readers and the writer track their positions in the stream of all
+// the elements ever written to the buffer. The stream is mapped onto the buffer
+// in laps: whenever the writer reaches the end of the buffer, it copies the last
+// overlap_ elements to the beginning of the buffer and continues the new lap
+// right after them, so that readers can always get contiguous slices.
+//
+// Every position is changed by a single thread only (the writer position - by
+// the thread executing the writer block, each reader position - by the thread
+// executing the reader block), so no locking is needed: positions are published
+// via atomics and every party computes the sizes available to it on demand.
+// Advancing the positions doesn't notify anybody: the block running the step
+// lets the pipeline know about all the buffers it has advanced at once.
+//
+// With the mirrored backend the buffer pages are mapped twice back to back,
+// so the stream position is simply taken modulo the buffer size: every slice
+// is contiguous and there are neither laps nor overlap copies.
+//
+// Writers of the outputs processed in place share the mirrored buffer of their
+// input: their positions are in the stream of the shared buffer, trailing the
+// reader of their block, and the shared buffer writer waits for their readers.
+
+enum class BufferBackend: std::int8_t
+{
+    Copying,
+    Mirrored
+};
+
 class CircularBufferReader: core::NonCopyable
 {
   public:
-    CircularBufferReader(Pipeline& pipeline, Block& block, std::size_t input_channel);
+    CircularBufferReader(Block& block, std::size_t input_channel);
 
     CircularBufferReader(CircularBufferReader&& reader);
 
     std::size_t availableSize() const;
 
-    bool wrapping() const;
+    std::size_t bufferSize() const;
+
+    // Slices of the mirrored buffer stay valid at the same addresses until
+    // the reader advances past them, no matter how far the writer gets.
+    bool mirrored() const;
+
+    // Whether the end of the buffer doesn't leave enough space for the specified
+    // suggested size (excluding the history), so that it cannot be satisfied.
+    bool wrapping(std::size_t suggested_size) const;
 
     void advance(std::size_t size);
 
     core::UntypedSlice slice();
 
+    Block& block() const;
+
+    std::size_t inputChannel() const;
+
+    const CircularBufferWriter& writer() const;
+
     void setWriter(CircularBufferWriter& writer);
 
     void reset();
@@ -53,27 +93,28 @@ class CircularBufferReader: core::NonCopyable
     friend class CircularBufferWriter;
 
     CircularBufferWriter* output_;
-    Pipeline& pipeline_;
     Block& block_;
-    std::size_t input_channel_, history_size_, delay_, min_combined_input_size_, suggested_input_size_, padding_;
-    std::size_t input_index_;
-    std::atomic<std::size_t> available_size_;
-    std::atomic<bool> wrapping_;
-    bool wrap_flag_;
+    std::size_t input_channel_, history_size_, delay_, min_combined_input_size_, padding_;
+    // Stream position of the first element of the input slice, including the history.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> input_position_;
 
-    void adjust();
+    std::size_t inputOffset(std::size_t input_position, std::size_t base_position, std::size_t previous_size) const;
 };
 
 class CircularBufferWriter: core::NonCopyable
 {
   public:
-    CircularBufferWriter(Pipeline& pipeline, Block& block, std::size_t output_channel, std::size_t buffer_size);
+    CircularBufferWriter(Block& block, std::size_t output_channel);
 
     CircularBufferWriter(CircularBufferWriter&& writer);
 
     std::size_t availableSize() const;
 
-    bool wrapping() const;
+    std::size_t bufferSize() const;
+
+    // Whether the end of the buffer doesn't leave enough space
+    // for the specified suggested size, so that it cannot be satisfied.
+    bool wrapping(std::size_t suggested_size) const;
 
     void advance(std::size_t offset);
 
@@ -81,6 +122,36 @@ class CircularBufferWriter: core::NonCopyable
 
     void addReader(CircularBufferReader& reader);
 
+    const std::vector<CircularBufferReader*>& readers() const;
+
+    // Makes the writer put its output over the input the given reader of the same
+    // block has just consumed, instead of getting a buffer of its own. Must be called
+    // after all readers of both writers are added, before any of them is allocated.
+    void setInPlaceReader(CircularBufferReader& reader);
+
+    // Reader whose input the output is written over, nullptr if there's none.
+    const CircularBufferReader* inPlaceReader() const;
+
+    // Takes over the buffer of the in-place reader once it's allocated, unless it's
+    // a copying one: as it keeps the elements at the end of each lap twice, readers
+    // could miss the output written over the other copy. In that case the writer
+    // stops writing in place and needs a buffer of its own, false is returned then.
+    bool shareBuffer();
+
+    // The smallest buffer size (in elements) the connected readers and the writer
+    // can work with without deadlocking, must be called after all readers are added.
+    std::size_t minBufferSize(BufferBackend buffer_backend) const;
+
+    std::size_t typeSize() const;
+
+    Block& block() const;
+
+    std::size_t outputChannel() const;
+
+    // Mirrored buffer falls back to the copying one if it cannot be allocated.
+    // Returns the actual size of the buffer, which might be rounded up.
+    std::size_t allocate(std::size_t buffer_size, BufferBackend buffer_backend);
+
     std::string internalState() const;
 
     void reset();
@@ -88,22 +159,45 @@ class CircularBufferWriter: core::NonCopyable
  private:
     friend class CircularBufferReader;
 
+    // Stream position of the element stored at the beginning of the buffer in the
+    // current lap, plus the buffer offset at which the previous lap has ended.
+    // The elements of the previous lap are still available to the readers
+    // that haven't reached its last overlap_ elements yet.
+    struct Lap
+    {
+        std::size_t base_position, previous_size;
+    };
+
     std::vector<CircularBufferReader*> readers_;
-    Pipeline& pipeline_;
+    CircularBufferReader* in_place_reader_;
+    // Writers sharing this buffer to write their outputs in place.
+    std::vector<CircularBufferWriter*> in_place_writers_;
     Block& block_;
-    std::size_t output_channel_, min_output_size_, suggested_output_size_, padding_, data_size_, buffer_size_, overlap_;
-    std::size_t current_size_, output_index_, min_input_index_, type_size_, alignment_;
-    std::atomic<std::size_t> available_size_;
-    std::atomic<bool> wrapping_;
-    bool wrap_flag_, min_input_wrap_flag_;
+    std::size_t output_channel_, min_output_size_, padding_, data_size_, buffer_size_, overlap_;
+    std::size_t type_size_, alignment_, initial_position_;
     core::AlignedVector<std::int8_t> data_;
-    mutable std::mutex mutex_;
+    std::shared_ptr<MirroredMemory> mirrored_data_;
+    // Points either to data_ or to mirrored_data_.
+    std::int8_t* buffer_;
+    // The current lap is stored in the slot laps_count_ % 2, so that the slot
+    // for the next lap can be filled in without disturbing concurrent readers.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> laps_count_;
+    std::atomic<std::size_t> laps_base_positions_[2], laps_previous_sizes_[2];
+    // Stream position right after the last written element.
+    alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> output_position_;
+
+    Lap currentLap() const;
+
+    void startLap(const Lap& lap);
+
+    std::size_t availableSize(std::size_t output_position, const Lap& lap, bool& wrap) const;
 
-    void verify() const;
+    // Includes the readers of the writers sharing the buffer.
+    std::size_t minInputPosition() const;
 
-    void updateMinInputIndex();
+    std::size_t maxHistorySize() const;
 
-    void adjust();
+    std::size_t maxCombinedInputSize() const;
 };
 
 } // namespace async
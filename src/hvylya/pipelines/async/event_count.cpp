@@ -0,0 +1,88 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/event_count.h>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "Futex word must be a plain 32-bit integer");
+
+std::uint32_t* futexWord(std::atomic<std::uint32_t>& word)
+{
+    return reinterpret_cast<std::uint32_t*>(&word);
+}
+
+} // anonymous namespace
+
+EventCount::EventCount():
+    epoch_(0),
+    waiters_(0)
+{
+}
+
+EventCount::Key EventCount::prepareWait()
+{
+    // Must be visible to the notifiers before the waiting thread checks its condition.
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    return epoch_.load(std::memory_order_acquire);
+}
+
+void EventCount::cancelWait()
+{
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void EventCount::wait(Key key)
+{
+    while (epoch_.load(std::memory_order_acquire) == key)
+    {
+        // Fails with EAGAIN if the epoch has changed meanwhile, EINTR is handled by the loop as well.
+        syscall(SYS_futex, futexWord(epoch_), FUTEX_WAIT_PRIVATE, key, nullptr, nullptr, 0);
+    }
+
+    waiters_.fetch_sub(1, std::memory_order_seq_cst);
+}
+
+void EventCount::notifyOne()
+{
+    notify(1);
+}
+
+void EventCount::notifyAll()
+{
+    notify(INT_MAX);
+}
+
+void EventCount::notify(int waiters_count)
+{
+    // Pairs with prepareWait(): either the waiter sees the condition made true
+    // before this call, or it's seen here as waiting.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (!waiters_.load(std::memory_order_relaxed))
+    {
+        return;
+    }
+
+    epoch_.fetch_add(1, std::memory_order_acq_rel);
+    syscall(SYS_futex, futexWord(epoch_), FUTEX_WAKE_PRIVATE, waiters_count, nullptr, nullptr, 0);
+}
@@ -0,0 +1,59 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+// Lets the threads sleep until some condition becomes true without any mutex:
+// the waiting thread calls prepareWait(), checks the condition once more and
+// then either waits with the returned key or cancels the wait, while the thread
+// making the condition true notifies the waiters afterwards. Notifications cost
+// a single atomic load unless somebody is actually waiting, in which case
+// the waiters are woken up with futex.
+class EventCount: core::NonCopyable
+{
+  public:
+    typedef std::uint32_t Key;
+
+    EventCount();
+
+    Key prepareWait();
+
+    void cancelWait();
+
+    // Returns right away if there were notifications since the key was obtained.
+    void wait(Key key);
+
+    void notifyOne();
+
+    void notifyAll();
+
+  private:
+    alignas(CACHE_LINE_SIZE) std::atomic<std::uint32_t> epoch_;
+    std::atomic<std::uint32_t> waiters_;
+
+    void notify(int waiters_count);
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
@@ -0,0 +1,209 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/executor.h>
+#include <hvylya/pipelines/async/affinity.h>
+#include <hvylya/pipelines/async/pipeline.h>
+
+using namespace hvylya::pipelines::async;
+
+Executor::Executor(std::size_t threads_count, const std::vector<std::size_t>& cpus):
+    pipelines_version_(0),
+    stopping_(false)
+{
+    if (!threads_count)
+    {
+        threads_count = !cpus.empty() ? cpus.size() : std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    }
+
+    threads_.reserve(threads_count);
+    for (std::size_t i = 0; i < threads_count; ++i)
+    {
+        threads_.emplace_back(&Executor::runThread, this, i, cpus);
+    }
+}
+
+Executor::~Executor()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        CHECK(pipelines_.empty()) << "Attempted to destroy executor with " << pipelines_.size() << " running pipelines";
+    }
+
+    stopping_.store(true);
+    work_queued_.notifyAll();
+
+    for (auto& thread: threads_)
+    {
+        thread.join();
+    }
+}
+
+Executor& Executor::shared()
+{
+    static Executor executor;
+    return executor;
+}
+
+std::size_t Executor::threadsCount() const
+{
+    return threads_.size();
+}
+
+void Executor::attach(Pipeline& pipeline)
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        for (auto& attachment: pipelines_)
+        {
+            CHECK_NE(attachment->pipeline, &pipeline);
+        }
+
+        auto attachment = std::make_shared<Attachment>();
+        attachment->pipeline = &pipeline;
+        attachment->users.store(0);
+        attachment->attached.store(true);
+        pipelines_.push_back(std::move(attachment));
+        ++pipelines_version_;
+    }
+
+    work_queued_.notifyAll();
+}
+
+void Executor::detach(Pipeline& pipeline)
+{
+    std::shared_ptr<Attachment> attachment;
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+
+        auto it =
+            std::find_if(
+                pipelines_.begin(),
+                pipelines_.end(),
+                [&pipeline](const std::shared_ptr<Attachment>& attachment)
+                {
+                    return attachment->pipeline == &pipeline;
+                }
+            );
+        if (it == pipelines_.end())
+        {
+            return;
+        }
+
+        attachment = *it;
+        pipelines_.erase(it);
+        ++pipelines_version_;
+    }
+
+    // Threads check the flag after registering as the users, so either they see
+    // the pipeline detached or it's seen here as still being used.
+    attachment->attached.store(false);
+
+    while (true)
+    {
+        EventCount::Key key = pipeline_released_.prepareWait();
+        if (!attachment->users.load())
+        {
+            pipeline_released_.cancelWait();
+            break;
+        }
+
+        pipeline_released_.wait(key);
+    }
+}
+
+void Executor::notify()
+{
+    work_queued_.notifyOne();
+}
+
+void Executor::runThread(std::size_t thread_index, const std::vector<std::size_t>& cpus)
+{
+    pinCurrentThread(cpus);
+
+    std::vector<std::shared_ptr<Attachment>> pipelines;
+    std::uint64_t pipelines_version = std::numeric_limits<std::uint64_t>::max();
+    std::size_t next_pipeline = thread_index;
+    // Pipelines found without any queued blocks in a row.
+    std::size_t idle_pipelines = 0;
+    bool waiting = false;
+    EventCount::Key key = 0;
+
+    while (!stopping_.load())
+    {
+        if (pipelines_version_.load() != pipelines_version)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            pipelines = pipelines_;
+            pipelines_version = pipelines_version_.load();
+            idle_pipelines = 0;
+        }
+
+        if (idle_pipelines >= pipelines.size())
+        {
+            if (!waiting)
+            {
+                // Check everything once more, as the blocks queued from now on wake this thread up.
+                key = work_queued_.prepareWait();
+                waiting = true;
+            }
+            else
+            {
+                work_queued_.wait(key);
+                waiting = false;
+            }
+
+            idle_pipelines = 0;
+            continue;
+        }
+
+        Attachment& attachment = *pipelines[next_pipeline++ % pipelines.size()];
+        bool processed = false;
+
+        attachment.users.fetch_add(1);
+        if (attachment.attached.load())
+        {
+            processed = attachment.pipeline->runExecutorBlock(thread_index);
+        }
+
+        if (attachment.users.fetch_sub(1) == 1 && !attachment.attached.load())
+        {
+            pipeline_released_.notifyAll();
+        }
+
+        if (processed)
+        {
+            idle_pipelines = 0;
+
+            if (waiting)
+            {
+                work_queued_.cancelWait();
+                waiting = false;
+            }
+        }
+        else
+        {
+            ++idle_pipelines;
+        }
+    }
+
+    if (waiting)
+    {
+        work_queued_.cancelWait();
+    }
+}
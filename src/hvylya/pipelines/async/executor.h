@@ -0,0 +1,81 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/pipelines/async/event_count.h>
+
+#include <thread>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+class Pipeline;
+
+// Pool of threads running the blocks of all the pipelines attached to it, see
+// Pipeline::setExecutor(). Threads take the blocks from the running pipelines
+// in turns, one block at a time, so that no pipeline can starve the others.
+// The mutex is taken only to attach and detach the pipelines: running the blocks
+// and queueing new ones touches only the atomics of the pipeline involved.
+class Executor: core::NonCopyable
+{
+  public:
+    // Threads are restricted to the given CPUs, if any. 0 threads means one
+    // thread per CPU, or per hardware thread if no CPUs are given.
+    Executor(std::size_t threads_count = 0, const std::vector<std::size_t>& cpus = {});
+
+    // All the pipelines must be stopped by now.
+    ~Executor();
+
+    // Process-wide executor, created on the first use.
+    static Executor& shared();
+
+    std::size_t threadsCount() const;
+
+  private:
+    friend class Pipeline;
+
+    struct Attachment
+    {
+        Pipeline* pipeline;
+        // Number of threads running the blocks of the pipeline.
+        std::atomic<std::size_t> users;
+        std::atomic<bool> attached;
+    };
+
+    std::vector<std::thread> threads_;
+    // Protects the list of the pipelines, which the threads copy whenever the version changes.
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Attachment>> pipelines_;
+    std::atomic<std::uint64_t> pipelines_version_;
+    EventCount work_queued_, pipeline_released_;
+    std::atomic<bool> stopping_;
+
+    void attach(Pipeline& pipeline);
+
+    // Waits until no thread is running the blocks of the pipeline anymore.
+    void detach(Pipeline& pipeline);
+
+    void notify();
+
+    void runThread(std::size_t thread_index, const std::vector<std::size_t>& cpus);
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
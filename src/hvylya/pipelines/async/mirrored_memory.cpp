@@ -0,0 +1,92 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/mirrored_memory.h>
+
+#include <hvylya/core/exceptions.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace hvylya::core;
+using namespace hvylya::pipelines::async;
+
+MirroredMemory::MirroredMemory(std::size_t size):
+    size_(size),
+    data_(nullptr)
+{
+    CHECK_GT(size_, 0);
+    CHECK_EQ(0, size_ % pageSize());
+
+    int fd = memfd_create("hvylya-buffer", MFD_CLOEXEC);
+    if (fd < 0)
+    {
+        THROW(SystemError()) << "memfd_create() failure";
+    }
+
+    try
+    {
+        map(fd);
+    }
+    catch (...)
+    {
+        if (data_)
+        {
+            munmap(data_, 2 * size_);
+        }
+        close(fd);
+        throw;
+    }
+
+    // Mappings keep the pages alive, the descriptor is not needed anymore.
+    close(fd);
+}
+
+MirroredMemory::~MirroredMemory()
+{
+    munmap(data_, 2 * size_);
+}
+
+std::size_t MirroredMemory::pageSize()
+{
+    return std::size_t(sysconf(_SC_PAGESIZE));
+}
+
+void MirroredMemory::map(int fd)
+{
+    if (ftruncate(fd, off_t(size_)) < 0)
+    {
+        THROW(SystemError()) << fmt::format("ftruncate() failure, size = {0}", size_);
+    }
+
+    // Reserve the address range for both copies first,
+    // so that nothing else can be mapped in between them.
+    void* address = mmap(nullptr, 2 * size_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (address == MAP_FAILED)
+    {
+        THROW(SystemError()) << fmt::format("mmap() failure, size = {0}", 2 * size_);
+    }
+    data_ = static_cast<std::int8_t*>(address);
+
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        if (mmap(data_ + i * size_, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+        {
+            THROW(SystemError()) << fmt::format("mmap() failure, size = {0}", size_);
+        }
+    }
+}
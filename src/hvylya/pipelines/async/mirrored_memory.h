@@ -0,0 +1,51 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+// Maps the same physical pages twice back to back, so that any range
+// of up to size() bytes starting in the first mapping is contiguous.
+class MirroredMemory: core::NonCopyable
+{
+  public:
+    // Size must be a multiple of the page size.
+    explicit MirroredMemory(std::size_t size);
+
+    ~MirroredMemory();
+
+    std::int8_t* data() const { return data_; }
+
+    std::size_t size() const { return size_; }
+
+    static std::size_t pageSize();
+
+  private:
+    std::size_t size_;
+    std::int8_t* data_;
+
+    void map(int fd);
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
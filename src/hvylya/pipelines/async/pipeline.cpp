@@ -16,9 +16,16 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <hvylya/pipelines/async/pipeline.h>
+#include <hvylya/pipelines/async/affinity.h>
+#include <hvylya/pipelines/async/static_schedule.h>
 
 #include <hvylya/filters/io_states.h>
 
+#include <immintrin.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
 using namespace hvylya::filters;
 using namespace hvylya::pipelines::async;
 
@@ -53,15 +60,181 @@ void addLinkedFilters(std::unordered_set<IFilter*>& filters, IFilter& filter)
     }
 }
 
+// Returns the filter consuming the only output of the given filter
+// if that's also its only input, so that both filters can be fused.
+IFilter* fusibleSink(IFilter& filter)
+{
+    if (filter.outputChannelsCount() != 1 || filter.sinks(0).size() != 1)
+    {
+        return nullptr;
+    }
+
+    IFilter& sink_filter = std::get<0>(filter.sinks(0).front());
+    return sink_filter.inputChannelsCount() == 1 ? &sink_filter : nullptr;
+}
+
+// Throughput policy schedules blocks with at least 4x suggested chunks, if buffers allow that.
+const int BatchChunkSizeLevel = 2;
+// ... and lets a few blocks queue up before waking up more threads.
+const std::size_t BatchExtraQueueLoad = 2;
+
+// Idle threads spin for the queued blocks for at least this many iterations before going to sleep ...
+const std::size_t MinSpinIterations = 64;
+// ... and for at most this many: the spin is doubled every time it finds a block and halved every time it doesn't.
+const std::size_t MaxSpinIterations = 4096;
+
+// Elastic threads measure the load over the windows of this length ...
+const std::chrono::milliseconds LoadWindow(50);
+// ... activate one more thread if the active ones were busy for more than this share of the window ...
+const double GrowUtilisation = 0.9;
+// ... and park one if they were busy for less than this share and nothing was queued.
+const double ShrinkUtilisation = 0.5;
+
+// Critical paths follow the wall times of the blocks measured over the periods of this length ...
+const std::chrono::milliseconds CriticalPathsUpdatePeriod(100);
+// ... per this many samples of the sources ...
+const double CriticalPathSamples = 1000;
+// ... with the blocks feeding the real-time sinks, like the audio output, counted as this much more expensive.
+const double DeadlineBranchWeight = 4;
+
+// Latency budget is split between holding the input back for the burst and processing it.
+const int BurstsPerLatencyBudget = 2;
+
+// Computes the distances from all the blocks to their closest sinks, so that
+// the blocks that are about to deliver their data are preferred over the rest.
+void setSinkDistances(const std::unordered_set<IFilter*>& filters, std::unordered_map<IFilter*, Block*>& blocks_map)
+{
+    std::unordered_map<IFilter*, std::size_t> distances;
+    std::deque<IFilter*> pending;
+
+    for (auto filter: filters)
+    {
+        if (!filter->outputChannelsCount())
+        {
+            distances[filter] = 0;
+            pending.push_back(filter);
+        }
+    }
+
+    // Breadth-first search from the sinks towards the sources.
+    while (!pending.empty())
+    {
+        IFilter* filter = pending.front();
+        pending.pop_front();
+
+        for (std::size_t i = 0; i < filter->inputChannelsCount(); ++i)
+        {
+            for (auto source: filter->sources(i))
+            {
+                IFilter* source_filter = &std::get<0>(source);
+                if (!distances.count(source_filter))
+                {
+                    distances[source_filter] = distances[filter] + 1;
+                    pending.push_back(source_filter);
+                }
+            }
+        }
+    }
+
+    for (auto filter: filters)
+    {
+        auto it = distances.find(filter);
+        blocks_map[filter]->setSinkDistance(it != distances.end() ? it->second : std::numeric_limits<std::size_t>::max());
+    }
+
+    // Fused chains are queued via their heads, which deliver data as soon as their tails do.
+    for (auto filter: filters)
+    {
+        Block& head = blocks_map[filter]->head();
+        head.setSinkDistance(std::min(head.sinkDistance(), blocks_map[filter]->sinkDistance()));
+    }
+}
+
+void addCriticalPathOrder(Block& block, std::unordered_set<Block*>& visited, std::vector<Block*>& order)
+{
+    if (!visited.insert(&block).second)
+    {
+        return;
+    }
+
+    for (auto consumer: block.consumers())
+    {
+        addCriticalPathOrder(*consumer, visited, order);
+    }
+
+    order.push_back(&block);
+}
+
+// Orders the blocks so that the consumers come before their producers.
+std::vector<Block*> criticalPathOrder(std::deque<Block>& blocks)
+{
+    std::unordered_set<Block*> visited;
+    std::vector<Block*> order;
+
+    for (auto& block: blocks)
+    {
+        addCriticalPathOrder(block, visited, order);
+    }
+
+    return order;
+}
+
+// Queue order of the critical path scheduling policy, FIFO for the equal blocks.
+bool criticalPathLess(const Block* lhs, const Block* rhs)
+{
+    return
+        lhs->criticalPath() > rhs->criticalPath() ||
+        (lhs->criticalPath() == rhs->criticalPath() && lhs->sinkDistance() < rhs->sinkDistance());
+}
+
+// The pipeline the current thread is working for, if any.
+thread_local Pipeline* current_pipeline = nullptr;
+thread_local std::size_t current_thread_index = 0;
+// The consumer handed off to the current thread by the block it has just run.
+thread_local Block* handed_off_block = nullptr;
+// Blocks queued by the current worker while it runs a block, if they are to be ordered.
+thread_local std::vector<Block*>* local_blocks = nullptr;
+
 } // anonymous namespace
 
-Pipeline::Pipeline(std::size_t min_extra_queue_load):
-    min_extra_queue_load_(min_extra_queue_load),
+Pipeline::Pipeline():
     threads_count_(0),
     threads_running_(0),
-    threads_waiting_(0),
-    threads_waking_up_(0),
-    state_(State::Stopped)
+    pending_wake_ups_(0),
+    threads_parked_(0),
+    io_threads_count_(0),
+    polled_blocks_count_(0),
+    queued_blocks_(0),
+    threads_spinning_(0),
+    poll_fd_(-1),
+    poll_wake_fd_(-1),
+    active_blocks_(0),
+    threads_sleeping_(0),
+    relaxed_mode_(false),
+    state_(State::Stopped),
+    scheduling_mode_(SchedulingMode::SharedQueue),
+    scheduling_policy_(SchedulingPolicy::Balanced),
+    buffer_backend_(BufferBackend::Copying),
+    trace_capacity_(0),
+    block_fusion_(true),
+    static_schedules_(false),
+    block_replicas_(1),
+    consumer_hand_off_(false),
+    io_threads_(true),
+    chunk_size_tuning_(ChunkSizeTuning::Disabled),
+    buffer_memory_budget_(0),
+    cache_aware_buffers_(true),
+    in_place_buffers_(true),
+    max_threads_(0),
+    executor_(nullptr),
+    numa_node_(-1),
+    elastic_threads_(false),
+    active_threads_(0),
+    busy_time_(0),
+    load_window_start_(0),
+    latency_budget_(0),
+    critical_paths_source_samples_(0),
+    critical_paths_update_time_(0)
 {
 }
 
@@ -71,15 +244,62 @@ void Pipeline::add(IFilter& top_filter)
 
     std::unordered_set<IFilter*> filters;
     std::unordered_map<IFilter*, Block*> blocks_map;
+    std::unordered_map<IFilter*, IFilter*> fused_sinks;
+    std::unordered_set<IFilter*> fused_filters;
+    std::vector<StaticSchedule> schedules;
+    std::unordered_map<IFilter*, const StaticSchedule*> scheduled_filters;
 
     filters.insert(&top_filter);
     addLinkedFilters(filters, top_filter);
 
-    blocks_.reserve(filters.size());
     for (auto filter: filters)
     {
         blocks_.emplace_back(*this, *filter);
         blocks_map[filter] = &blocks_.back();
+
+        if (block_replicas_ > 1)
+        {
+            blocks_.back().replicate(block_replicas_);
+        }
+    }
+
+    if (static_schedules_)
+    {
+        // Same restrictions as for the fused chains below apply.
+        std::unordered_set<IFilter*> schedulable_filters;
+        for (auto filter: filters)
+        {
+            if (blocks_map[filter]->replicasCount() == 1 && !ioBound(*blocks_map[filter]))
+            {
+                schedulable_filters.insert(filter);
+            }
+        }
+
+        schedules = findStaticSchedules(schedulable_filters);
+        for (auto& schedule: schedules)
+        {
+            for (auto filter: schedule.filters)
+            {
+                scheduled_filters[filter] = &schedule;
+            }
+        }
+    }
+
+    if (block_fusion_)
+    {
+        for (auto filter: filters)
+        {
+            // Replicated blocks are scheduled on their own, so that their parts can run concurrently,
+            // and so are I/O bound blocks, so that they don't drag other blocks onto the I/O threads.
+            IFilter* sink_filter = fusibleSink(*filter);
+            if (sink_filter && !scheduled_filters.count(filter) && !scheduled_filters.count(sink_filter) &&
+                blocks_map[filter]->replicasCount() == 1 && blocks_map[sink_filter]->replicasCount() == 1 &&
+                !ioBound(*blocks_map[filter]) && !ioBound(*blocks_map[sink_filter]))
+            {
+                fused_sinks[filter] = sink_filter;
+                fused_filters.insert(sink_filter);
+            }
+        }
     }
 
     for (auto filter: filters)
@@ -94,6 +314,13 @@ void Pipeline::add(IFilter& top_filter)
                 CHECK(blocks_map.count(&std::get<0>(source)));
                 Block& source_block = *blocks_map[&std::get<0>(source)];
                 current_block.reader(i).setWriter(source_block.writer(std::get<1>(source)));
+                source_block.addConsumer(current_block);
+
+                // Bursts are formed by holding back the output of the sources.
+                if (!source_block.inputChannelsCount())
+                {
+                    current_block.setBurstGated(true);
+                }
             }
         }
 
@@ -107,300 +334,1805 @@ void Pipeline::add(IFilter& top_filter)
             }
         }
     }
-}
-
-void Pipeline::start()
-{
-    CHECK(state_ == State::Stopped) << "Attempted to start pipeline in state = " << int(state_);
-
-    last_exception_.reset();
-    relaxed_mode_ = false;
-    scheduling_ = false;
-    finished_ = false;
-    stalled_ = false;
 
-    scheduleAllBlocks();
+    // Outputs written in place, each after the output whose buffer it shares.
+    std::vector<Channel> in_place_outputs;
+    if (in_place_buffers_ && buffer_backend_ == BufferBackend::Mirrored)
+    {
+        std::unordered_map<const CircularBufferWriter*, CircularBufferWriter*> sharing_writers;
+        for (auto filter: filters)
+        {
+            Block& block = *blocks_map[filter];
+            for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+            {
+                if (inPlace(block, i))
+                {
+                    CircularBufferReader& reader = block.reader(filter->outputState(i).inPlaceInput());
+                    block.writer(i).setInPlaceReader(reader);
+                    sharing_writers[&reader.writer()] = &block.writer(i);
+                }
+            }
+        }
 
-    state_ = State::Running;
+        for (auto& sharing_writer: sharing_writers)
+        {
+            if (!sharing_writer.first->inPlaceReader())
+            {
+                for (auto it = sharing_writers.find(sharing_writer.first); it != sharing_writers.end(); it = sharing_writers.find(it->second))
+                {
+                    in_place_outputs.emplace_back(it->second->block().filter(), it->second->outputChannel());
+                }
+            }
+        }
+    }
 
-    // Start enough threads - but not more than blocks we have,
-    // as blocks cannot be executed simultaneously by multiple threads.
-    threads_count_ =
-        std::min<std::size_t>(
-            std::thread::hardware_concurrency(),
-            blocks_.size()
-        );
-    threads_.reserve(threads_count_);
-    threads_running_ = threads_count_;
-    for (unsigned i = 0; i < threads_count_; ++i)
+    // Build the fused chains starting from the filters that are not fused
+    // to their sources.
+    std::size_t fused_count = 0;
+    for (auto filter: filters)
     {
-        threads_.emplace_back(&Pipeline::runThread, this);
+        if (!fused_filters.count(filter))
+        {
+            Block& head = *blocks_map[filter];
+            for (auto it = fused_sinks.find(filter); it != fused_sinks.end(); it = fused_sinks.find(it->second))
+            {
+                head.fuse(*blocks_map[it->second]);
+                ++fused_count;
+            }
+        }
     }
-}
 
-void Pipeline::pause()
-{
-    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+    CHECK_EQ(fused_filters.size(), fused_count) << "Fused chains must not form cycles";
 
-    if (state_ == State::Running)
-    {
-        state_ = State::Paused;
-        threads_waiting_ = 0;
-        task_scheduled_.notify_all();
-    }
-    else
+    // Each static schedule runs as a single unit, its filters ordered producers first.
+    for (auto& schedule: schedules)
     {
-        LOG(FATAL) << "Attempted to pause non-running pipeline";
+        Block& head = *blocks_map[schedule.filters.front()];
+        for (std::size_t i = 1; i < schedule.filters.size(); ++i)
+        {
+            head.fuse(*blocks_map[schedule.filters[i]]);
+        }
+
+        for (auto filter: schedule.filters)
+        {
+            std::vector<std::size_t> input_sizes, output_sizes;
+            for (std::size_t i = 0; i < filter->inputChannelsCount(); ++i)
+            {
+                input_sizes.push_back(schedule.inputSize(*filter, i));
+            }
+
+            for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+            {
+                output_sizes.push_back(schedule.outputSize(*filter, i));
+            }
+
+            blocks_map[filter]->setPeriod(input_sizes, output_sizes);
+        }
     }
-}
 
-void Pipeline::reset()
-{
-    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
-    CHECK(state_ == State::Paused) << "Attempted to reset the non-paused pipeline";
+    setSinkDistances(filters, blocks_map);
 
-    for (auto& block: blocks_)
+    // Buffers of the previously added filters take their share of the budget.
+    std::size_t used_memory = 0;
+    for (auto& layout: buffer_layout_)
     {
-        block.reset();
+        used_memory += layout.size * layout.type_size;
     }
 
-    queue_.clear();
-    lock.unlock();
-    scheduleAllBlocks();
-}
+    std::size_t memory_budget =
+        buffer_memory_budget_ ?
+        std::max<std::size_t>(buffer_memory_budget_ - std::min(used_memory, buffer_memory_budget_), 1) :
+        0;
 
-void Pipeline::resume()
-{
-    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+    BufferPlanner planner(buffer_backend_, memory_budget, cache_aware_buffers_);
+    auto add_buffer =
+        [&](IFilter* filter, std::size_t output_channel)
+        {
+            std::size_t sink_replicas = 1;
+            // Output is sized for the period only if all its readers are in the same schedule.
+            auto schedule_it = scheduled_filters.find(filter);
+            bool scheduled = schedule_it != scheduled_filters.end() && !filter->sinks(output_channel).empty();
+            for (auto& sink: filter->sinks(output_channel))
+            {
+                sink_replicas = std::max(sink_replicas, blocks_map[&std::get<0>(sink)]->replicasCount());
 
-    if (state_ == State::Paused)
-    {
-        state_ = State::Running;
-        threads_waiting_ = 0;
-        task_scheduled_.notify_all();
-    }
-    else if (state_ == State::Stopped)
-    {
-        // We don't need the lock anymore - release it so that
-        // the threads that start() creates can execute immediately.
-        lock.unlock();
-        start();
-    }
-    else
-    {
-        LOG(FATAL) << "Attempted to resume pipeline in state = " << int(state_);
-    }
-}
+                auto sink_schedule_it = scheduled_filters.find(&std::get<0>(sink));
+                scheduled = scheduled && sink_schedule_it != scheduled_filters.end() && sink_schedule_it->second == schedule_it->second;
+            }
 
-void Pipeline::wait()
-{
-    // Wait until all the threads are finished:
-    for (auto& thread: threads_)
+            planner.addBuffer(
+                *blocks_map[filter],
+                output_channel,
+                fused_sinks.count(filter) > 0,
+                sink_replicas,
+                scheduled ? schedule_it->second->outputSize(*filter, output_channel) : 0
+            );
+        };
+
+    for (auto filter: filters)
     {
-        thread.join();
+        for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+        {
+            if (!blocks_map[filter]->writer(i).inPlaceReader())
+            {
+                add_buffer(filter, i);
+            }
+        }
     }
-}
 
-void Pipeline::stop()
-{
+    for (auto& output: in_place_outputs)
     {
-        std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
-        CHECK(state_ == State::Running || state_ == State::Paused) << "Attempted to stop pipeline in state = " << int(state_);
-        state_ = State::Stopped;
-        threads_waiting_ = 0;
-        task_scheduled_.notify_all();
+        add_buffer(&std::get<0>(output), std::get<1>(output));
     }
 
-    wait();
-    finalize();
-}
+    // Allocation zero-fills the copying buffers, so do it on the node that is going to use
+    // them. Mirrored buffers are not touched until their writers run on that node anyway.
+    runPinned(
+        numa_node_ >= 0 ? threads_cpus_ : std::vector<std::size_t>(),
+        [this, &planner]
+        {
+            for (auto& layout: planner.allocate())
+            {
+                buffer_layout_.push_back(layout);
+            }
+        }
+    );
 
-void Pipeline::finalize()
-{
-    if (last_exception_)
+    for (auto& schedule: schedules)
     {
-        last_exception_->rethrow();
+        Block& head = *blocks_map[schedule.filters.front()];
+        if (!periodFits(head))
+        {
+            LOG(WARNING) << "Buffers cannot hold the period of " << schedule.filters.size() << " statically scheduled filters, scheduling them dynamically";
+            for (auto block: head.fusedBlocks())
+            {
+                block->setPeriod({}, {});
+            }
+        }
     }
 
-    bool eof_found = false;
-    for (auto& block: blocks_)
+    for (auto filter: filters)
     {
-        for (std::size_t i = 0; !eof_found && i < block.outputChannelsCount(); ++i)
+        Block& block = *blocks_map[filter];
+        if (block.replicasCount() > 1 && !block.reader(0).mirrored())
         {
-            eof_found = eof_found || block.outputState(i).eof();
+            // Parts of the copying buffer might be moved to the next lap while replicas process them.
+            LOG(WARNING) << "Mirrored buffer is not available, not replicating " << typeid(*filter).name();
+            block.replicate(1);
         }
-
-        CHECK(!finished_ || block.state().load() == Block::State::Idle) << block.internalState();
     }
+}
 
-    stalled_ = !eof_found;
+Pipeline::SchedulingMode Pipeline::schedulingMode() const
+{
+    return scheduling_mode_;
+}
 
-    if (stalled_)
-    {
-        LOG(ERROR) << "Pipeline stalled with pending input data";
-    }
+void Pipeline::setSchedulingMode(SchedulingMode scheduling_mode)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change scheduling mode of pipeline in state = " << int(state_.load());
+    scheduling_mode_ = scheduling_mode;
 }
 
-void Pipeline::run()
+Pipeline::SchedulingPolicy Pipeline::schedulingPolicy() const
 {
-    start();
-    wait();
-    finalize();
+    return scheduling_policy_;
 }
 
-bool Pipeline::scheduleAllBlocks()
+void Pipeline::setSchedulingPolicy(SchedulingPolicy scheduling_policy)
 {
-    bool scheduled = false;
+    CHECK(state_ == State::Stopped) << "Attempted to change scheduling policy of pipeline in state = " << int(state_.load());
+    scheduling_policy_ = scheduling_policy;
+}
 
+std::vector<BlockStats> Pipeline::stats() const
+{
+    std::vector<BlockStats> stats;
     for (auto& block: blocks_)
     {
-        scheduled = trySchedulingBlock(block) || scheduled;
+        stats.push_back(block.stats());
     }
 
-    return scheduled;
+    return stats;
 }
 
-void Pipeline::runThread()
+void Pipeline::setTraceCapacity(std::size_t max_events_per_thread)
 {
-    while (true)
-    {
-        Block* block;
-        {
-            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+    CHECK(state_ == State::Stopped) << "Attempted to change trace capacity of pipeline in state = " << int(state_.load());
+    trace_capacity_ = max_events_per_thread;
+}
 
-            --threads_running_;
+void Pipeline::writeTrace(std::ostream& os) const
+{
+    CHECK(tracer_) << "Tracing is not enabled";
+    tracer_->write(os, blocks_);
+}
 
-            if (state_ == State::Stopped)
-            {
-                // Exit the loop.
-                break;
-            }
+bool Pipeline::blockFusion() const
+{
+    return block_fusion_;
+}
 
-            if (queue_.empty() && !threads_running_ && !scheduling_)
-            {
-                if (!relaxed_mode_)
-                {
-                    // First time we're here - reschedule blocks in relaxed
-                    // size mode to process the rest of the data.
-                    relaxed_mode_ = true;
-                    scheduling_ = true;
+void Pipeline::setBlockFusion(bool block_fusion)
+{
+    CHECK(blocks_.empty()) << "Attempted to change block fusion of pipeline with " << blocks_.size() << " blocks";
+    block_fusion_ = block_fusion;
+}
 
-                    // Release lock because scheduling will try to acquire it.
-                    lock.unlock();
-                    scheduleAllBlocks();
-                    lock.lock();
+bool Pipeline::staticSchedules() const
+{
+    return static_schedules_;
+}
 
-                    scheduling_ = false;
+void Pipeline::setStaticSchedules(bool static_schedules)
+{
+    CHECK(blocks_.empty()) << "Attempted to change static schedules of pipeline with " << blocks_.size() << " blocks";
+    static_schedules_ = static_schedules;
+}
+
+std::size_t Pipeline::blockReplicas() const
+{
+    return block_replicas_;
+}
+
+void Pipeline::setBlockReplicas(std::size_t block_replicas)
+{
+    CHECK(blocks_.empty()) << "Attempted to change block replicas of pipeline with " << blocks_.size() << " blocks";
+    CHECK_GE(block_replicas, 1);
+    block_replicas_ = block_replicas;
+}
+
+bool Pipeline::consumerHandOff() const
+{
+    return consumer_hand_off_;
+}
+
+void Pipeline::setConsumerHandOff(bool consumer_hand_off)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change consumer hand-off of pipeline in state = " << int(state_.load());
+    consumer_hand_off_ = consumer_hand_off;
+}
+
+bool Pipeline::ioThreads() const
+{
+    return io_threads_;
+}
+
+void Pipeline::setIoThreads(bool io_threads)
+{
+    CHECK(blocks_.empty()) << "Attempted to change I/O threads of pipeline with " << blocks_.size() << " blocks";
+    io_threads_ = io_threads;
+}
+
+ChunkSizeTuning Pipeline::chunkSizeTuning() const
+{
+    return chunk_size_tuning_;
+}
+
+void Pipeline::setChunkSizeTuning(ChunkSizeTuning chunk_size_tuning)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change chunk size tuning of pipeline in state = " << int(state_.load());
+    chunk_size_tuning_ = chunk_size_tuning;
+}
+
+std::size_t Pipeline::bufferMemoryBudget() const
+{
+    return buffer_memory_budget_;
+}
+
+void Pipeline::setBufferMemoryBudget(std::size_t buffer_memory_budget)
+{
+    CHECK(blocks_.empty()) << "Attempted to change buffer memory budget of pipeline with " << blocks_.size() << " blocks";
+    buffer_memory_budget_ = buffer_memory_budget;
+}
+
+bool Pipeline::inPlaceBuffers() const
+{
+    return in_place_buffers_;
+}
+
+void Pipeline::setInPlaceBuffers(bool in_place_buffers)
+{
+    CHECK(blocks_.empty()) << "Attempted to change in-place buffers of pipeline with " << blocks_.size() << " blocks";
+    in_place_buffers_ = in_place_buffers;
+}
+
+bool Pipeline::cacheAwareBuffers() const
+{
+    return cache_aware_buffers_;
+}
+
+void Pipeline::setCacheAwareBuffers(bool cache_aware_buffers)
+{
+    CHECK(blocks_.empty()) << "Attempted to change cache aware buffers of pipeline with " << blocks_.size() << " blocks";
+    cache_aware_buffers_ = cache_aware_buffers;
+}
+
+const std::vector<BufferLayout>& Pipeline::bufferLayout() const
+{
+    return buffer_layout_;
+}
+
+BufferBackend Pipeline::bufferBackend() const
+{
+    return buffer_backend_;
+}
+
+void Pipeline::setBufferBackend(BufferBackend buffer_backend)
+{
+    CHECK(blocks_.empty()) << "Attempted to change buffer backend of pipeline with " << blocks_.size() << " blocks";
+    buffer_backend_ = buffer_backend;
+}
+
+std::size_t Pipeline::maxThreads() const
+{
+    return max_threads_;
+}
+
+void Pipeline::setMaxThreads(std::size_t max_threads)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change max threads of pipeline in state = " << int(state_.load());
+    max_threads_ = max_threads;
+}
+
+bool Pipeline::elasticThreads() const
+{
+    return elastic_threads_;
+}
+
+void Pipeline::setElasticThreads(bool elastic_threads)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change elastic threads of pipeline in state = " << int(state_.load());
+    elastic_threads_ = elastic_threads;
+}
+
+std::size_t Pipeline::activeThreads() const
+{
+    return active_threads_.load();
+}
+
+const std::vector<std::size_t>& Pipeline::cpuAffinity() const
+{
+    return cpu_affinity_;
+}
+
+void Pipeline::setCpuAffinity(const std::vector<std::size_t>& cpus)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change CPU affinity of pipeline in state = " << int(state_.load());
+    cpu_affinity_ = cpus;
+    updateThreadsCpus();
+}
+
+int Pipeline::numaNode() const
+{
+    return numa_node_;
+}
+
+void Pipeline::setNumaNode(int numa_node)
+{
+    CHECK(blocks_.empty()) << "Attempted to change NUMA node of pipeline with " << blocks_.size() << " blocks";
+    numa_node_ = numa_node;
+    updateThreadsCpus();
+}
+
+void Pipeline::updateThreadsCpus()
+{
+    threads_cpus_ = cpu_affinity_;
+
+    if (numa_node_ >= 0)
+    {
+        std::vector<std::size_t> node_cpus = numaNodeCpus(std::size_t(numa_node_));
+        if (node_cpus.empty())
+        {
+            LOG(WARNING) << "NUMA node " << numa_node_ << " is not available, ignoring it";
+        }
+        else if (threads_cpus_.empty())
+        {
+            threads_cpus_ = node_cpus;
+        }
+        else
+        {
+            threads_cpus_.erase(
+                std::remove_if(
+                    threads_cpus_.begin(),
+                    threads_cpus_.end(),
+                    [&node_cpus](std::size_t cpu)
+                    {
+                        return std::find(node_cpus.begin(), node_cpus.end(), cpu) == node_cpus.end();
+                    }
+                ),
+                threads_cpus_.end()
+            );
+
+            if (threads_cpus_.empty())
+            {
+                LOG(WARNING) << "CPU affinity has no CPUs of NUMA node " << numa_node_ << ", using the whole node";
+                threads_cpus_ = node_cpus;
+            }
+        }
+    }
+}
+
+std::chrono::milliseconds Pipeline::latencyBudget() const
+{
+    return latency_budget_;
+}
+
+void Pipeline::setLatencyBudget(std::chrono::milliseconds latency_budget)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change latency budget of pipeline in state = " << int(state_.load());
+    latency_budget_ = latency_budget;
+}
+
+Executor* Pipeline::executor() const
+{
+    return executor_;
+}
+
+void Pipeline::setExecutor(Executor* executor)
+{
+    CHECK(state_ == State::Stopped) << "Attempted to change executor of pipeline in state = " << int(state_.load());
+    executor_ = executor;
+}
+
+void Pipeline::start()
+{
+    CHECK(state_ == State::Stopped) << "Attempted to start pipeline in state = " << int(state_.load());
+    CHECK(!executor_ || scheduling_mode_ == SchedulingMode::SharedQueue) << "Executor supports only shared queue scheduling mode";
+
+    last_exception_.reset();
+    relaxed_mode_ = false;
+    scheduling_ = false;
+    finished_ = false;
+    stalled_ = false;
+    pending_wake_ups_ = 0;
+    threads_sleeping_ = 0;
+    threads_parked_ = 0;
+
+    // Start enough threads - but not more than blocks we have,
+    // as blocks cannot be executed simultaneously by multiple threads,
+    // unless they are replicated. I/O bound blocks have threads of their own.
+    std::size_t replicas_count = 0;
+    io_threads_count_ = 0;
+    polled_blocks_count_ = 0;
+    for (auto& block: blocks_)
+    {
+        if (polled(block))
+        {
+            ++polled_blocks_count_;
+        }
+
+        if (ioBound(block))
+        {
+            ++io_threads_count_;
+        }
+        else
+        {
+            replicas_count += block.replicasCount();
+        }
+    }
+
+    std::size_t max_threads = max_threads_ ? max_threads_ : std::thread::hardware_concurrency();
+    if (!threads_cpus_.empty())
+    {
+        max_threads = std::min(max_threads, threads_cpus_.size());
+    }
+
+    threads_count_ = std::min(max_threads, replicas_count);
+
+    if (executor_)
+    {
+        // Any of the executor threads can pick up the blocks.
+        threads_count_ = executor_->threadsCount();
+    }
+
+    // Elastic threads start from a single one and grow with the load.
+    active_threads_ = elastic_threads_ && !executor_ ? 1 : threads_count_;
+    busy_time_ = 0;
+    load_window_start_ = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+
+    tracer_.reset(trace_capacity_ ? new Tracer(threads_count_, io_threads_count_, trace_capacity_) : nullptr);
+
+    int min_chunk_size_level = std::numeric_limits<int>::min(), max_chunk_size_level = std::numeric_limits<int>::max();
+    if (scheduling_policy_ == SchedulingPolicy::Latency || scheduling_policy_ == SchedulingPolicy::CriticalPath)
+    {
+        max_chunk_size_level = 0;
+    }
+    else if (scheduling_policy_ == SchedulingPolicy::Throughput)
+    {
+        min_chunk_size_level = BatchChunkSizeLevel;
+    }
+
+    for (auto& block: blocks_)
+    {
+        block.setChunkSizeTuning(chunk_size_tuning_, min_chunk_size_level, max_chunk_size_level);
+    }
+
+    if (scheduling_policy_ == SchedulingPolicy::CriticalPath)
+    {
+        std::vector<Block*> order = criticalPathOrder(blocks_);
+        std::unordered_map<const Block*, std::size_t> indices;
+
+        critical_path_nodes_.clear();
+        for (auto block: order)
+        {
+            CriticalPathNode node{block, {}, !block->outputChannelsCount() && block->filter().ioBound(), block->wallTime(), 0, 0, 0};
+            for (auto consumer: block->consumers())
+            {
+                node.consumers.push_back(indices[consumer]);
+                node.deadline = node.deadline || critical_path_nodes_[indices[consumer]].deadline;
+            }
+
+            indices[block] = critical_path_nodes_.size();
+            critical_path_nodes_.push_back(std::move(node));
+        }
+
+        critical_paths_source_samples_ = 0;
+        for (auto& node: critical_path_nodes_)
+        {
+            if (!node.block->inputChannelsCount() && node.block->outputChannelsCount())
+            {
+                critical_paths_source_samples_ += node.block->producedSamples(0);
+            }
+        }
+
+        critical_paths_update_time_ = 0;
+    }
+
+    burst_blocks_.clear();
+    for (auto& block: blocks_)
+    {
+        if (burstGated(block))
+        {
+            burst_blocks_.push_back(&block);
+        }
+    }
+
+    if (scheduling_mode_ == SchedulingMode::WorkStealing)
+    {
+        workers_queues_.clear();
+        for (std::size_t i = 0; i < threads_count_; ++i)
+        {
+            workers_queues_.push_back(std::make_unique<WorkStealingQueue>(blocks_.size()));
+        }
+    }
+
+    if (countsActiveBlocks())
+    {
+        // Hold the pipeline active until all threads are started,
+        // in case there's nothing to schedule right away.
+        active_blocks_ = 1;
+    }
+
+    if (polled_blocks_count_)
+    {
+        try
+        {
+            poll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+            poll_wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            if (poll_fd_ < 0 || poll_wake_fd_ < 0)
+            {
+                THROW(core::IoError()) << "Cannot create epoll instance";
+            }
+
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.ptr = nullptr;
+            if (epoll_ctl(poll_fd_, EPOLL_CTL_ADD, poll_wake_fd_, &event) < 0)
+            {
+                THROW(core::IoError()) << "Cannot add eventfd to epoll instance";
+            }
+
+            for (auto& block: blocks_)
+            {
+                if (polled(block))
+                {
+                    block.pollReady() = false;
+                    block.pollArmed() = false;
+                    armPolledBlock(block, EPOLL_CTL_ADD);
+                }
+            }
+        }
+        catch (...)
+        {
+            // The pipeline stays stopped, so nothing else releases the descriptors and the blocks.
+            for (auto& block: blocks_)
+            {
+                block.pollArmed() = false;
+            }
+            active_blocks_ = 0;
+            closePollDescriptors();
+            throw;
+        }
+    }
+
+    scheduleAllBlocks();
+
+    state_ = State::Running;
+
+    threads_.clear();
+    threads_.reserve(threads_count_ + io_threads_count_);
+
+    if (executor_)
+    {
+        executor_->attach(*this);
+    }
+    else
+    {
+        threads_running_ = threads_count_;
+        for (std::size_t i = 0; i < threads_count_; ++i)
+        {
+            threads_.emplace_back(&Pipeline::runThread, this, i);
+        }
+    }
+
+    for (std::size_t i = 0; i < io_threads_count_; ++i)
+    {
+        threads_.emplace_back(&Pipeline::runIoThread, this, threads_count_ + i);
+    }
+
+    if (polled_blocks_count_)
+    {
+        threads_.emplace_back(&Pipeline::runPollThread, this);
+    }
+
+    if (!burst_blocks_.empty())
+    {
+        threads_.emplace_back(&Pipeline::runBurstsThread, this);
+    }
+
+    if (countsActiveBlocks())
+    {
+        finishActiveBlock();
+    }
+}
+
+void Pipeline::pause()
+{
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+    if (state_ == State::Running)
+    {
+        state_ = State::Paused;
+        notifyAllThreads();
+    }
+    else
+    {
+        LOG(FATAL) << "Attempted to pause non-running pipeline";
+    }
+}
+
+void Pipeline::reset()
+{
+    std::unique_lock<std::mutex> poll_lock(poll_mutex_);
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+    CHECK(state_ == State::Paused) << "Attempted to reset the non-paused pipeline";
+
+    for (auto& block: blocks_)
+    {
+        block.reset();
+    }
+
+    queue_.clear();
+    queued_blocks_ = 0;
+    io_queue_.clear();
+    for (auto& worker_queue: workers_queues_)
+    {
+        worker_queue->clear();
+    }
+
+    // Paused pipeline has no running blocks, so the reset above has just
+    // deactivated all of them, except for the ones waiting for their poll descriptors.
+    // Same as in start(), hold the pipeline active until the blocks are scheduled,
+    // in case there's nothing to schedule right away.
+    active_blocks_ = std::size_t(
+        std::count_if(
+            blocks_.begin(),
+            blocks_.end(),
+            [](Block& block)
+            {
+                return block.pollArmed().load();
+            }
+        )
+    ) + (countsActiveBlocks() ? 1u : 0u);
+
+    // Whatever the descriptors reported before the reset might have been dropped
+    // by the blocks reset, so wait for the descriptors to report again.
+    for (auto& block: blocks_)
+    {
+        if (polled(block))
+        {
+            block.pollReady() = false;
+            armPolledBlock(block, EPOLL_CTL_MOD);
+        }
+    }
+
+    lock.unlock();
+    poll_lock.unlock();
+    scheduleAllBlocks();
+
+    if (countsActiveBlocks())
+    {
+        finishActiveBlock();
+    }
+}
+
+void Pipeline::resume()
+{
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+    if (state_ == State::Paused)
+    {
+        state_ = State::Running;
+        notifyAllThreads();
+
+        if (executor_)
+        {
+            executor_->notify();
+        }
+    }
+    else if (state_ == State::Stopped)
+    {
+        // We don't need the lock anymore - release it so that
+        // the threads that start() creates can execute immediately.
+        lock.unlock();
+        start();
+    }
+    else
+    {
+        LOG(FATAL) << "Attempted to resume pipeline in state = " << int(state_.load());
+    }
+}
+
+void Pipeline::wait()
+{
+    if (executor_)
+    {
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            task_scheduled_.wait(
+                lock,
+                [=]
+                {
+                    return state_ == State::Stopped;
+                }
+            );
+        }
+
+        // Blocks might still be running on the executor threads.
+        executor_->detach(*this);
+    }
+
+    // Wait until all the threads are finished:
+    for (auto& thread: threads_)
+    {
+        thread.join();
+    }
+
+    closePollDescriptors();
+}
+
+void Pipeline::stop()
+{
+    {
+        std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+        CHECK(state_ == State::Running || state_ == State::Paused) << "Attempted to stop pipeline in state = " << int(state_.load());
+        state_ = State::Stopped;
+        notifyAllThreads();
+    }
+
+    wait();
+    finalize();
+}
+
+void Pipeline::finalize()
+{
+    if (last_exception_)
+    {
+        last_exception_->rethrow();
+    }
+
+    bool eof_found = false;
+    for (auto& block: blocks_)
+    {
+        for (std::size_t i = 0; !eof_found && i < block.outputChannelsCount(); ++i)
+        {
+            eof_found = eof_found || block.outputState(i).eof();
+        }
+
+        CHECK(!finished_ || block.state().load() == Block::State::Idle) << block.internalState();
+    }
+
+    stalled_ = !eof_found;
+
+    if (stalled_)
+    {
+        LOG(ERROR) << "Pipeline stalled with pending input data";
+    }
+}
+
+void Pipeline::run()
+{
+    start();
+    wait();
+    finalize();
+}
+
+bool Pipeline::scheduleAllBlocks()
+{
+    bool scheduled = false;
+
+    for (auto& block: blocks_)
+    {
+        scheduled = trySchedulingBlock(block) || scheduled;
+    }
+
+    return scheduled;
+}
+
+void Pipeline::runThread(std::size_t thread_index)
+{
+    current_pipeline = this;
+    current_thread_index = thread_index;
+
+    pinCurrentThread(threads_cpus_);
+
+    if (scheduling_mode_ == SchedulingMode::WorkStealing)
+    {
+        runWorkStealingThread(thread_index);
+    }
+    else
+    {
+        runSharedQueueThread(thread_index);
+    }
+
+    current_pipeline = nullptr;
+}
+
+void Pipeline::runSharedQueueThread(std::size_t thread_index)
+{
+    std::size_t spin_iterations = MinSpinIterations;
+
+    while (true)
+    {
+        Block* block;
+        bool wake_up;
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+            --threads_running_;
+
+            if (state_ == State::Stopped)
+            {
+                // Exit the loop.
+                break;
+            }
+
+            // With the active blocks counted, it's the last finished block that detects the end.
+            if (!countsActiveBlocks() && queue_.empty() && !threads_running_ && !scheduling_)
+            {
+                if (!relaxed_mode_)
+                {
+                    // First time we're here - reschedule blocks in relaxed
+                    // size mode to process the rest of the data.
+                    relaxed_mode_ = true;
+                    scheduling_ = true;
+
+                    // Release lock because scheduling will try to acquire it.
+                    lock.unlock();
+                    scheduleAllBlocks();
+                    lock.lock();
+
+                    scheduling_ = false;
                     ++threads_running_;
                     continue;
                 }
                 else
                 {
-                    // We're in "empty queue" clause the second time - by now all blocks
-                    // that can be possibly scheduled under relaxed scheme should have been
-                    // scheduled and executed, including those that became schedulable after
-                    // initial blocks under relaxed scheme were scheduled.
-                    // Check this is the case indeed.
-                    lock.unlock();
-                    CHECK(!scheduleAllBlocks());
-                    lock.lock();
+                    // We're in "empty queue" clause the second time - by now all blocks
+                    // that can be possibly scheduled under relaxed scheme should have been
+                    // scheduled and executed, including those that became schedulable after
+                    // initial blocks under relaxed scheme were scheduled.
+                    // Check this is the case indeed.
+                    lock.unlock();
+                    CHECK(!scheduleAllBlocks());
+                    lock.lock();
+
+                    // Switch into the 'stopped' mode.
+                    state_ = State::Stopped;
+                    finished_ = true;
+
+                    // Let everybody know we're stalled and exit the loop.
+                    notifyAllThreads();
+                    break;
+                }
+            }
+
+            if (parkThread(lock, thread_index))
+            {
+                ++threads_running_;
+                continue;
+            }
+
+            if (queue_.empty() && state_ == State::Running)
+            {
+                // Wait without the lock, so that queueing the blocks stays cheap.
+                lock.unlock();
+                waitForQueuedBlocks(spin_iterations);
+                lock.lock();
+
+                ++threads_running_;
+                continue;
+            }
+
+            if (state_ == State::Stopped)
+            {
+                // Exit the loop.
+                break;
+            }
+            else if (state_ == State::Paused)
+            {
+                task_scheduled_.wait(
+                    lock,
+                    [=]
+                    {
+                        return state_ != State::Paused;
+                    }
+                );
+                ++threads_running_;
+                continue;
+            }
+
+            block = popSharedQueue();
+
+            ++threads_running_;
+
+            // Get one more thread going for the rest of the queue, unless some thread
+            // is spinning already: that one will get another going in turn, if needed.
+            wake_up = queue_.size() > extraQueueLoad() && !threads_spinning_.load();
+        }
+
+        if (wake_up)
+        {
+            blocks_queued_.notifyOne();
+        }
+
+        // Keep running the consumers handed off by the blocks just run,
+        // as the data they need is still in the cache of this thread.
+        auto begin_time = std::chrono::steady_clock::now();
+        bool processed = true;
+        while (block && processed)
+        {
+            processed = processBlock(*block, thread_index);
+            Block* next_block = takeHandedOffBlock(processed);
+
+            if (processed && countsActiveBlocks())
+            {
+                finishActiveBlock();
+            }
+
+            block = next_block;
+        }
+
+        if (elastic_threads_)
+        {
+            updateActiveThreads(begin_time);
+        }
+
+        if (!processed)
+        {
+            break;
+        }
+    }
+}
+
+void Pipeline::runWorkStealingThread(std::size_t thread_index)
+{
+    Block* next_block = nullptr;
+    std::vector<Block*> ordered_blocks;
+
+    while (true)
+    {
+        Block* block = next_block;
+
+        // Blocks queued by this thread for itself must be run before it's parked.
+        if (!block && elastic_threads_ && thread_index >= active_threads_.load() && workers_queues_[thread_index]->empty())
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            if (parkThread(lock, thread_index))
+            {
+                continue;
+            }
+        }
+
+        if (!block && state_ == State::Running)
+        {
+            block = findBlock(thread_index);
+        }
+
+        if (!block)
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+            if (state_ == State::Stopped)
+            {
+                // Exit the loop.
+                break;
+            }
+            else if (state_ == State::Paused)
+            {
+                task_scheduled_.wait(
+                    lock,
+                    [=]
+                    {
+                        return state_ != State::Paused;
+                    }
+                );
+                continue;
+            }
+
+            if (!queue_.empty())
+            {
+                // Blocks scheduled outside of worker threads end up in the shared queue.
+                block = popSharedQueue();
+            }
+            else
+            {
+                ++threads_sleeping_;
+                // Blocks queued after this point are guaranteed to see this thread
+                // as sleeping, so it's safe to sleep if no blocks are queued yet.
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+
+                if (!hasQueuedBlocks())
+                {
+                    task_scheduled_.wait(
+                        lock,
+                        [=]
+                        {
+                            return pending_wake_ups_ || state_ != State::Running;
+                        }
+                    );
+
+                    if (pending_wake_ups_)
+                    {
+                        --pending_wake_ups_;
+                    }
+                }
+
+                --threads_sleeping_;
+                continue;
+            }
+        }
+
+        auto begin_time = std::chrono::steady_clock::now();
+        // Covers the relaxed mode switch in finishActiveBlock() too, which queues the leftovers.
+        local_blocks = ordersLocalBlocks() ? &ordered_blocks : nullptr;
+        bool processed = processBlock(*block, thread_index);
+        // The handed off block is active already, so it's safe
+        // to finish the current one before running it.
+        next_block = takeHandedOffBlock(processed);
+
+        if (processed)
+        {
+            if (elastic_threads_)
+            {
+                updateActiveThreads(begin_time);
+            }
+
+            finishActiveBlock();
+        }
+
+        local_blocks = nullptr;
+        pushLocalBlocks(ordered_blocks, thread_index);
+
+        if (!processed)
+        {
+            break;
+        }
+    }
+}
+
+void Pipeline::runIoThread(std::size_t thread_index)
+{
+    while (true)
+    {
+        Block* block;
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            io_block_scheduled_.wait(
+                lock,
+                [=]
+                {
+                    return state_ == State::Stopped || (state_ == State::Running && !io_queue_.empty());
+                }
+            );
+
+            if (state_ == State::Stopped)
+            {
+                // Exit the loop.
+                break;
+            }
+
+            block = io_queue_.front();
+            io_queue_.pop_front();
+        }
+
+        if (!processBlock(*block, thread_index))
+        {
+            break;
+        }
+
+        finishActiveBlock();
+    }
+}
+
+void Pipeline::runPollThread()
+{
+    std::vector<epoll_event> events(polled_blocks_count_ + 1);
+
+    while (state_ != State::Stopped)
+    {
+        int events_count = epoll_wait(poll_fd_, events.data(), int(events.size()), -1);
+        CHECK(events_count >= 0 || errno == EINTR) << "epoll_wait() failed, errno = " << errno;
+
+        std::unique_lock<std::mutex> lock(poll_mutex_);
+        for (int i = 0; i < events_count; ++i)
+        {
+            Block* block = static_cast<Block*>(events[std::size_t(i)].data.ptr);
+            if (!block)
+            {
+                // Woken up to check the state of the pipeline.
+                std::uint64_t value;
+                while (read(poll_wake_fd_, &value, sizeof(value)) > 0)
+                {
+                }
+                continue;
+            }
+
+            block->pollArmed() = false;
+            block->pollReady() = true;
+            trySchedulingBlock(*block);
+
+            // The block is counted as active again if it has been scheduled.
+            finishActiveBlock();
+        }
+    }
+}
+
+bool Pipeline::parkThread(std::unique_lock<std::mutex>& lock, std::size_t thread_index)
+{
+    if (!elastic_threads_ || thread_index < active_threads_.load() || state_ != State::Running)
+    {
+        return false;
+    }
+
+    // Shared queue threads might be waiting for the blocks this one has just queued.
+    if (!queue_.empty())
+    {
+        blocks_queued_.notifyOne();
+    }
+
+    ++threads_parked_;
+    threads_unparked_.wait(
+        lock,
+        [=]
+        {
+            return thread_index < active_threads_.load() || state_ != State::Running;
+        }
+    );
+    --threads_parked_;
+
+    return true;
+}
+
+void Pipeline::updateActiveThreads(std::chrono::steady_clock::time_point begin_time)
+{
+    auto end_time = std::chrono::steady_clock::now();
+    busy_time_ += std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - begin_time).count();
+
+    // Only the thread that closes the window evaluates it.
+    std::int64_t window_end = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time.time_since_epoch()).count();
+    std::int64_t window_start = load_window_start_.load();
+    if (window_end - window_start < std::chrono::nanoseconds(LoadWindow).count() ||
+        !load_window_start_.compare_exchange_strong(window_start, window_end))
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+    std::size_t active_threads = active_threads_.load();
+    double utilisation = double(busy_time_.exchange(0)) / double((window_end - window_start) * std::int64_t(active_threads));
+
+    // Blocks waiting for a thread to run them.
+    std::size_t queued_blocks = queue_.size();
+    if (scheduling_mode_ == SchedulingMode::WorkStealing && active_blocks_.load() > active_threads)
+    {
+        queued_blocks += active_blocks_.load() - active_threads;
+    }
+
+    if ((utilisation > GrowUtilisation || queued_blocks > active_threads + extraQueueLoad()) && active_threads < threads_count_)
+    {
+        ++active_threads_;
+        threads_unparked_.notify_all();
+    }
+    else if (utilisation < ShrinkUtilisation && !queued_blocks && active_threads > 1)
+    {
+        // The thread with the highest index parks itself once it's done with its current block.
+        --active_threads_;
+    }
+}
+
+void Pipeline::notifyAllThreads()
+{
+    task_scheduled_.notify_all();
+    threads_unparked_.notify_all();
+    io_block_scheduled_.notify_all();
+    blocks_queued_.notifyAll();
+
+    if (poll_wake_fd_ >= 0)
+    {
+        std::uint64_t value = 1;
+        CHECK_EQ(ssize_t(sizeof(value)), write(poll_wake_fd_, &value, sizeof(value)));
+    }
+
+    {
+        // The bursts thread checks the state with the bursts mutex held.
+        std::unique_lock<std::mutex> lock(bursts_mutex_);
+    }
+    bursts_changed_.notify_all();
+}
+
+bool Pipeline::runExecutorBlock(std::size_t thread_index)
+{
+    // Executor threads look through all the pipelines, most of which are usually idle.
+    if (!queued_blocks_.load())
+    {
+        return false;
+    }
+
+    Block* block;
+    {
+        std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+        if (state_ != State::Running || queue_.empty())
+        {
+            return false;
+        }
+
+        block = popSharedQueue();
+    }
+
+    current_pipeline = this;
+    current_thread_index = thread_index;
+
+    bool processed = processBlock(*block, thread_index);
+    // Executor threads run one block at a time, so that they get back to the other pipelines:
+    // the handed off consumer goes to the queue of this one instead. It's active already,
+    // so it's safe to finish the current block after that.
+    takeHandedOffBlock(false);
+
+    if (processed)
+    {
+        finishActiveBlock();
+    }
+
+    current_pipeline = nullptr;
+
+    return true;
+}
+
+bool Pipeline::countsActiveBlocks() const
+{
+    return scheduling_mode_ == SchedulingMode::WorkStealing || executor_ || io_threads_count_ || polled_blocks_count_;
+}
+
+Block* Pipeline::findBlock(std::size_t thread_index)
+{
+    Block* block = workers_queues_[thread_index]->pop();
+
+    // Try to steal the block from other threads, starting from the next one
+    // so that different threads prefer different victims.
+    for (std::size_t i = 1; !block && i < threads_count_; ++i)
+    {
+        block = workers_queues_[(thread_index + i) % threads_count_]->steal();
+        if (block)
+        {
+            block->markStolen();
+        }
+    }
+
+    return block;
+}
+
+bool Pipeline::hasQueuedBlocks()
+{
+    for (auto& worker_queue: workers_queues_)
+    {
+        if (!worker_queue->empty())
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Pipeline::wakeUpThread()
+{
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+    if (pending_wake_ups_ < threads_sleeping_)
+    {
+        ++pending_wake_ups_;
+        task_scheduled_.notify_one();
+    }
+}
+
+void Pipeline::finishActiveBlock()
+{
+    if (active_blocks_.fetch_sub(1) != 1)
+    {
+        return;
+    }
+
+    // Nothing is scheduled or running anymore.
+    if (!relaxed_mode_.exchange(true))
+    {
+        // First time we're here - reschedule blocks in relaxed
+        // size mode to process the rest of the data.
+        ++active_blocks_;
+        scheduleAllBlocks();
+        finishActiveBlock();
+    }
+    else
+    {
+        // By now all blocks that can be possibly scheduled under relaxed
+        // scheme should have been scheduled and executed, check this is
+        // the case indeed.
+        CHECK(!scheduleAllBlocks());
+
+        std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+
+        // Switch into the 'stopped' mode and let everybody know about it.
+        state_ = State::Stopped;
+        finished_ = true;
+        notifyAllThreads();
+    }
+}
+
+bool Pipeline::processBlock(Block& block, std::size_t thread_index)
+{
+    CHECK(block.state().load() == Block::State::Scheduled);
+    block.state().store(Block::State::Running);
+
+    try
+    {
+        if (block.replicasCount() > 1)
+        {
+            processReplicatedBlock(block, thread_index);
+            return true;
+        }
+
+        // Units with the static schedule fall back to running whatever they can
+        // if the period couldn't be finished, e.g. after the relaxed mode leftovers.
+        bool period_finished = periodic(block) && runPeriod(block, thread_index);
+
+        // Run the fused blocks back to back, so that each of them
+        // picks up the data the previous one has just produced.
+        for (auto chain_block: period_finished ? std::vector<Block*>() : block.fusedBlocks())
+        {
+            // The chain is scheduled as soon as any of its blocks is schedulable,
+            // but blocks stay schedulable until they run, so some block always runs.
+            if (isSchedulable(*chain_block))
+            {
+                if (chain_block != &block)
+                {
+                    // The chain was queued as a whole, don't account that for the rest of blocks.
+                    chain_block->markScheduled();
+                }
+
+                if (polled(*chain_block))
+                {
+                    // Whatever the descriptor had ready is consumed now, wait for more.
+                    chain_block->pollReady() = false;
+                    runBlock(*chain_block, thread_index);
+                    armPolledBlock(*chain_block, EPOLL_CTL_MOD);
+                }
+                else
+                {
+                    runBlock(*chain_block, thread_index);
+                }
+
+                // The burst is over once everything accumulated is processed.
+                if (burstGated(*chain_block) && !isSchedulable(*chain_block))
+                {
+                    holdBurst(*chain_block);
+                }
+            }
+        }
+    }
+    catch (core::ExceptionBase& ex)
+    {
+        std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+        if (block.replicasCount() == 1)
+        {
+            // Replicated blocks are released before their parts are processed.
+            block.state().store(Block::State::Idle);
+        }
+        if (!last_exception_)
+        {
+            last_exception_ = ex.clone();
+            state_ = State::Stopped;
+            notifyAllThreads();
+        }
+        return false;
+    }
+
+    block.state().store(Block::State::Idle);
+
+    if (scheduling_policy_ == SchedulingPolicy::CriticalPath)
+    {
+        updateCriticalPaths();
+    }
+
+    trySchedulingBlock(block);
+
+    return true;
+}
+
+void Pipeline::processReplicatedBlock(Block& block, std::size_t thread_index)
+{
+    Block::Part* part = block.claimPart(relaxed_mode_);
+
+    // Let other threads claim the next parts while this one is processed.
+    block.state().store(Block::State::Idle);
+    trySchedulingBlock(block);
+
+    if (!part)
+    {
+        return;
+    }
+
+    auto begin_time = std::chrono::steady_clock::now();
+    block.processPart(*part);
+    if (tracer_)
+    {
+        tracer_->record(thread_index, block, begin_time, std::chrono::steady_clock::now(), part->size, part->size);
+    }
+
+    block.finishPart(*part);
+    trySchedulingBlock(block);
+}
+
+void Pipeline::runBlock(Block& block, std::size_t thread_index)
+{
+    if (tracer_)
+    {
+        auto begin_time = std::chrono::steady_clock::now();
+        block.process();
+        tracer_->record(
+            thread_index,
+            block,
+            begin_time,
+            std::chrono::steady_clock::now(),
+            block.lastConsumedSize(),
+            block.lastProducedSize()
+        );
+    }
+    else
+    {
+        block.process();
+    }
+}
+
+bool Pipeline::periodic(const Block& head) const
+{
+    // Relaxed mode processes whatever is left at the end, which is less than the period.
+    return head.periodic() && !relaxed_mode_;
+}
+
+bool Pipeline::periodAvailable(Block& head)
+{
+    for (auto block: head.fusedBlocks())
+    {
+        // Buffers inside the unit are back to the same state after every period.
+        for (std::size_t i = 0; i < block->inputChannelsCount(); ++i)
+        {
+            const CircularBufferReader& reader = block->reader(i);
+            if (&reader.writer().block().head() != &head && reader.availableSize() < block->inputState(i).historySize() + block->periodInputSize(i))
+            {
+                return false;
+            }
+        }
+
+        for (std::size_t i = 0; i < block->outputChannelsCount(); ++i)
+        {
+            if (block->outputState(i).eof() || block->writer(i).availableSize() < block->periodOutputSize(i))
+            {
+                return false;
+            }
+        }
+
+        if (burstPending(*block))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Pipeline::periodFits(Block& head)
+{
+    for (auto block: head.fusedBlocks())
+    {
+        for (std::size_t i = 0; i < block->inputChannelsCount(); ++i)
+        {
+            const CircularBufferReader& reader = block->reader(i);
+            if (!reader.mirrored() || reader.bufferSize() < block->inputState(i).historySize() + block->periodInputSize(i))
+            {
+                return false;
+            }
+        }
+
+        for (std::size_t i = 0; i < block->outputChannelsCount(); ++i)
+        {
+            // The slowest reader keeps its history in the buffer.
+            const CircularBufferWriter& writer = block->writer(i);
+            std::size_t max_history_size = 0;
+            for (auto reader: writer.readers())
+            {
+                max_history_size = std::max(max_history_size, reader->block().inputState(reader->inputChannel()).historySize());
+            }
+
+            if (!writer.inPlaceReader() && writer.bufferSize() < max_history_size + block->periodOutputSize(i))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+bool Pipeline::runPeriod(Block& head, std::size_t thread_index)
+{
+    for (auto block: head.fusedBlocks())
+    {
+        if (block != &head)
+        {
+            // The unit was queued as a whole, don't account that for the rest of blocks.
+            block->markScheduled();
+        }
+
+        auto begin_time = std::chrono::steady_clock::now();
+        bool finished = block->processPeriod();
+        if (tracer_)
+        {
+            tracer_->record(thread_index, *block, begin_time, std::chrono::steady_clock::now(), block->lastConsumedSize(), block->lastProducedSize());
+        }
+
+        if (!finished)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Pipeline::isSchedulable(Block& block)
+{
+    if (polled(block) && !block.pollReady().load())
+    {
+        return false;
+    }
+
+    if (block.replicasCount() > 1)
+    {
+        return block.replicasSchedulable(relaxed_mode_);
+    }
+
+    bool schedulable = true;
+
+    for (std::size_t i = 0; schedulable && i < block.inputChannelsCount(); ++i)
+    {
+        const InputState& state = block.inputState(i);
+        std::size_t available_size = block.reader(i).availableSize();
+        std::size_t suggested_size = block.suggestedInputSize(i);
+        bool relaxed_size = relaxed_mode_ || block.reader(i).wrapping(suggested_size);
+        schedulable = available_size >= state.historySize() + (relaxed_size ? state.requiredSize() : suggested_size);
+    }
+
+    for (std::size_t i = 0; schedulable && i < block.outputChannelsCount(); ++i)
+    {
+        const OutputState& state = block.outputState(i);
+        std::size_t available_size = block.writer(i).availableSize();
+        std::size_t suggested_size = block.suggestedOutputSize(i);
+        bool relaxed_size = relaxed_mode_ || block.writer(i).wrapping(suggested_size);
+        schedulable = !state.eof() && available_size >= (relaxed_size ? state.requiredSize() : suggested_size);
+    }
+
+    return schedulable && !burstPending(block);
+}
+
+bool Pipeline::ioBound(const Block& block) const
+{
+    return io_threads_ && block.filter().ioBound();
+}
+
+bool Pipeline::polled(const Block& block) const
+{
+    return block.filter().pollDescriptor() >= 0;
+}
+
+bool Pipeline::inPlace(Block& block, std::size_t output_channel) const
+{
+    // Readers past the output end would see the input instead of the padding.
+    const OutputState& state = block.outputState(output_channel);
+    if (!state.inPlace() || state.padding())
+    {
+        return false;
+    }
+
+    // Nobody else may see the input being overwritten, including its history.
+    const InputState& input_state = block.inputState(state.inPlaceInput());
+    const CircularBufferWriter& input_writer = block.reader(state.inPlaceInput()).writer();
+    if (input_state.historySize() || input_state.delay() || input_writer.readers().size() != 1)
+    {
+        return false;
+    }
+
+    // Replicas process the parts of the buffers out of order.
+    bool replicated = block.replicasCount() > 1 || input_writer.block().replicasCount() > 1;
+    for (auto reader: block.writer(output_channel).readers())
+    {
+        replicated = replicated || reader->block().replicasCount() > 1;
+    }
+
+    return !replicated;
+}
+
+void Pipeline::armPolledBlock(Block& block, int operation)
+{
+    for (std::size_t i = 0; i < block.outputChannelsCount(); ++i)
+    {
+        if (block.outputState(i).eof())
+        {
+            return;
+        }
+    }
+
+    if (block.pollArmed().exchange(true))
+    {
+        return;
+    }
+
+    ++active_blocks_;
+
+    // One-shot, so that the descriptor is not reported again until the block runs.
+    epoll_event event = {};
+    event.events = block.filter().pollEvents() | EPOLLONESHOT;
+    event.data.ptr = &block;
+    if (epoll_ctl(poll_fd_, operation, block.filter().pollDescriptor(), &event) < 0)
+    {
+        block.pollArmed() = false;
+        --active_blocks_;
+        THROW(core::IoError()) << fmt::format("Cannot poll the descriptor of {0}", typeid(block.filter()).name());
+    }
+}
+
+void Pipeline::closePollDescriptors()
+{
+    if (poll_fd_ >= 0)
+    {
+        close(poll_fd_);
+        poll_fd_ = -1;
+    }
+
+    if (poll_wake_fd_ >= 0)
+    {
+        close(poll_wake_fd_);
+        poll_wake_fd_ = -1;
+    }
+}
+
+bool Pipeline::burstGated(const Block& block) const
+{
+    return latency_budget_.count() && block.burstGated() && block.replicasCount() == 1;
+}
+
+bool Pipeline::burstPending(const Block& block) const
+{
+    if (!burstGated(block) || relaxed_mode_ || !block.burstHeld())
+    {
+        return false;
+    }
+
+    // Holding the input back must not stall the sources: once any of them
+    // cannot write more, the burst starts right away.
+    for (std::size_t i = 0; i < block.inputChannelsCount(); ++i)
+    {
+        const CircularBufferWriter& writer = block.reader(i).writer();
+        const OutputState& state = writer.block().outputState(writer.outputChannel());
+        std::size_t suggested_size = writer.block().suggestedOutputSize(writer.outputChannel());
+        if (state.eof() || writer.availableSize() < (writer.wrapping(suggested_size) ? state.requiredSize() : suggested_size))
+        {
+            return false;
+        }
+    }
 
-                    // Switch into the 'stopped' mode.
-                    state_ = State::Stopped;
-                    finished_ = true;
+    return true;
+}
 
-                    // Let everybody know we're stalled and exit the loop.
-                    threads_waiting_ = 0;
-                    task_scheduled_.notify_all();
-                    break;
-                }
-            }
+void Pipeline::holdBurst(Block& block)
+{
+    {
+        std::unique_lock<std::mutex> lock(bursts_mutex_);
+        block.setNextBurstTime(std::chrono::steady_clock::now() + latency_budget_ / BurstsPerLatencyBudget);
+        block.setBurstHeld(true);
+    }
 
-            if (queue_.empty())
-            {
-                ++threads_waiting_;
-                task_scheduled_.wait(
-                    lock,
-                    [=]
-                    {
-                        bool ready = state_ == State::Stopped;
-                        if (threads_waking_up_)
-                        {
-                            ready = ready || !queue_.empty();
-                            if (!ready)
-                            {
-                                ++threads_waiting_;
-                            }
+    bursts_changed_.notify_one();
+}
 
-                            --threads_waking_up_;
-                        }
+void Pipeline::runBurstsThread()
+{
+    std::vector<Block*> released_blocks;
+    std::unique_lock<std::mutex> lock(bursts_mutex_);
 
-                        return ready;
-                    }
-                );
-            }
-            else if (threads_waiting_ && queue_.size() > threads_count_ - threads_waiting_ + min_extra_queue_load_)
+    while (state_ != State::Stopped)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto next_burst_time = std::chrono::steady_clock::time_point::max();
+        for (auto block: burst_blocks_)
+        {
+            if (!block->burstHeld())
             {
-                --threads_waiting_;
-                ++threads_waking_up_;
-                task_scheduled_.notify_one();
+                continue;
             }
 
-            if (state_ == State::Stopped)
+            if (block->nextBurstTime() <= now)
             {
-                // Exit the loop.
-                break;
+                block->setBurstHeld(false);
+                released_blocks.push_back(block);
             }
-            else if (state_ == State::Paused)
+            else
             {
-                task_scheduled_.wait(
-                    lock,
-                    [=]
-                    {
-                        return state_ != State::Paused;
-                    }
-                );
-                ++threads_running_;
-                continue;
+                next_burst_time = std::min(next_burst_time, block->nextBurstTime());
             }
-
-            block = queue_.front();
-            queue_.pop_front();
-
-            ++threads_running_;
         }
 
-        CHECK(block->state().load() == Block::State::Scheduled);
-        block->state().store(Block::State::Running);
-
-        try
-        {
-            block->process();
-        }
-        catch (core::ExceptionBase& ex)
+        if (!released_blocks.empty())
         {
-            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
-            block->state().store(Block::State::Idle);
-            if (!last_exception_)
+            // Scheduling takes the tasks queue mutex, which is held while this thread is notified.
+            lock.unlock();
+            for (auto block: released_blocks)
             {
-                last_exception_ = ex.clone();
-                state_ = State::Stopped;
-                threads_waiting_ = 0;
-                task_scheduled_.notify_all();
+                trySchedulingBlock(*block);
             }
-            break;
+            released_blocks.clear();
+            lock.lock();
+        }
+        else if (next_burst_time == std::chrono::steady_clock::time_point::max())
+        {
+            bursts_changed_.wait(lock);
+        }
+        else
+        {
+            bursts_changed_.wait_until(lock, next_burst_time);
         }
-
-        block->state().store(Block::State::Idle);
-
-        trySchedulingBlock(*block);
     }
 }
 
-bool Pipeline::trySchedulingBlock(Block& block)
+bool Pipeline::trySchedulingBlock(Block& block, bool consumer)
 {
+    // Fused chains are scheduled as a whole via their heads.
+    Block& head = block.head();
+
     Block::State expected_state = Block::State::Idle;
-    while (!block.state().compare_exchange_weak(expected_state, Block::State::Scheduling))
+    while (!head.state().compare_exchange_weak(expected_state, Block::State::Scheduling))
     {
         if (expected_state == Block::State::Running || expected_state == Block::State::Scheduled)
         {
@@ -414,44 +2146,424 @@ bool Pipeline::trySchedulingBlock(Block& block)
     }
 
     // We've got access - see if we want to schedule this block.
-    bool schedulable = true;
+    bool schedulable = false;
+    if (periodic(head))
+    {
+        schedulable = periodAvailable(head);
+    }
+    else
+    {
+        for (auto chain_block: head.fusedBlocks())
+        {
+            schedulable = schedulable || isSchedulable(*chain_block);
+        }
+    }
 
-    for (std::size_t i = 0; schedulable && i < block.inputChannelsCount(); ++i)
+    if (schedulable)
     {
-        const InputState& state = block.inputState(i);
-        std::size_t available_size = block.reader(i).availableSize();
-        bool relaxed_size = relaxed_mode_ || block.reader(i).wrapping();
-        schedulable = available_size >= state.historySize() + (relaxed_size ? state.requiredSize() : state.suggestedSize());
+        if (!consumer || !handOffBlock(head))
+        {
+            enqueueBlock(head);
+        }
+    }
+    else
+    {
+        head.state().store(Block::State::Idle);
     }
 
-    for (std::size_t i = 0; schedulable && i < block.outputChannelsCount(); ++i)
+    return schedulable;
+}
+
+void Pipeline::enqueueBlock(Block& block)
+{
+    if (ioBound(block))
     {
-        const OutputState& state = block.outputState(i);
-        std::size_t available_size = block.writer(i).availableSize();
-        bool relaxed_size = relaxed_mode_ || block.writer(i).wrapping();
-        schedulable = !state.eof() && available_size >= (relaxed_size ? state.requiredSize() : state.suggestedSize());
+        ++active_blocks_;
+
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            block.markScheduled();
+            io_queue_.push_back(&block);
+            block.state().store(Block::State::Scheduled);
+        }
+
+        io_block_scheduled_.notify_one();
     }
+    else if (scheduling_mode_ == SchedulingMode::WorkStealing)
+    {
+        ++active_blocks_;
+        // Must be done before the block is queued, as other threads
+        // might steal it right away.
+        block.markScheduled();
+        block.state().store(Block::State::Scheduled);
 
-    if (schedulable)
+        // In throughput mode, the current worker runs the block itself next
+        // if it has nothing else queued, without waking anyone up.
+        bool wake_up = true;
+
+        if (current_pipeline == this && local_blocks)
+        {
+            // Pushed in the policy order, waking the threads up, once the running block is done.
+            local_blocks->push_back(&block);
+            return;
+        }
+        else if (current_pipeline == this)
+        {
+            WorkStealingQueue& worker_queue = *workers_queues_[current_thread_index];
+            wake_up = scheduling_policy_ != SchedulingPolicy::Throughput || !worker_queue.empty();
+            worker_queue.push(&block);
+        }
+        else
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            pushSharedQueue(block);
+        }
+
+        // Pairs with the fence in runWorkStealingThread.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (wake_up && threads_sleeping_.load())
+        {
+            wakeUpThread();
+        }
+    }
+    else
+    {
+        if (countsActiveBlocks())
+        {
+            ++active_blocks_;
+        }
+
+        bool wake_up;
+        {
+            std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+            block.markScheduled();
+            pushSharedQueue(block);
+            block.state().store(Block::State::Scheduled);
+
+            // Threads of the pipeline get the others going as they take the blocks from the queue,
+            // but the blocks queued by other threads need an idle thread woken up right away.
+            wake_up = current_pipeline != this && !threads_spinning_.load();
+        }
+
+        if (wake_up)
+        {
+            blocks_queued_.notifyOne();
+        }
+
+        if (executor_)
+        {
+            executor_->notify();
+        }
+    }
+}
+
+bool Pipeline::handOffBlock(Block& block)
+{
+    // Only the first consumer made ready by the running block is handed off,
+    // the rest are queued as usual for other threads to pick up.
+    if (!consumer_hand_off_ || current_pipeline != this || handed_off_block || ioBound(block))
+    {
+        return false;
+    }
+
+    if (countsActiveBlocks())
+    {
+        ++active_blocks_;
+    }
+
+    block.markScheduled();
+    block.state().store(Block::State::Scheduled);
+    handed_off_block = &block;
+
+    return true;
+}
+
+Block* Pipeline::takeHandedOffBlock(bool run)
+{
+    Block* block = handed_off_block;
+    handed_off_block = nullptr;
+
+    if (!block || (run && state_ == State::Running))
+    {
+        return block;
+    }
+
+    // The pipeline is paused, stopped or failed, or the thread serves other pipelines
+    // too: queue the block back, so that it's not lost for the rest of the pipeline.
+    if (scheduling_mode_ == SchedulingMode::WorkStealing)
+    {
+        workers_queues_[current_thread_index]->push(block);
+    }
+    else
     {
         std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+        pushSharedQueue(*block);
+    }
+
+    if (executor_)
+    {
+        executor_->notify();
+    }
+
+    return nullptr;
+}
+
+bool Pipeline::ordersLocalBlocks() const
+{
+    return
+        scheduling_mode_ == SchedulingMode::WorkStealing &&
+        (scheduling_policy_ == SchedulingPolicy::Latency || scheduling_policy_ == SchedulingPolicy::CriticalPath);
+}
+
+void Pipeline::pushLocalBlocks(std::vector<Block*>& blocks, std::size_t thread_index)
+{
+    if (blocks.empty())
+    {
+        return;
+    }
+
+    if (scheduling_policy_ == SchedulingPolicy::CriticalPath)
+    {
+        // Paths might change while the blocks are sorted, so sort by their copies.
+        thread_local std::vector<std::pair<Block*, std::chrono::nanoseconds>> blocks_paths;
+        blocks_paths.clear();
+        for (auto block: blocks)
+        {
+            blocks_paths.emplace_back(block, block->criticalPath());
+        }
+
+        std::stable_sort(
+            blocks_paths.begin(),
+            blocks_paths.end(),
+            [](const std::pair<Block*, std::chrono::nanoseconds>& lhs, const std::pair<Block*, std::chrono::nanoseconds>& rhs)
+            {
+                return
+                    lhs.second > rhs.second ||
+                    (lhs.second == rhs.second && lhs.first->sinkDistance() < rhs.first->sinkDistance());
+            }
+        );
+
+        for (std::size_t i = 0; i < blocks.size(); ++i)
+        {
+            blocks[i] = blocks_paths[i].first;
+        }
+    }
+    else
+    {
+        // Blocks closer to the sinks run first, in the order they were queued for equal distances.
+        std::stable_sort(
+            blocks.begin(),
+            blocks.end(),
+            [](const Block* lhs, const Block* rhs)
+            {
+                return lhs->sinkDistance() < rhs->sinkDistance();
+            }
+        );
+    }
+
+    // The worker pops its blocks from the bottom, so the first one to run goes last.
+    WorkStealingQueue& worker_queue = *workers_queues_[thread_index];
+    for (auto it = blocks.rbegin(); it != blocks.rend(); ++it)
+    {
+        worker_queue.push(*it);
+    }
+
+    // Pairs with the fence in runWorkStealingThread.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (std::size_t i = 0; i < blocks.size() && threads_sleeping_.load(); ++i)
+    {
+        wakeUpThread();
+    }
+
+    blocks.clear();
+}
+
+void Pipeline::pushSharedQueue(Block& block)
+{
+    if (scheduling_policy_ == SchedulingPolicy::Latency)
+    {
+        // Keep the queue ordered by the distance to the sinks, FIFO for equal distances.
+        auto it =
+            std::upper_bound(
+                queue_.begin(),
+                queue_.end(),
+                &block,
+                [](const Block* lhs, const Block* rhs)
+                {
+                    return lhs->sinkDistance() < rhs->sinkDistance();
+                }
+            );
+        queue_.insert(it, &block);
+    }
+    else if (scheduling_policy_ == SchedulingPolicy::CriticalPath)
+    {
+        queue_.insert(std::upper_bound(queue_.begin(), queue_.end(), &block, criticalPathLess), &block);
+    }
+    else
+    {
         queue_.push_back(&block);
-        block.state().store(Block::State::Scheduled);
+    }
+
+    queued_blocks_ = queue_.size();
+}
+
+Block* Pipeline::popSharedQueue()
+{
+    Block* block = queue_.front();
+    queue_.pop_front();
+    queued_blocks_ = queue_.size();
+
+    return block;
+}
+
+bool Pipeline::criticalPathsOutdated() const
+{
+    std::int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    return now >= critical_paths_update_time_.load(std::memory_order_relaxed);
+}
+
+void Pipeline::updateCriticalPaths()
+{
+    if (!criticalPathsOutdated())
+    {
+        return;
+    }
+
+    // Whoever holds the lock is updating the paths already, no need to wait for it.
+    std::unique_lock<std::mutex> paths_lock(critical_paths_mutex_, std::try_to_lock);
+    if (!paths_lock.owns_lock() || !criticalPathsOutdated())
+    {
+        return;
+    }
+
+    critical_paths_update_time_.store(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            (std::chrono::steady_clock::now() + CriticalPathsUpdatePeriod).time_since_epoch()
+        ).count(),
+        std::memory_order_relaxed
+    );
+
+    std::uint64_t source_samples = 0;
+    for (auto& node: critical_path_nodes_)
+    {
+        if (!node.block->inputChannelsCount() && node.block->outputChannelsCount())
+        {
+            source_samples += node.block->producedSamples(0);
+        }
+    }
+
+    // Nothing came in since the last update, so the costs measured then still stand.
+    if (source_samples == critical_paths_source_samples_)
+    {
+        return;
+    }
+
+    // Stats were reset, measure from the scratch over the next period.
+    if (source_samples < critical_paths_source_samples_)
+    {
+        critical_paths_source_samples_ = source_samples;
+        for (auto& node: critical_path_nodes_)
+        {
+            node.wall_time = node.block->wallTime();
+        }
+
+        return;
+    }
+
+    double period_samples = double(source_samples - critical_paths_source_samples_) / CriticalPathSamples;
+    critical_paths_source_samples_ = source_samples;
+
+    for (auto& node: critical_path_nodes_)
+    {
+        // Wall times are taken once, as the blocks keep running meanwhile.
+        std::chrono::nanoseconds wall_time = node.block->wallTime();
+        node.cost = double(std::max<std::int64_t>((wall_time - node.wall_time).count(), 0)) / period_samples * (node.deadline ? DeadlineBranchWeight : 1.0);
+        node.wall_time = wall_time;
+        node.head = 0;
+        node.tail = node.cost;
+        for (auto consumer: node.consumers)
+        {
+            node.tail = std::max(node.tail, node.cost + critical_path_nodes_[consumer].tail);
+        }
+    }
+
+    for (auto it = critical_path_nodes_.rbegin(); it != critical_path_nodes_.rend(); ++it)
+    {
+        for (auto consumer: it->consumers)
+        {
+            CriticalPathNode& consumer_node = critical_path_nodes_[consumer];
+            consumer_node.head = std::max(consumer_node.head, it->head + it->cost);
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(tasks_queue_mutex_);
+    for (auto& node: critical_path_nodes_)
+    {
+        node.block->setCriticalPath(std::chrono::nanoseconds(std::int64_t(node.head + node.tail)));
+    }
+
+    // Paths are changed only here, so the queue stays ordered in between.
+    std::stable_sort(queue_.begin(), queue_.end(), criticalPathLess);
+}
+
+void Pipeline::waitForQueuedBlocks(std::size_t& spin_iterations)
+{
+    auto ready =
+        [this]
+        {
+            return queued_blocks_.load() || state_ != State::Running;
+        };
+
+    ++threads_spinning_;
+    for (std::size_t i = 0; i < spin_iterations; ++i)
+    {
+        if (ready())
+        {
+            --threads_spinning_;
+            spin_iterations = std::min(2 * spin_iterations, MaxSpinIterations);
+            return;
+        }
+
+        _mm_pause();
+    }
+
+    spin_iterations = std::max(spin_iterations / 2, MinSpinIterations);
+
+    // The blocks queued after this point either see this thread as not spinning
+    // anymore and wake it up or are seen by the check below.
+    EventCount::Key key = blocks_queued_.prepareWait();
+    --threads_spinning_;
+
+    if (ready())
+    {
+        blocks_queued_.cancelWait();
     }
     else
     {
-        block.state().store(Block::State::Idle);
+        blocks_queued_.wait(key);
     }
+}
 
-    return schedulable;
+std::size_t Pipeline::extraQueueLoad() const
+{
+    switch (scheduling_policy_)
+    {
+        case SchedulingPolicy::Balanced:
+        case SchedulingPolicy::Latency:
+        case SchedulingPolicy::CriticalPath:
+            return 0;
+
+        case SchedulingPolicy::Throughput:
+            return BatchExtraQueueLoad;
+    }
 }
 
-void Pipeline::inputAvailableSizeChanged(Block& block, std::size_t /* input_channel */)
+void Pipeline::inputAvailableSizeChanged(Block& block)
 {
-    trySchedulingBlock(block);
+    trySchedulingBlock(block, true);
 }
 
-void Pipeline::outputAvailableSizeChanged(Block& block, std::size_t /* output_channel */)
+void Pipeline::outputAvailableSizeChanged(Block& block)
 {
     trySchedulingBlock(block);
 }
@@ -18,8 +18,14 @@
 #pragma once
 
 #include <hvylya/pipelines/async/block.h>
+#include <hvylya/pipelines/async/buffer_planner.h>
+#include <hvylya/pipelines/async/event_count.h>
+#include <hvylya/pipelines/async/executor.h>
+#include <hvylya/pipelines/async/tracer.h>
+#include <hvylya/pipelines/async/work_stealing_queue.h>
 
 #include <condition_variable>
+#include <deque>
 #include <thread>
 
 namespace hvylya {
@@ -29,10 +35,188 @@ namespace async {
 class Pipeline: core::NonCopyable
 {
   public:
-    Pipeline(std::size_t min_extra_queue_load = 0);
+    enum class SchedulingMode: std::int8_t
+    {
+        // All threads share the single queue of scheduled blocks.
+        SharedQueue,
+        // Each thread has its own queue of scheduled blocks and steals
+        // blocks from other threads when its own queue is empty.
+        WorkStealing
+    };
+
+    enum class SchedulingPolicy: std::int8_t
+    {
+        // Blocks are run in the order they become schedulable.
+        Balanced,
+        // Blocks closer to the sinks run first and chunks are never scaled
+        // above the suggested sizes. In the work stealing mode each thread
+        // orders only the blocks it has queued itself.
+        Latency,
+        // Blocks wait for several suggested chunks before running and idle threads
+        // are woken up only when the running ones cannot keep up with the queue.
+        Throughput,
+        // Blocks on the most expensive chains from the sources to the sinks run first, as
+        // measured by their recent wall times per source sample, with the chains feeding
+        // the I/O bound sinks weighted up, and the blocks closer to the sinks run first
+        // on the same chain. Chunks are never scaled above the suggested sizes.
+        // In the work stealing mode each thread orders only the blocks it has
+        // queued itself, as with the latency policy.
+        CriticalPath
+    };
+
+    Pipeline();
 
     void add(filters::IFilter& top_filter);
 
+    SchedulingMode schedulingMode() const;
+
+    // Can be changed only while the pipeline is stopped.
+    void setSchedulingMode(SchedulingMode scheduling_mode);
+
+    SchedulingPolicy schedulingPolicy() const;
+
+    // Can be changed only while the pipeline is stopped, takes effect on the next start.
+    void setSchedulingPolicy(SchedulingPolicy scheduling_policy);
+
+    // Can be called at any time, including while the pipeline is running.
+    std::vector<BlockStats> stats() const;
+
+    // Maximal number of block executions recorded by each thread, 0 disables tracing.
+    // Can be changed only while the pipeline is stopped, takes effect on the next start.
+    void setTraceCapacity(std::size_t max_events_per_thread);
+
+    // Writes block executions recorded since the last start in Chrome trace format,
+    // which can be loaded into chrome://tracing or https://ui.perfetto.dev.
+    void writeTrace(std::ostream& os) const;
+
+    bool blockFusion() const;
+
+    // Enables execution of chains of single input / single output filters
+    // as single scheduling units. Can be changed only before any filters are added.
+    void setBlockFusion(bool block_fusion);
+
+    bool staticSchedules() const;
+
+    // Runs the connected filters with the fixed rates (see filters::InputState::rate())
+    // as single scheduling units in the order precomputed from their rates, with the buffers
+    // between them sized for exactly one period of the schedule. Each unit is queued only
+    // once the whole period is available on its outer channels and then runs each filter
+    // on its share of the period, without checking anything in between. The rest of the data
+    // at the end of the stream, as well as the units that have any copying buffers or buffers
+    // too small for the period, are scheduled dynamically, like the remaining filters.
+    // Can be changed only before any filters are added.
+    void setStaticSchedules(bool static_schedules);
+
+    std::size_t blockReplicas() const;
+
+    // Lets the replicable filters (see IFilter::replicate()) process up to the specified number
+    // of parts of their input concurrently. Can be changed only before any filters are added.
+    void setBlockReplicas(std::size_t block_replicas);
+
+    bool consumerHandOff() const;
+
+    // Lets the thread that has just produced the data run the first consumer it made
+    // schedulable right away, while the data is still in its cache, instead of queueing it.
+    // Can be changed only while the pipeline is stopped.
+    void setConsumerHandOff(bool consumer_hand_off);
+
+    bool ioThreads() const;
+
+    // Runs the I/O bound blocks (see IFilter::ioBound()) on the threads of their own, one per
+    // block, so that the threads processing the data are not held up while they wait for the
+    // devices. I/O bound blocks are not fused with the others then.
+    // Can be changed only before any filters are added.
+    void setIoThreads(bool io_threads);
+
+    ChunkSizeTuning chunkSizeTuning() const;
+
+    // Adjusts the chunk sizes the blocks are scheduled with at runtime, starting
+    // from the suggested sizes of the filters. Can be changed only while the
+    // pipeline is stopped, takes effect on the next start.
+    void setChunkSizeTuning(ChunkSizeTuning chunk_size_tuning);
+
+    BufferBackend bufferBackend() const;
+
+    // Can be changed only before any filters are added.
+    void setBufferBackend(BufferBackend buffer_backend);
+
+    std::size_t bufferMemoryBudget() const;
+
+    // Limits the total size of the buffers in bytes, 0 means unlimited. Buffers
+    // are never made smaller than the filters need to make progress, though.
+    // Can be changed only before any filters are added.
+    void setBufferMemoryBudget(std::size_t buffer_memory_budget);
+
+    bool inPlaceBuffers() const;
+
+    // Writes the outputs the filters can process in place (see filters::OutputState::inPlace())
+    // over their inputs, sharing the buffer instead of getting one of their own, as long as
+    // nobody else reads these inputs. Applies to the mirrored buffers only.
+    // Can be changed only before any filters are added.
+    void setInPlaceBuffers(bool in_place_buffers);
+
+    bool cacheAwareBuffers() const;
+
+    // Keeps the buffers small enough to stay in L2 cache, unless the filters need larger
+    // chunks to run efficiently. Can be changed only before any filters are added.
+    void setCacheAwareBuffers(bool cache_aware_buffers);
+
+    // Sizes of the buffers allocated for all added filters, except
+    // for the outputs written in place.
+    const std::vector<BufferLayout>& bufferLayout() const;
+
+    std::size_t maxThreads() const;
+
+    // Limits the number of threads the pipeline runs blocks on, 0 means the number
+    // of hardware threads. Can be changed only while the pipeline is stopped.
+    void setMaxThreads(std::size_t max_threads);
+
+    bool elasticThreads() const;
+
+    // Keeps only as many threads active as the measured load needs: the rest are parked
+    // and not woken up for the scheduled blocks until the active ones become busy enough
+    // or the queue grows. Doesn't apply to the executor threads.
+    // Can be changed only while the pipeline is stopped.
+    void setElasticThreads(bool elastic_threads);
+
+    // Number of threads currently allowed to run blocks, can be called at any time.
+    std::size_t activeThreads() const;
+
+    const std::vector<std::size_t>& cpuAffinity() const;
+
+    // Restricts the threads of the pipeline to the given CPUs and limits their number
+    // to the number of CPUs, empty set lifts the restriction. Doesn't apply to the
+    // executor threads. Can be changed only while the pipeline is stopped.
+    void setCpuAffinity(const std::vector<std::size_t>& cpus);
+
+    int numaNode() const;
+
+    // Keeps the pipeline on the given NUMA node: its threads are restricted to the CPUs
+    // of the node (within the CPU affinity, if any) and its buffers are allocated there,
+    // -1 disables the placement. To spread the work across the nodes, run connected
+    // subgraphs as separate pipelines placed on different nodes.
+    // Can be changed only before any filters are added.
+    void setNumaNode(int numa_node);
+
+    std::chrono::milliseconds latencyBudget() const;
+
+    // Runs the pipeline in bursts for the cores to stay idle longer in between: the blocks
+    // consuming the output of the sources hold it back for up to half of the budget and
+    // then process everything accumulated at once, unless the sources run out of buffer
+    // space earlier. The budget must fit into the delay the sinks can tolerate, e.g. the
+    // AlsaSink delay. Replicated blocks are not held back. 0 disables the bursts.
+    // Can be changed only while the pipeline is stopped.
+    void setLatencyBudget(std::chrono::milliseconds latency_budget);
+
+    Executor* executor() const;
+
+    // Runs the blocks on the threads of the given executor, shared with other pipelines,
+    // instead of starting the threads of its own; nullptr goes back to the own threads.
+    // Only the shared queue scheduling mode is supported then, and the max threads
+    // as well as the throughput policy wake up limits don't apply.
+    // Can be changed only while the pipeline is stopped.
+    void setExecutor(Executor* executor);
+
     void start();
 
     void pause();
@@ -47,11 +231,15 @@ class Pipeline: core::NonCopyable
 
     void run();
 
-    void inputAvailableSizeChanged(Block& block, std::size_t input_channel);
+    // Called once per step of the block that has advanced the buffers, no matter how many
+    // channels connecting it to the given block it has advanced.
+    void inputAvailableSizeChanged(Block& block);
 
-    void outputAvailableSizeChanged(Block& block, std::size_t output_channel);
+    void outputAvailableSizeChanged(Block& block);
 
   private:
+    friend class Executor;
+
     enum class State: std::int8_t
     {
         Stopped,
@@ -59,21 +247,203 @@ class Pipeline: core::NonCopyable
         Running
     };
 
+    struct CriticalPathNode
+    {
+        Block* block;
+        // Indices of the consumers of the block, which come before it.
+        std::vector<std::size_t> consumers;
+        // Whether the block feeds a sink that must keep up with the real time, like the audio output.
+        bool deadline;
+        // Wall time of the block by the last update.
+        std::chrono::nanoseconds wall_time;
+        // Wall time of the block per 1000 source samples over the last update period, and the longest
+        // paths from the sources up to the block and from the block down to the sinks.
+        double cost, head, tail;
+    };
+
     std::vector<std::thread> threads_;
-    std::deque<Block*> queue_;
-    std::vector<Block> blocks_;
-    std::condition_variable task_scheduled_;
+    std::deque<Block*> queue_, io_queue_;
+    // Blocks must stay in place as the later added filters are appended, as they refer to each other.
+    std::deque<Block> blocks_;
+    std::vector<std::unique_ptr<WorkStealingQueue>> workers_queues_;
+    std::condition_variable task_scheduled_, threads_unparked_, io_block_scheduled_;
     std::mutex tasks_queue_mutex_;
-    std::size_t min_extra_queue_load_, threads_count_, threads_running_, threads_waiting_, threads_waking_up_;
+    std::size_t threads_count_, threads_running_, pending_wake_ups_, threads_parked_, io_threads_count_, polled_blocks_count_;
+    // Idle shared queue threads sleep on it until more blocks are queued.
+    EventCount blocks_queued_;
+    // Size of the shared queue, so that the idle threads can spin on it without the lock.
+    std::atomic<std::size_t> queued_blocks_;
+    // Idle shared queue threads that are spinning for the queued blocks rather than sleeping.
+    std::atomic<std::size_t> threads_spinning_;
+    // epoll instance the poll descriptors of the blocks are waited on and the eventfd
+    // waking up the poll thread, -1 if there are no such blocks.
+    int poll_fd_, poll_wake_fd_;
+    // Keeps the poll thread from changing the active blocks while they are recounted.
+    std::mutex poll_mutex_;
+    // Only used in work stealing mode, with executor, I/O threads or polled blocks: the number
+    // of blocks that are either scheduled, running or waiting for their poll descriptors,
+    // plus the number of ongoing scheduling passes.
+    std::atomic<std::size_t> active_blocks_;
+    std::atomic<std::size_t> threads_sleeping_;
     std::unique_ptr<core::ExceptionBase> last_exception_;
-    bool scheduling_, relaxed_mode_, finished_, stalled_;
-    State state_;
+    std::atomic<bool> relaxed_mode_;
+    bool scheduling_, finished_, stalled_;
+    std::atomic<State> state_;
+    SchedulingMode scheduling_mode_;
+    SchedulingPolicy scheduling_policy_;
+    BufferBackend buffer_backend_;
+    std::size_t trace_capacity_;
+    std::unique_ptr<Tracer> tracer_;
+    bool block_fusion_;
+    bool static_schedules_;
+    std::size_t block_replicas_;
+    bool consumer_hand_off_;
+    bool io_threads_;
+    ChunkSizeTuning chunk_size_tuning_;
+    std::size_t buffer_memory_budget_;
+    bool cache_aware_buffers_;
+    bool in_place_buffers_;
+    std::vector<BufferLayout> buffer_layout_;
+    std::size_t max_threads_;
+    Executor* executor_;
+    std::vector<std::size_t> cpu_affinity_;
+    int numa_node_;
+    // CPUs the threads are restricted to, empty if any CPU can be used.
+    std::vector<std::size_t> threads_cpus_;
+    bool elastic_threads_;
+    // Threads with indices starting from this one are parked.
+    std::atomic<std::size_t> active_threads_;
+    // Time the blocks took to run since the current load measurement window has started.
+    std::atomic<std::int64_t> busy_time_, load_window_start_;
+    std::chrono::milliseconds latency_budget_;
+    // Gated blocks, released by the bursts thread once their next bursts are due.
+    std::vector<Block*> burst_blocks_;
+    std::mutex bursts_mutex_;
+    std::condition_variable bursts_changed_;
+    // Blocks ordered so that the consumers come before their producers.
+    std::vector<CriticalPathNode> critical_path_nodes_;
+    // Samples produced by the sources by the last critical paths update.
+    std::uint64_t critical_paths_source_samples_;
+    // Steady clock time the critical paths are due for the next update at, in nanoseconds.
+    std::atomic<std::int64_t> critical_paths_update_time_;
+    // Taken by the thread updating the critical paths, so that the rest don't wait for it.
+    std::mutex critical_paths_mutex_;
+
+    bool isSchedulable(Block& block);
+
+    bool ioBound(const Block& block) const;
+
+    bool polled(const Block& block) const;
+
+    bool inPlace(Block& block, std::size_t output_channel) const;
+
+    // Waits for the poll descriptor of the block to become ready, unless the block has finished.
+    void armPolledBlock(Block& block, int operation);
+
+    void closePollDescriptors();
+
+    bool burstGated(const Block& block) const;
+
+    // Whether the gated block should keep holding its input back until the next burst.
+    bool burstPending(const Block& block) const;
 
-    bool trySchedulingBlock(Block& block);
+    // Holds the input of the gated block back until the next burst, once the current one is over.
+    void holdBurst(Block& block);
+
+    // Schedules the held gated blocks once their next bursts are due, as their sources
+    // might not make them schedulable again in time, or at all, if they are idle.
+    void runBurstsThread();
+
+    // Consumers are the blocks notified about the new input data.
+    bool trySchedulingBlock(Block& block, bool consumer = false);
 
     bool scheduleAllBlocks();
 
-    void runThread();
+    void enqueueBlock(Block& block);
+
+    // Returns false if the block cannot be handed off to the current thread.
+    bool handOffBlock(Block& block);
+
+    // Returns the block handed off to the current thread if it should run it,
+    // otherwise queues it back for the other threads.
+    Block* takeHandedOffBlock(bool run);
+
+    // Whether the blocks the worker makes schedulable while running a block are queued
+    // once it's done, in the order of the scheduling policy, see pushLocalBlocks().
+    bool ordersLocalBlocks() const;
+
+    // Pushes the blocks to the deque of the worker so that it pops them in the order of the
+    // scheduling policy. Other workers steal them in the reverse order, least urgent first.
+    void pushLocalBlocks(std::vector<Block*>& blocks, std::size_t thread_index);
+
+    // Must be called with the tasks queue mutex held.
+    void pushSharedQueue(Block& block);
+
+    // Must be called with the tasks queue mutex held.
+    Block* popSharedQueue();
+
+    // Whether the critical paths are due for the update.
+    bool criticalPathsOutdated() const;
+
+    // Must be called without the tasks queue mutex held, takes it only to reorder the queue.
+    void updateCriticalPaths();
+
+    // Spins for up to the given number of iterations and then sleeps until there are queued
+    // blocks or the pipeline is not running anymore, adapting the spin to how often it pays off.
+    void waitForQueuedBlocks(std::size_t& spin_iterations);
+
+    std::size_t extraQueueLoad() const;
+
+    bool processBlock(Block& block, std::size_t thread_index);
+
+    void processReplicatedBlock(Block& block, std::size_t thread_index);
+
+    void runBlock(Block& block, std::size_t thread_index);
+
+    // Whether the unit headed by the block runs by the periods of its static schedule.
+    bool periodic(const Block& head) const;
+
+    // Whether the channels connecting the unit to the rest of the pipeline have the whole period available.
+    bool periodAvailable(Block& head);
+
+    // Whether the buffers of the unit are mirrored and can hold the whole period.
+    bool periodFits(Block& head);
+
+    // Returns false if any filter has stopped short of its period.
+    bool runPeriod(Block& head, std::size_t thread_index);
+
+    void runThread(std::size_t thread_index);
+
+    void runSharedQueueThread(std::size_t thread_index);
+
+    void runWorkStealingThread(std::size_t thread_index);
+
+    void runIoThread(std::size_t thread_index);
+
+    void runPollThread();
+
+    // Called by the executor threads, runs at most one block and returns false if there was none to run.
+    bool runExecutorBlock(std::size_t thread_index);
+
+    bool countsActiveBlocks() const;
+
+    void updateThreadsCpus();
+
+    // Must be called with the tasks queue mutex held.
+    bool parkThread(std::unique_lock<std::mutex>& lock, std::size_t thread_index);
+
+    void updateActiveThreads(std::chrono::steady_clock::time_point begin_time);
+
+    // Must be called with the tasks queue mutex held.
+    void notifyAllThreads();
+
+    Block* findBlock(std::size_t thread_index);
+
+    bool hasQueuedBlocks();
+
+    void wakeUpThread();
+
+    void finishActiveBlock();
 
     void finalize();
 };
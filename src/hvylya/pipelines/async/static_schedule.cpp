@@ -0,0 +1,265 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/static_schedule.h>
+
+#include <hvylya/filters/io_states.h>
+
+#include <deque>
+#include <numeric>
+
+using namespace hvylya::filters;
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+// Channel connecting two fixed rate filters.
+struct Link
+{
+    IFilter* producer;
+    std::size_t output_channel;
+    IFilter* consumer;
+    std::size_t input_channel;
+};
+
+// Repetitions are found as fractions first and scaled to the whole numbers afterwards.
+struct Fraction
+{
+    std::size_t numerator, denominator;
+};
+
+bool fixedRate(const IFilter& filter)
+{
+    for (std::size_t i = 0; i < filter.inputChannelsCount(); ++i)
+    {
+        if (!filter.inputState(i).rate())
+        {
+            return false;
+        }
+    }
+
+    for (std::size_t i = 0; i < filter.outputChannelsCount(); ++i)
+    {
+        if (!filter.outputState(i).rate())
+        {
+            return false;
+        }
+    }
+
+    return filter.inputChannelsCount() || filter.outputChannelsCount();
+}
+
+Fraction makeFraction(std::size_t numerator, std::size_t denominator)
+{
+    std::size_t divisor = std::gcd(numerator, denominator);
+    return { numerator / divisor, denominator / divisor };
+}
+
+std::size_t divideUp(std::size_t value, std::size_t divisor)
+{
+    return (value + divisor - 1) / divisor;
+}
+
+} // anonymous namespace
+
+std::size_t StaticSchedule::inputSize(const IFilter& filter, std::size_t input_channel) const
+{
+    return repetitions.at(&filter) * filter.inputState(input_channel).rate();
+}
+
+std::size_t StaticSchedule::outputSize(const IFilter& filter, std::size_t output_channel) const
+{
+    return repetitions.at(&filter) * filter.outputState(output_channel).rate();
+}
+
+std::vector<StaticSchedule> hvylya::pipelines::async::findStaticSchedules(const std::unordered_set<IFilter*>& filters)
+{
+    std::unordered_set<IFilter*> fixed_rate_filters;
+    for (auto filter: filters)
+    {
+        if (fixedRate(*filter))
+        {
+            fixed_rate_filters.insert(filter);
+        }
+    }
+
+    // Links are listed for both of their ends.
+    std::unordered_map<IFilter*, std::vector<Link>> links;
+    for (auto filter: fixed_rate_filters)
+    {
+        for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+        {
+            for (auto& sink: filter->sinks(i))
+            {
+                IFilter* sink_filter = &std::get<0>(sink);
+                if (fixed_rate_filters.count(sink_filter))
+                {
+                    Link link{filter, i, sink_filter, std::get<1>(sink)};
+                    links[filter].push_back(link);
+                    links[sink_filter].push_back(link);
+                }
+            }
+        }
+    }
+
+    std::vector<StaticSchedule> schedules;
+    std::unordered_set<IFilter*> visited;
+
+    for (auto start: fixed_rate_filters)
+    {
+        if (visited.count(start) || !links.count(start))
+        {
+            continue;
+        }
+
+        // Solve the balance equations, producer repetitions * output rate = consumer repetitions * input rate
+        // for every link, by propagating the repetitions from the first filter to all the linked ones.
+        std::unordered_map<IFilter*, Fraction> fractions;
+        std::vector<IFilter*> subgraph;
+        std::deque<IFilter*> pending(1, start);
+        fractions[start] = makeFraction(1, 1);
+        visited.insert(start);
+        bool consistent = true;
+
+        while (!pending.empty())
+        {
+            IFilter* filter = pending.front();
+            pending.pop_front();
+            subgraph.push_back(filter);
+
+            for (auto& link: links[filter])
+            {
+                std::size_t output_rate = link.producer->outputState(link.output_channel).rate();
+                std::size_t input_rate = link.consumer->inputState(link.input_channel).rate();
+                const Fraction& fraction = fractions[filter];
+
+                IFilter* linked_filter;
+                Fraction linked_fraction;
+                if (link.producer == filter)
+                {
+                    linked_filter = link.consumer;
+                    linked_fraction = makeFraction(fraction.numerator * output_rate, fraction.denominator * input_rate);
+                }
+                else
+                {
+                    linked_filter = link.producer;
+                    linked_fraction = makeFraction(fraction.numerator * input_rate, fraction.denominator * output_rate);
+                }
+
+                auto it = fractions.find(linked_filter);
+                if (it == fractions.end())
+                {
+                    fractions[linked_filter] = linked_fraction;
+                    visited.insert(linked_filter);
+                    pending.push_back(linked_filter);
+                }
+                else if (it->second.numerator != linked_fraction.numerator || it->second.denominator != linked_fraction.denominator)
+                {
+                    consistent = false;
+                }
+            }
+        }
+
+        if (!consistent)
+        {
+            LOG(WARNING) << "Rates of " << subgraph.size() << " connected fixed rate filters are inconsistent, scheduling them dynamically";
+            continue;
+        }
+
+        StaticSchedule schedule;
+
+        std::size_t denominator = 1;
+        for (auto filter: subgraph)
+        {
+            denominator = std::lcm(denominator, fractions[filter].denominator);
+        }
+
+        std::size_t divisor = 0;
+        for (auto filter: subgraph)
+        {
+            std::size_t repetitions = fractions[filter].numerator * (denominator / fractions[filter].denominator);
+            schedule.repetitions[filter] = repetitions;
+            divisor = std::gcd(divisor, repetitions);
+        }
+
+        // The smallest period might be too short for the filters to run efficiently.
+        std::size_t scale = 1;
+        for (auto filter: subgraph)
+        {
+            std::size_t repetitions = schedule.repetitions[filter] / divisor;
+            for (std::size_t i = 0; i < filter->inputChannelsCount(); ++i)
+            {
+                const InputState& state = filter->inputState(i);
+                scale = std::max(scale, divideUp(state.suggestedSize(), repetitions * state.rate()));
+            }
+
+            for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+            {
+                const OutputState& state = filter->outputState(i);
+                scale = std::max(scale, divideUp(state.suggestedSize(), repetitions * state.rate()));
+            }
+        }
+
+        for (auto& repetitions: schedule.repetitions)
+        {
+            repetitions.second = repetitions.second / divisor * scale;
+        }
+
+        // Order the filters so that the producers come first.
+        std::unordered_map<IFilter*, std::size_t> producers_count;
+        for (auto filter: subgraph)
+        {
+            for (auto& link: links[filter])
+            {
+                if (link.consumer == filter)
+                {
+                    ++producers_count[filter];
+                }
+            }
+        }
+
+        std::deque<IFilter*> ready;
+        for (auto filter: subgraph)
+        {
+            if (!producers_count[filter])
+            {
+                ready.push_back(filter);
+            }
+        }
+
+        while (!ready.empty())
+        {
+            IFilter* filter = ready.front();
+            ready.pop_front();
+            schedule.filters.push_back(filter);
+
+            for (auto& link: links[filter])
+            {
+                if (link.producer == filter && !--producers_count[link.consumer])
+                {
+                    ready.push_back(link.consumer);
+                }
+            }
+        }
+
+        CHECK_EQ(subgraph.size(), schedule.filters.size()) << "Fixed rate filters must not form cycles";
+
+        schedules.push_back(std::move(schedule));
+    }
+
+    return schedules;
+}
@@ -0,0 +1,56 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/filters/ifilter.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+// Periodic schedule of the connected fixed rate filters (see filters::InputState::rate()),
+// as in synchronous dataflow: within every period each filter processes the given number
+// of its rate-sized chunks, after which all the buffers between the filters return to
+// the same state.
+//
+// Pipeline runs the whole period as a single unit, each filter processing all its chunks
+// of the period at once, in the schedule order, whenever the buffers connecting the unit
+// to the rest of the pipeline have the period available, see Pipeline::setStaticSchedules().
+struct StaticSchedule
+{
+    // Filters in the order they run in, producers before their consumers.
+    std::vector<filters::IFilter*> filters;
+    // Number of rate-sized chunks each filter processes per period. Periods are scaled
+    // so that every filter still gets at least its suggested chunks.
+    std::unordered_map<const filters::IFilter*, std::size_t> repetitions;
+
+    // Number of samples the filter consumes on the input channel per period.
+    std::size_t inputSize(const filters::IFilter& filter, std::size_t input_channel) const;
+
+    // Number of samples the filter produces on the output channel per period.
+    std::size_t outputSize(const filters::IFilter& filter, std::size_t output_channel) const;
+};
+
+// Finds the subgraphs of at least two fixed rate filters among the given ones, linked by
+// the channels with the fixed rates on both ends, and solves their balance equations.
+// Subgraphs with the rates contradicting each other get no schedule.
+std::vector<StaticSchedule> findStaticSchedules(const std::unordered_set<filters::IFilter*>& filters);
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
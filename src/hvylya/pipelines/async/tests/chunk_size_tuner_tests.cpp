@@ -0,0 +1,99 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/chunk_size_tuner.h>
+
+#include <hvylya/core/tests/common.h>
+
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+const std::size_t BaseChunkSize = 4096;
+const std::size_t TunedCalls = 10000;
+
+// Simulates the block with the given call overhead and per-sample cost,
+// where the per-sample cost grows by the given factor per level above 0
+// to model the effect of the chunks not fitting the cache anymore.
+int tune(ChunkSizeTuning tuning, double call_overhead, double sample_cost, double cache_penalty = 1)
+{
+    ChunkSizeTuner tuner;
+    tuner.reset(tuning, -4, 4);
+
+    int level = tuner.level();
+    for (std::size_t i = 0; i < TunedCalls; ++i)
+    {
+        std::size_t samples = level >= 0 ? BaseChunkSize << level : BaseChunkSize >> -level;
+        double cost = sample_cost * (level > 0 ? std::pow(cache_penalty, level) : 1);
+        level = tuner.update(samples, std::uint64_t(call_overhead + cost * double(samples)));
+    }
+
+    return level;
+}
+
+}
+
+TEST(ChunkSizeTuner, Disabled)
+{
+    EXPECT_EQ(0, tune(ChunkSizeTuning::Disabled, 100000, 1));
+}
+
+TEST(ChunkSizeTuner, Throughput)
+{
+    // Overhead is always amortized better by larger chunks.
+    EXPECT_EQ(4, tune(ChunkSizeTuning::Throughput, 100000, 1));
+    // Until the per-sample cost starts growing faster than that.
+    EXPECT_EQ(1, tune(ChunkSizeTuning::Throughput, 2000, 1, 1.2));
+}
+
+TEST(ChunkSizeTuner, Latency)
+{
+    // The overhead takes 25% of the call time at 3 * 500 samples.
+    EXPECT_EQ(-1, tune(ChunkSizeTuning::Latency, 500, 1));
+    // ... and at 3 * 16000 samples.
+    EXPECT_EQ(4, tune(ChunkSizeTuning::Latency, 16000, 1));
+    // No overhead at all.
+    EXPECT_EQ(-4, tune(ChunkSizeTuning::Latency, 0, 1));
+}
+
+TEST(ChunkSizeTuner, FixedChunks)
+{
+    ChunkSizeTuner tuner;
+    tuner.reset(ChunkSizeTuning::Latency, -4, 4);
+
+    int level = tuner.level();
+    for (std::size_t i = 0; i < TunedCalls; ++i)
+    {
+        level = tuner.update(BaseChunkSize, 1000 + BaseChunkSize);
+    }
+
+    // Doesn't drift away when the chunk size doesn't depend on the level.
+    EXPECT_LE(std::abs(level), 1);
+}
+
+TEST(ChunkSizeTuner, Limits)
+{
+    ChunkSizeTuner tuner;
+
+    // Starts from the level closest to the suggested sizes.
+    tuner.reset(ChunkSizeTuning::Disabled, 2, 4);
+    EXPECT_EQ(2, tuner.level());
+    EXPECT_EQ(2, tuner.update(BaseChunkSize, 1000));
+
+    tuner.reset(ChunkSizeTuning::Latency, -4, -1);
+    EXPECT_EQ(-1, tuner.level());
+}
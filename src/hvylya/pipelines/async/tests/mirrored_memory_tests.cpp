@@ -0,0 +1,33 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/mirrored_memory.h>
+
+#include <hvylya/core/tests/common.h>
+
+using namespace hvylya::pipelines::async;
+
+TEST(MirroredMemory, Aliasing)
+{
+    MirroredMemory memory(MirroredMemory::pageSize());
+    std::int8_t* data = memory.data();
+
+    data[0] = 1;
+    data[memory.size() - 1] = 2;
+    EXPECT_EQ(1, data[memory.size()]);
+    EXPECT_EQ(2, data[2 * memory.size() - 1]);
+}
@@ -19,10 +19,18 @@
 #include <hvylya/filters/null_sink.h>
 #include <hvylya/filters/mapper_filter.h>
 
+#include <hvylya/pipelines/async/affinity.h>
 #include <hvylya/pipelines/async/pipeline.h>
+#include <hvylya/pipelines/async/static_schedule.h>
 
 #include <hvylya/core/tests/common.h>
 
+#include <numeric>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
 using namespace hvylya::filters;
 using namespace hvylya::pipelines::async;
 
@@ -30,12 +38,794 @@ namespace {
 
 const char* TestExceptionString = "test exception";
 
+const std::size_t TestSamplesCount = 10000 * TEST_LOAD_FACTOR;
+// Doesn't depend on the load factor, as the chunk sizes are tuned over many calls.
+const std::size_t TunedSamplesCount = 1 << 20;
+
 [[ noreturn ]] void func(float&)
 {
     errno = EIO;
     THROW(IoError()) << TestExceptionString;
 }
 
+void doubler(const float& input, float& output)
+{
+    output = 2 * input;
+}
+
+void copier(const float& input, float& output)
+{
+    output = input;
+}
+
+// Produces the sequence 0, 1, 2, ... of the specified length.
+class CountingSource:
+    public FilterGeneric<
+        TypeList<>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<CountingSource>::Type Base;
+
+    CountingSource(std::size_t samples):
+        samples_(samples),
+        current_sample_(0)
+    {
+    }
+
+    virtual void process(const Base::Inputs& /* input */, Base::Outputs& output) override
+    {
+        auto& output_data = std::get<0>(output);
+        std::size_t output_size = std::min({Base::outputState(0).suggestedSize(), output_data.size(), samples_ - current_sample_});
+
+        for (std::size_t i = 0; i < output_size; ++i)
+        {
+            output_data[i] = float(current_sample_ + i);
+        }
+
+        current_sample_ += output_size;
+        output_data.advance(output_size);
+
+        if (current_sample_ == samples_)
+        {
+            Base::outputState(0).setEof(true);
+        }
+    }
+
+  private:
+    std::size_t samples_, current_sample_;
+};
+
+// Produces the sequence 0, 1, 2, ... in small chunks at a steady pace, like a live source does,
+// recording the threads it runs on.
+class PacedSource:
+    public FilterGeneric<
+        TypeList<>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<PacedSource>::Type Base;
+
+    PacedSource(std::size_t samples, std::size_t chunk_size, std::chrono::microseconds period, bool io_bound = false):
+        samples_(samples),
+        chunk_size_(chunk_size),
+        current_sample_(0),
+        period_(period),
+        io_bound_(io_bound)
+    {
+    }
+
+    virtual bool ioBound() const override
+    {
+        return io_bound_;
+    }
+
+    const std::set<std::thread::id>& threads() const
+    {
+        return threads_;
+    }
+
+    virtual void process(const Base::Inputs& /* input */, Base::Outputs& output) override
+    {
+        threads_.insert(std::this_thread::get_id());
+        std::this_thread::sleep_for(period_);
+
+        auto& output_data = std::get<0>(output);
+        std::size_t output_size = std::min({chunk_size_, output_data.size(), samples_ - current_sample_});
+
+        for (std::size_t i = 0; i < output_size; ++i)
+        {
+            output_data[i] = float(current_sample_ + i);
+        }
+
+        current_sample_ += output_size;
+        output_data.advance(output_size);
+
+        if (current_sample_ == samples_)
+        {
+            Base::outputState(0).setEof(true);
+        }
+    }
+
+  private:
+    std::size_t samples_, chunk_size_, current_sample_;
+    std::chrono::microseconds period_;
+    bool io_bound_;
+    std::set<std::thread::id> threads_;
+};
+
+// Reads the samples from the non-blocking pipe, relying on the pipeline to run it only once there's data.
+class PipeSource:
+    public FilterGeneric<
+        TypeList<>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<PipeSource>::Type Base;
+
+    PipeSource(int descriptor):
+        descriptor_(descriptor),
+        empty_reads_(0)
+    {
+    }
+
+    virtual int pollDescriptor() const override
+    {
+        return descriptor_;
+    }
+
+    virtual std::uint32_t pollEvents() const override
+    {
+        return EPOLLIN;
+    }
+
+    std::size_t emptyReads() const
+    {
+        return empty_reads_;
+    }
+
+    virtual void process(const Base::Inputs& /* input */, Base::Outputs& output) override
+    {
+        auto& output_data = std::get<0>(output);
+        ssize_t read_size = read(descriptor_, &output_data[0], output_data.size() * sizeof(float));
+
+        if (read_size < 0)
+        {
+            CHECK_EQ(EAGAIN, errno);
+            ++empty_reads_;
+        }
+        else if (!read_size)
+        {
+            Base::outputState(0).setEof(true);
+        }
+        else
+        {
+            // Samples are written to the pipe whole, so they are read whole too.
+            CHECK_EQ(0, std::size_t(read_size) % sizeof(float));
+            output_data.advance(std::size_t(read_size) / sizeof(float));
+        }
+    }
+
+  private:
+    int descriptor_;
+    std::size_t empty_reads_;
+};
+
+// Spends the specified number of iterations of busy work on every sample,
+// counting the samples if requested.
+struct BusyConsumer
+{
+    BusyConsumer(std::size_t iterations, std::size_t* samples = nullptr):
+        iterations_(iterations),
+        samples_(samples)
+    {
+    }
+
+    void operator() (const float& sample)
+    {
+        volatile float value = sample;
+        for (std::size_t i = 0; i < iterations_; ++i)
+        {
+            value = value * 0.5f + 1.0f;
+        }
+
+        if (samples_)
+        {
+            ++*samples_;
+        }
+    }
+
+    std::size_t iterations_;
+    std::size_t* samples_;
+};
+
+// Consumes all the input it gets, recording its sizes and spending the specified
+// time on every call, no matter its size.
+class CallOverheadSink:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<CallOverheadSink>::Type Base;
+
+    CallOverheadSink(std::chrono::microseconds overhead):
+        overhead_(overhead)
+    {
+    }
+
+    const std::vector<std::size_t>& sizes() const
+    {
+        return sizes_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        std::this_thread::sleep_for(overhead_);
+
+        auto& input_data = std::get<0>(input);
+        sizes_.push_back(input_data.size());
+        input_data.advance(input_data.size());
+    }
+
+  private:
+    std::chrono::microseconds overhead_;
+    std::vector<std::size_t> sizes_;
+};
+
+// Records the threads the samples are processed on.
+struct ThreadsRecorder
+{
+    ThreadsRecorder(std::set<std::thread::id>& threads):
+        threads_(threads)
+    {
+    }
+
+    void operator() (const float& /* sample */)
+    {
+        threads_.insert(std::this_thread::get_id());
+    }
+
+    std::set<std::thread::id>& threads_;
+};
+
+// Verifies that the received samples follow the sequence produced by
+// CountingSource, scaled by the specified factor.
+struct SequenceChecker
+{
+    SequenceChecker(float scale, std::size_t& samples, std::size_t& errors):
+        scale_(scale),
+        samples_(samples),
+        errors_(errors)
+    {
+    }
+
+    void operator() (const float& sample)
+    {
+        if (sample != scale_ * float(samples_))
+        {
+            ++errors_;
+        }
+        ++samples_;
+    }
+
+    float scale_;
+    std::size_t& samples_;
+    std::size_t& errors_;
+};
+
+// Copies the samples, counting the ones starting from the given one that reach
+// it before the given counter of the other consumer has passed them.
+struct OrderChecker
+{
+    OrderChecker(const std::size_t& preceding_samples, std::size_t& samples, std::size_t& errors, std::size_t checked_samples = 0):
+        preceding_samples_(preceding_samples),
+        samples_(samples),
+        errors_(errors),
+        checked_samples_(checked_samples)
+    {
+    }
+
+    void operator() (const float& input, float& output)
+    {
+        if (samples_ >= checked_samples_ && preceding_samples_ <= samples_)
+        {
+            ++errors_;
+        }
+        ++samples_;
+        output = input;
+    }
+
+    const std::size_t& preceding_samples_;
+    std::size_t& samples_;
+    std::size_t& errors_;
+    std::size_t checked_samples_;
+};
+
+// Verifies that every input slice starts with the history of the already
+// consumed CountingSource samples, consuming the input in uneven chunks.
+class HistoryChecker:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<HistoryChecker>::Type Base;
+
+    HistoryChecker(std::size_t history_size, std::size_t required_size):
+        history_size_(history_size),
+        required_size_(required_size),
+        samples_(0),
+        errors_(0),
+        calls_(0)
+    {
+        Base::inputState(0).setHistorySize(history_size);
+        Base::inputState(0).setRequiredSize(required_size);
+    }
+
+    std::size_t samples() const
+    {
+        return samples_;
+    }
+
+    std::size_t errors() const
+    {
+        return errors_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        std::size_t input_size = roundDown(input_data.size() - history_size_, required_size_);
+        std::size_t consumed_size = std::min(input_size, required_size_ * (1 + calls_++ % 7));
+
+        for (std::size_t i = 0; i < history_size_ + consumed_size; ++i)
+        {
+            // History before the first sample is zero-filled.
+            float expected = samples_ + i >= history_size_ ? float(samples_ + i - history_size_) : 0;
+            if (input_data[i] != expected)
+            {
+                ++errors_;
+            }
+        }
+
+        samples_ += consumed_size;
+        input_data.advance(consumed_size);
+    }
+
+  private:
+    std::size_t history_size_, required_size_, samples_, errors_, calls_;
+};
+
+// Fixed rate sink recording the sizes of the inputs it gets in every call.
+class CallSizesRecorder:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<CallSizesRecorder>::Type Base;
+
+    CallSizesRecorder()
+    {
+        Base::inputState(0).setRate(1);
+    }
+
+    const std::vector<std::size_t>& sizes() const
+    {
+        return sizes_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        sizes_.push_back(input_data.size());
+        input_data.advance(input_data.size());
+    }
+
+  private:
+    std::vector<std::size_t> sizes_;
+};
+
+// Spends the specified number of iterations of busy work on every CountingSource sample
+// it consumes in small chunks, recording the number of active threads of the pipeline
+// at the first sample of every call.
+class ActiveThreadsRecorder:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<ActiveThreadsRecorder>::Type Base;
+
+    ActiveThreadsRecorder(const Pipeline& pipeline, std::size_t iterations):
+        pipeline_(pipeline),
+        iterations_(iterations)
+    {
+        Base::inputState(0).setSuggestedSize(100);
+    }
+
+    // Pairs of the first sample and the number of active threads of every call.
+    const std::vector<std::pair<std::size_t, std::size_t>>& activeThreads() const
+    {
+        return active_threads_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        active_threads_.emplace_back(std::size_t(input_data[0]), pipeline_.activeThreads());
+
+        volatile float value = 0;
+        for (std::size_t i = 0; i < input_data.size() * iterations_; ++i)
+        {
+            value = value * 0.5f + 1.0f;
+        }
+
+        input_data.advance(input_data.size());
+    }
+
+  private:
+    const Pipeline& pipeline_;
+    std::size_t iterations_;
+    std::vector<std::pair<std::size_t, std::size_t>> active_threads_;
+};
+
+// Counts the consumed samples, letting other threads wait for them.
+class ProgressSink:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<ProgressSink>::Type Base;
+
+    ProgressSink():
+        samples_(0)
+    {
+    }
+
+    // Returns whether the given number of samples was consumed before the timeout.
+    bool waitForSamples(std::size_t samples, std::chrono::milliseconds timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return samples_changed_.wait_for(lock, timeout, [&] { return samples_ >= samples; });
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            samples_ += input_data.size();
+        }
+        samples_changed_.notify_all();
+        input_data.advance(input_data.size());
+    }
+
+  private:
+    std::mutex mutex_;
+    std::condition_variable samples_changed_;
+    std::size_t samples_;
+};
+
+// Consumes CountingSource samples in uneven chunks, verifying them
+// and recording where in memory the input slices start.
+class SlicesRecorder:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<SlicesRecorder>::Type Base;
+
+    struct Slice
+    {
+        // Offset from the first slice, in elements.
+        std::ptrdiff_t offset;
+        // Stream position of the first element of the slice and the number of consumed elements.
+        std::size_t position, size;
+    };
+
+    SlicesRecorder():
+        first_sample_(nullptr),
+        samples_(0),
+        errors_(0)
+    {
+    }
+
+    const std::vector<Slice>& slices() const
+    {
+        return slices_;
+    }
+
+    std::size_t samples() const
+    {
+        return samples_;
+    }
+
+    std::size_t errors() const
+    {
+        return errors_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        std::size_t size = std::min(input_data.size(), 7 * (1 + slices_.size() % 7));
+
+        if (!first_sample_)
+        {
+            first_sample_ = &input_data[0];
+        }
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            if (input_data[i] != float(samples_ + i))
+            {
+                ++errors_;
+            }
+        }
+
+        slices_.push_back(Slice{&input_data[0] - first_sample_, samples_, size});
+        samples_ += size;
+        input_data.advance(size);
+    }
+
+  private:
+    const float* first_sample_;
+    std::size_t samples_, errors_;
+    std::vector<Slice> slices_;
+};
+
+// Doubles CountingSource samples, verifying that their history is intact,
+// and can be replicated as it keeps no other state.
+// Tracks how many replicas process their parts at the same time.
+struct ConcurrencyCounter
+{
+    std::atomic<std::size_t> running{0}, max_running{0};
+};
+
+class ReplicableDoubler:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<ReplicableDoubler>::Type Base;
+
+    ReplicableDoubler(
+        std::size_t history_size,
+        std::size_t required_size,
+        std::atomic<std::size_t>& errors,
+        std::atomic<std::size_t>& replicas,
+        ConcurrencyCounter* concurrency = nullptr
+    ):
+        history_size_(history_size),
+        required_size_(required_size),
+        errors_(errors),
+        replicas_(replicas),
+        concurrency_(concurrency)
+    {
+        Base::inputState(0).setHistorySize(history_size);
+        Base::inputState(0).setRequiredSize(required_size);
+    }
+
+    virtual std::unique_ptr<IFilter> replicate() const override
+    {
+        ++replicas_;
+        return std::make_unique<ReplicableDoubler>(history_size_, required_size_, errors_, replicas_, concurrency_);
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& output) override
+    {
+        auto& input_data = std::get<0>(input);
+        auto& output_data = std::get<0>(output);
+        std::size_t size = std::min(roundDown(input_data.size() - history_size_, required_size_), output_data.size());
+
+        for (std::size_t i = 0; i < history_size_; ++i)
+        {
+            // History before the first sample is zero-filled.
+            float expected = input_data[history_size_] >= float(history_size_ - i) ? input_data[history_size_] - float(history_size_ - i) : 0;
+            if (input_data[i] != expected)
+            {
+                ++errors_;
+            }
+        }
+
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            output_data[i] = 2 * input_data[history_size_ + i];
+        }
+
+        if (concurrency_)
+        {
+            std::size_t running = ++concurrency_->running;
+            std::size_t max_running = concurrency_->max_running.load();
+            while (running > max_running && !concurrency_->max_running.compare_exchange_weak(max_running, running))
+            {
+            }
+
+            // Gives other threads the chance to run their parts meanwhile even with a single CPU.
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+            --concurrency_->running;
+        }
+
+        input_data.advance(size);
+        output_data.advance(size);
+    }
+
+  private:
+    std::size_t history_size_, required_size_;
+    std::atomic<std::size_t>& errors_;
+    std::atomic<std::size_t>& replicas_;
+    ConcurrencyCounter* concurrency_;
+};
+
+// Returns the stats of the blocks, taken while their filters still exist.
+std::vector<BlockStats> runCountingPipeline(Pipeline& pipeline)
+{
+    std::size_t samples[3] = { 0, 0, 0 }, errors[3] = { 0, 0, 0 };
+
+    CountingSource source(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper(&doubler);
+    MapperFilter<SequenceChecker>
+        checker0(SequenceChecker(1, samples[0], errors[0])),
+        checker1(SequenceChecker(2, samples[1], errors[1])),
+        checker2(SequenceChecker(2, samples[2], errors[2]));
+    HistoryChecker history_checker0(100, 1), history_checker1(1000, 16), history_checker2(10000, 1000);
+
+    connect(source, checker0);
+    connect(source, mapper, checker1);
+    connect(mapper, checker2);
+    connect(source, history_checker0);
+    connect(source, history_checker1);
+    connect(source, history_checker2);
+
+    pipeline.add(source);
+    pipeline.run();
+
+    for (std::size_t i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(TestSamplesCount, samples[i]);
+        EXPECT_EQ(0, errors[i]);
+    }
+
+    for (auto history_checker: { &history_checker0, &history_checker1, &history_checker2 })
+    {
+        EXPECT_EQ(TestSamplesCount, history_checker->samples());
+        EXPECT_EQ(0, history_checker->errors());
+    }
+
+    return pipeline.stats();
+}
+
+
+void runFusiblePipelines(bool block_fusion)
+{
+    std::size_t samples = 0, errors = 0;
+    CountingSource source(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper0(&doubler), mapper1(&doubler);
+    MapperFilter<SequenceChecker> checker(SequenceChecker(4, samples, errors));
+    connect(source, mapper0, mapper1, checker);
+
+    Pipeline pipeline;
+    pipeline.setBlockFusion(block_fusion);
+    pipeline.add(source);
+    pipeline.run();
+
+    EXPECT_EQ(TestSamplesCount, samples);
+    EXPECT_EQ(0, errors);
+
+    // Fused buffers must still fit the history of the reader.
+    CountingSource history_source(TestSamplesCount);
+    HistoryChecker history_checker(10000, 1000);
+    connect(history_source, history_checker);
+
+    Pipeline history_pipeline;
+    history_pipeline.setBlockFusion(block_fusion);
+    history_pipeline.add(history_source);
+    history_pipeline.run();
+
+    EXPECT_EQ(TestSamplesCount, history_checker.samples());
+    EXPECT_EQ(0, history_checker.errors());
+}
+
+
+// Returns the average number of samples per call of the sink with the high per-call overhead.
+// Returns the sizes of the sink calls.
+std::vector<std::size_t> runCallOverheadPipeline(ChunkSizeTuning chunk_size_tuning)
+{
+    CountingSource source(TunedSamplesCount);
+    // The sleep dwarfs the rest of the call time, so that the per-sample cost
+    // halves with every level no matter how fast the machine is.
+    CallOverheadSink sink(std::chrono::microseconds(1000));
+    connect(source, sink);
+
+    // The sink runs as soon as it has the chunk of its current size, as the single thread
+    // alternates between the blocks and the fused sink would run right after every source call.
+    // Buffers are left large enough for the chunks to grow.
+    Pipeline pipeline;
+    pipeline.setChunkSizeTuning(chunk_size_tuning);
+    pipeline.setBlockFusion(false);
+    pipeline.setCacheAwareBuffers(false);
+    pipeline.setMaxThreads(1);
+    pipeline.add(source);
+    pipeline.run();
+
+    auto& sizes = sink.sizes();
+    EXPECT_EQ(TunedSamplesCount, std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)));
+
+    return sizes;
+}
+
+// Returns the size of the buffer the recorder reads from.
+std::size_t runSlicesPipeline(BufferBackend buffer_backend, SlicesRecorder& recorder)
+{
+    CountingSource source(TestSamplesCount);
+    connect(source, recorder);
+
+    Pipeline pipeline;
+    pipeline.setBufferBackend(buffer_backend);
+    pipeline.add(source);
+    pipeline.run();
+
+    EXPECT_EQ(TestSamplesCount, recorder.samples());
+    EXPECT_EQ(0, recorder.errors());
+
+    const auto& layout = pipeline.bufferLayout();
+    EXPECT_EQ(1, layout.size());
+    return layout.empty() ? 0 : layout[0].size;
+}
+
+// Returns the number of buffers allocated.
+std::size_t runInPlacePipelines(bool in_place_buffers, bool block_fusion)
+{
+    std::size_t samples = 0, errors = 0;
+    CountingSource source(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper0(&doubler), mapper1(&doubler);
+    MapperFilter<SequenceChecker> checker(SequenceChecker(4, samples, errors));
+    connect(source, mapper0, mapper1, checker);
+
+    Pipeline pipeline;
+    pipeline.setBufferBackend(BufferBackend::Mirrored);
+    pipeline.setInPlaceBuffers(in_place_buffers);
+    pipeline.setBlockFusion(block_fusion);
+    pipeline.add(source);
+    pipeline.run();
+
+    EXPECT_EQ(TestSamplesCount, samples);
+    EXPECT_EQ(0, errors);
+
+    // Output written in place must still provide the history to the reader.
+    CountingSource history_source(TestSamplesCount);
+    MapperFilter<decltype(&copier)> history_mapper(&copier);
+    HistoryChecker history_checker(10000, 1000);
+    connect(history_source, history_mapper, history_checker);
+
+    Pipeline history_pipeline;
+    history_pipeline.setBufferBackend(BufferBackend::Mirrored);
+    history_pipeline.setInPlaceBuffers(in_place_buffers);
+    history_pipeline.setBlockFusion(block_fusion);
+    history_pipeline.add(history_source);
+    history_pipeline.run();
+
+    EXPECT_EQ(TestSamplesCount, history_checker.samples());
+    EXPECT_EQ(0, history_checker.errors());
+
+    return pipeline.bufferLayout().size() + history_pipeline.bufferLayout().size();
+}
+
 }
 
 TEST(Pipeline, ExceptionPropagation)
@@ -61,3 +851,798 @@ TEST(Pipeline, ExceptionPropagation)
 
     EXPECT_EQ(true, caught);
 }
+
+TEST(Pipeline, SharedQueueScheduling)
+{
+    Pipeline pipeline;
+    EXPECT_EQ(Pipeline::SchedulingMode::SharedQueue, pipeline.schedulingMode());
+
+    // All threads take the blocks from the same queue, so there's nothing to steal.
+    for (auto& block_stats: runCountingPipeline(pipeline))
+    {
+        EXPECT_GT(block_stats.calls, 0);
+        EXPECT_EQ(0, block_stats.steals);
+    }
+}
+
+TEST(Pipeline, WorkStealingScheduling)
+{
+    Pipeline pipeline;
+    pipeline.setSchedulingMode(Pipeline::SchedulingMode::WorkStealing);
+    // Source makes all of its consumers schedulable at once, so with at least
+    // two threads the ones the source thread doesn't get to are stolen.
+    pipeline.setMaxThreads(std::max<std::size_t>(2, std::thread::hardware_concurrency()));
+
+    std::uint64_t steals = 0;
+    for (auto& block_stats: runCountingPipeline(pipeline))
+    {
+        EXPECT_GT(block_stats.calls, 0);
+        steals += block_stats.steals;
+    }
+
+    EXPECT_GT(steals, 0);
+}
+
+TEST(Pipeline, CopyingBuffers)
+{
+    EXPECT_EQ(BufferBackend::Copying, Pipeline().bufferBackend());
+
+    // Every lap restarts from the overlap copy at the beginning of the buffer,
+    // so that the slices never cross its end.
+    SlicesRecorder recorder;
+    std::size_t buffer_size = runSlicesPipeline(BufferBackend::Copying, recorder);
+
+    const auto& slices = recorder.slices();
+    std::size_t laps = 0;
+    for (std::size_t i = 0; i < slices.size(); ++i)
+    {
+        EXPECT_GE(slices[i].offset, 0);
+        EXPECT_LE(slices[i].offset + std::ptrdiff_t(slices[i].size), std::ptrdiff_t(buffer_size));
+
+        if (i && slices[i].offset < slices[i - 1].offset)
+        {
+            ++laps;
+        }
+    }
+
+    EXPECT_GT(laps, 0);
+}
+
+TEST(Pipeline, MirroredBuffers)
+{
+    Pipeline pipeline;
+    pipeline.setBufferBackend(BufferBackend::Mirrored);
+    runCountingPipeline(pipeline);
+
+    // Slices start at the stream position modulo the buffer size, with no overlap
+    // copies, and the ones reaching the end of the buffer continue into its mirror.
+    SlicesRecorder recorder;
+    std::size_t buffer_size = runSlicesPipeline(BufferBackend::Mirrored, recorder);
+
+    std::size_t wrapped_slices = 0;
+    for (auto& slice: recorder.slices())
+    {
+        EXPECT_EQ(std::ptrdiff_t(slice.position % buffer_size), slice.offset);
+
+        if (slice.position % buffer_size + slice.size > buffer_size)
+        {
+            ++wrapped_slices;
+        }
+    }
+
+    EXPECT_GT(wrapped_slices, 0);
+}
+
+TEST(Pipeline, BlockFusion)
+{
+    EXPECT_TRUE(Pipeline().blockFusion());
+    runFusiblePipelines(true);
+    runFusiblePipelines(false);
+}
+
+TEST(Pipeline, StaticSchedules)
+{
+    EXPECT_FALSE(Pipeline().staticSchedules());
+
+    // Mapper and the checkers have fixed rates and run as a single unit.
+    Pipeline pipeline;
+    pipeline.setStaticSchedules(true);
+    runCountingPipeline(pipeline);
+
+    Pipeline work_stealing_pipeline;
+    work_stealing_pipeline.setStaticSchedules(true);
+    work_stealing_pipeline.setSchedulingMode(Pipeline::SchedulingMode::WorkStealing);
+    runCountingPipeline(work_stealing_pipeline);
+
+    // With the mirrored buffers every call but the ones at the end of stream processes the whole period.
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        CountingSource source(TestSamplesCount);
+        MapperFilter<decltype(&doubler)> mapper(&doubler);
+        CallSizesRecorder recorder;
+        connect(source, mapper, recorder);
+
+        auto schedules = findStaticSchedules({ &mapper, &recorder });
+        ASSERT_EQ(1, schedules.size());
+        std::size_t period_size = schedules[0].inputSize(recorder, 0);
+
+        Pipeline periodic_pipeline;
+        periodic_pipeline.setStaticSchedules(true);
+        periodic_pipeline.setBufferBackend(BufferBackend::Mirrored);
+        periodic_pipeline.setSchedulingMode(mode);
+        periodic_pipeline.add(source);
+        periodic_pipeline.run();
+
+        auto& sizes = recorder.sizes();
+        std::size_t periods = TestSamplesCount / period_size;
+        ASSERT_LE(periods, sizes.size());
+        EXPECT_EQ(TestSamplesCount, std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)));
+        for (std::size_t i = 0; i < periods; ++i)
+        {
+            EXPECT_EQ(period_size, sizes[i]);
+        }
+    }
+}
+
+TEST(Pipeline, InPlaceBuffers)
+{
+    EXPECT_TRUE(Pipeline().inPlaceBuffers());
+
+    // Only the sources get the buffers when all the rest is written in place.
+    EXPECT_EQ(2, runInPlacePipelines(true, true));
+    EXPECT_EQ(2, runInPlacePipelines(true, false));
+    EXPECT_EQ(5, runInPlacePipelines(false, true));
+
+    // Inputs with several readers are never overwritten.
+    Pipeline pipeline;
+    pipeline.setBufferBackend(BufferBackend::Mirrored);
+    runCountingPipeline(pipeline);
+    EXPECT_EQ(2, pipeline.bufferLayout().size());
+}
+
+TEST(Pipeline, ChunkSizeTuning)
+{
+    for (auto tuning: { ChunkSizeTuning::Throughput, ChunkSizeTuning::Latency })
+    {
+        Pipeline pipeline;
+        pipeline.setChunkSizeTuning(tuning);
+        runCountingPipeline(pipeline);
+    }
+
+    // Without tuning, every call but the last one at the end of stream gets the suggested chunk.
+    std::size_t suggested_size = CallOverheadSink::DefaultSuggestedSize;
+    auto sizes = runCallOverheadPipeline(ChunkSizeTuning::Disabled);
+    ASSERT_LE(2, sizes.size());
+    for (std::size_t i = 0; i + 1 < sizes.size(); ++i)
+    {
+        EXPECT_EQ(suggested_size, sizes[i]);
+    }
+
+    // The per-call overhead is amortized by the chunks larger than the suggested ones: measuring
+    // every level takes 32 calls, so the stream is long enough to get past the fourfold chunks.
+    auto tuned_sizes = runCallOverheadPipeline(ChunkSizeTuning::Throughput);
+    ASSERT_LE(2, tuned_sizes.size());
+    EXPECT_EQ(suggested_size, tuned_sizes.front());
+    EXPECT_LE(4 * suggested_size, tuned_sizes[tuned_sizes.size() - 2]);
+}
+
+TEST(Pipeline, SchedulingPolicies)
+{
+    EXPECT_EQ(Pipeline::SchedulingPolicy::Balanced, Pipeline().schedulingPolicy());
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        for (auto policy: { Pipeline::SchedulingPolicy::Latency, Pipeline::SchedulingPolicy::Throughput, Pipeline::SchedulingPolicy::CriticalPath })
+        {
+            Pipeline pipeline;
+            pipeline.setSchedulingMode(mode);
+            pipeline.setSchedulingPolicy(policy);
+            runCountingPipeline(pipeline);
+        }
+
+        // The sink right after the source runs before the mapper on the longer branch,
+        // as long as the mapper is not fused with its own sink.
+        std::size_t samples = 0, errors = 0, mapped_samples = 0, order_errors = 0;
+        CountingSource source(TestSamplesCount);
+        MapperFilter<SequenceChecker> checker(SequenceChecker(1, samples, errors));
+        MapperFilter<OrderChecker> mapper(OrderChecker(samples, mapped_samples, order_errors));
+        NullSink<float> sink;
+        connect(source, checker);
+        connect(source, mapper, sink);
+
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::Latency);
+        pipeline.setBlockFusion(false);
+        pipeline.setMaxThreads(1);
+        pipeline.add(source);
+        pipeline.run();
+
+        EXPECT_EQ(TestSamplesCount, samples);
+        EXPECT_EQ(0, errors);
+        EXPECT_EQ(TestSamplesCount, mapped_samples);
+        EXPECT_EQ(0, order_errors);
+    }
+}
+
+TEST(Pipeline, CriticalPaths)
+{
+    const std::size_t samples_count = 20000;
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        std::size_t expensive_samples = 0, cheap_samples = 0, order_errors = 0;
+        PacedSource source(samples_count, 50, std::chrono::microseconds(1000));
+        MapperFilter<decltype(&copier)> mapper(&copier);
+        MapperFilter<BusyConsumer> expensive_consumer(BusyConsumer(1000, &expensive_samples));
+        // Paths are measured once the first update period is over, which the paced source
+        // takes at most a quarter of its samples to get through, so the second half must
+        // go strictly in the order of the paths.
+        MapperFilter<OrderChecker> cheap_consumer(OrderChecker(expensive_samples, cheap_samples, order_errors, samples_count / 2));
+        NullSink<float> sink;
+        connect(source, mapper, expensive_consumer);
+        connect(source, cheap_consumer, sink);
+
+        // The mapper and the cheap consumer are equally far from the sinks,
+        // so only the critical paths put the expensive branch first.
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setSchedulingPolicy(Pipeline::SchedulingPolicy::CriticalPath);
+        pipeline.setBlockFusion(false);
+        pipeline.setMaxThreads(1);
+        pipeline.add(source);
+        pipeline.run();
+
+        std::unordered_map<const IFilter*, std::chrono::nanoseconds> critical_paths;
+        for (auto& block_stats: pipeline.stats())
+        {
+            critical_paths[block_stats.filter] = block_stats.critical_path;
+        }
+
+        // The critical path goes from the source through its most expensive consumer.
+        EXPECT_EQ(critical_paths[&source].count(), critical_paths[&expensive_consumer].count());
+        EXPECT_GT(critical_paths[&expensive_consumer].count(), critical_paths[&cheap_consumer].count());
+
+        EXPECT_EQ(samples_count, expensive_samples);
+        EXPECT_EQ(samples_count, cheap_samples);
+        EXPECT_EQ(0, order_errors);
+    }
+}
+
+TEST(Pipeline, ConsumerHandOff)
+{
+    EXPECT_FALSE(Pipeline().consumerHandOff());
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setConsumerHandOff(true);
+        runCountingPipeline(pipeline);
+    }
+}
+
+TEST(Pipeline, ElasticThreads)
+{
+    EXPECT_FALSE(Pipeline().elasticThreads());
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        for (auto policy: { Pipeline::SchedulingPolicy::Balanced, Pipeline::SchedulingPolicy::Throughput })
+        {
+            Pipeline pipeline;
+            pipeline.setSchedulingMode(mode);
+            pipeline.setSchedulingPolicy(policy);
+            pipeline.setElasticThreads(true);
+            runCountingPipeline(pipeline);
+
+            EXPECT_LE(1, pipeline.activeThreads());
+            EXPECT_GE(std::max(1u, std::thread::hardware_concurrency()), pipeline.activeThreads());
+        }
+    }
+
+    // The source trickles, then floods the sink with the expensive samples and trickles again.
+    const std::size_t trickle_samples = 4000, flood_samples = 200000, chunk_size = 100;
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        int descriptors[2];
+        ASSERT_EQ(0, pipe(descriptors));
+        ASSERT_EQ(0, fcntl(descriptors[0], F_SETFL, O_NONBLOCK));
+
+        std::thread writer(
+            [&]
+            {
+                std::vector<float> chunk(chunk_size);
+                for (std::size_t i = 0; i < 2 * trickle_samples + flood_samples; i += chunk.size())
+                {
+                    std::iota(chunk.begin(), chunk.end(), float(i));
+                    ASSERT_EQ(ssize_t(chunk.size() * sizeof(float)), write(descriptors[1], chunk.data(), chunk.size() * sizeof(float)));
+
+                    if (i < trickle_samples || i >= trickle_samples + flood_samples)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                    }
+                }
+                close(descriptors[1]);
+            }
+        );
+
+        Pipeline pipeline;
+        PipeSource source(descriptors[0]);
+        ActiveThreadsRecorder recorder(pipeline, 1000);
+        connect(source, recorder);
+
+        pipeline.setSchedulingMode(mode);
+        pipeline.setMaxThreads(4);
+        pipeline.setElasticThreads(true);
+        pipeline.add(source);
+        pipeline.run();
+
+        writer.join();
+        close(descriptors[0]);
+
+        // A single thread keeps up with the trickle, so the rest stay parked until the flood,
+        // which keeps the active thread busy, and get parked again once the flood is over.
+        std::size_t trickle_threads = 0, flood_threads = 0;
+        for (auto& active_threads: recorder.activeThreads())
+        {
+            if (active_threads.first < trickle_samples)
+            {
+                trickle_threads = std::max(trickle_threads, active_threads.second);
+            }
+            else if (active_threads.first < trickle_samples + flood_samples)
+            {
+                flood_threads = std::max(flood_threads, active_threads.second);
+            }
+        }
+
+        EXPECT_EQ(1, trickle_threads);
+        EXPECT_LT(1, flood_threads);
+        ASSERT_FALSE(recorder.activeThreads().empty());
+        EXPECT_EQ(1, recorder.activeThreads().back().second);
+    }
+}
+
+TEST(Pipeline, LatencyBudget)
+{
+    EXPECT_EQ(0, Pipeline().latencyBudget().count());
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setLatencyBudget(std::chrono::milliseconds(20));
+        runCountingPipeline(pipeline);
+    }
+
+    // Single thread runs the gated sink only once the source runs out of buffer space, as the
+    // next burst is far away, so every call but the first and the last gets the whole buffer.
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        CountingSource source(TestSamplesCount);
+        CallSizesRecorder recorder;
+        connect(source, recorder);
+
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setBufferBackend(BufferBackend::Mirrored);
+        pipeline.setMaxThreads(1);
+        pipeline.setLatencyBudget(std::chrono::hours(1));
+        pipeline.add(source);
+        pipeline.run();
+
+        ASSERT_EQ(1, pipeline.bufferLayout().size());
+        std::size_t burst_size = pipeline.bufferLayout()[0].size - CountingSource::DefaultSuggestedSize;
+
+        auto& sizes = recorder.sizes();
+        ASSERT_LE(3, sizes.size());
+        EXPECT_EQ(TestSamplesCount, std::accumulate(sizes.begin(), sizes.end(), std::size_t(0)));
+        EXPECT_GE(TestSamplesCount / burst_size + 2, sizes.size());
+        for (std::size_t i = 1; i + 1 < sizes.size(); ++i)
+        {
+            EXPECT_LE(burst_size, sizes[i]);
+        }
+    }
+
+    // The held input is released once the next burst is due, even if the source stays idle.
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        int descriptors[2];
+        ASSERT_EQ(0, pipe(descriptors));
+        ASSERT_EQ(0, fcntl(descriptors[0], F_SETFL, O_NONBLOCK));
+
+        PipeSource source(descriptors[0]);
+        ProgressSink sink;
+        connect(source, sink);
+
+        // The first batch starts the burst right away and the second one arrives while
+        // the sink holds its input back, with nothing written after it.
+        bool released = true;
+        std::thread writer(
+            [&]
+            {
+                // Chunks are small enough for the pipe to write them atomically.
+                std::vector<float> chunk(128);
+                for (std::size_t i = 1; i <= 2; ++i)
+                {
+                    for (std::size_t j = 0; j < ProgressSink::DefaultSuggestedSize; j += chunk.size())
+                    {
+                        ASSERT_EQ(ssize_t(chunk.size() * sizeof(float)), write(descriptors[1], chunk.data(), chunk.size() * sizeof(float)));
+                    }
+                    released = sink.waitForSamples(i * ProgressSink::DefaultSuggestedSize, std::chrono::seconds(10)) && released;
+                }
+                close(descriptors[1]);
+            }
+        );
+
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setLatencyBudget(std::chrono::milliseconds(40));
+        pipeline.add(source);
+        pipeline.run();
+
+        writer.join();
+        close(descriptors[0]);
+
+        EXPECT_TRUE(released);
+    }
+}
+
+TEST(Pipeline, IoThreads)
+{
+    EXPECT_TRUE(Pipeline().ioThreads());
+
+    Executor executor(2);
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        for (Executor* pipeline_executor: { static_cast<Executor*>(nullptr), &executor })
+        {
+            if (pipeline_executor && mode != Pipeline::SchedulingMode::SharedQueue)
+            {
+                continue;
+            }
+
+            for (bool io_threads: { false, true })
+            {
+                std::size_t samples = 0, errors = 0;
+                std::set<std::thread::id> threads;
+                PacedSource source(TestSamplesCount, 100, std::chrono::microseconds(10), true);
+                MapperFilter<SequenceChecker> checker(SequenceChecker(1, samples, errors));
+                MapperFilter<ThreadsRecorder> recorder((ThreadsRecorder(threads)));
+                connect(source, checker);
+                connect(source, recorder);
+
+                Pipeline pipeline;
+                pipeline.setSchedulingMode(mode);
+                pipeline.setExecutor(pipeline_executor);
+                pipeline.setIoThreads(io_threads);
+                pipeline.add(source);
+                pipeline.run();
+
+                EXPECT_EQ(TestSamplesCount, samples);
+                EXPECT_EQ(0, errors);
+
+                if (io_threads)
+                {
+                    // The source has a thread of its own, which doesn't process the data.
+                    ASSERT_EQ(1, source.threads().size());
+                    EXPECT_FALSE(threads.count(*source.threads().begin()));
+                }
+            }
+        }
+    }
+}
+
+TEST(Pipeline, PolledSource)
+{
+    Executor executor(2);
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        for (Executor* pipeline_executor: { static_cast<Executor*>(nullptr), &executor })
+        {
+            if (pipeline_executor && mode != Pipeline::SchedulingMode::SharedQueue)
+            {
+                continue;
+            }
+
+            int descriptors[2];
+            ASSERT_EQ(0, pipe(descriptors));
+            ASSERT_EQ(0, fcntl(descriptors[0], F_SETFL, O_NONBLOCK));
+
+            // Writes the sequence in chunks small enough for the pipe to write them atomically.
+            std::thread writer(
+                [&descriptors]
+                {
+                    std::vector<float> chunk(100);
+                    for (std::size_t i = 0; i < TestSamplesCount; i += chunk.size())
+                    {
+                        std::iota(chunk.begin(), chunk.end(), float(i));
+                        ASSERT_EQ(ssize_t(chunk.size() * sizeof(float)), write(descriptors[1], chunk.data(), chunk.size() * sizeof(float)));
+                        std::this_thread::sleep_for(std::chrono::microseconds(10));
+                    }
+                    close(descriptors[1]);
+                }
+            );
+
+            std::size_t samples = 0, errors = 0;
+            PipeSource source(descriptors[0]);
+            MapperFilter<SequenceChecker> checker(SequenceChecker(1, samples, errors));
+            connect(source, checker);
+
+            Pipeline pipeline;
+            pipeline.setSchedulingMode(mode);
+            pipeline.setExecutor(pipeline_executor);
+            pipeline.add(source);
+            pipeline.run();
+
+            writer.join();
+            close(descriptors[0]);
+
+            EXPECT_EQ(TestSamplesCount, samples);
+            EXPECT_EQ(0, errors);
+            // The source only runs when the pipe has something to read.
+            EXPECT_EQ(0, source.emptyReads());
+        }
+    }
+}
+
+TEST(Pipeline, BlockReplication)
+{
+    EXPECT_EQ(1, Pipeline().blockReplicas());
+
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        std::size_t samples = 0, errors = 0;
+        std::atomic<std::size_t> history_errors(0), replicas(0);
+        CountingSource source(TestSamplesCount);
+        ReplicableDoubler doubler(100, 16, history_errors, replicas);
+        MapperFilter<SequenceChecker> checker(SequenceChecker(2, samples, errors));
+        connect(source, doubler, checker);
+
+        Pipeline pipeline;
+        pipeline.setSchedulingMode(mode);
+        pipeline.setBlockReplicas(4);
+        pipeline.add(source);
+        pipeline.run();
+
+        // Source and sink are not replicable.
+        EXPECT_EQ(3, replicas);
+        EXPECT_EQ(TestSamplesCount, samples);
+        EXPECT_EQ(0, errors);
+        EXPECT_EQ(0, history_errors);
+    }
+
+    // Adjacent replicated blocks notify each other while their parts run on several threads.
+    for (auto mode: { Pipeline::SchedulingMode::SharedQueue, Pipeline::SchedulingMode::WorkStealing })
+    {
+        for (std::size_t iteration = 0; iteration < 20; ++iteration)
+        {
+            std::size_t samples = 0, errors = 0;
+            std::atomic<std::size_t> history_errors(0), replicas(0);
+            ConcurrencyCounter concurrency;
+            CountingSource source(TestSamplesCount);
+            ReplicableDoubler doubler0(100, 16, history_errors, replicas, &concurrency), doubler1(0, 16, history_errors, replicas, &concurrency);
+            MapperFilter<SequenceChecker> checker(SequenceChecker(4, samples, errors));
+            connect(source, doubler0, doubler1, checker);
+
+            // Small parts, so that there are plenty of them to run concurrently.
+            doubler0.inputState(0).setSuggestedSize(256);
+            doubler1.inputState(0).setSuggestedSize(256);
+
+            Pipeline pipeline;
+            pipeline.setSchedulingMode(mode);
+            pipeline.setBlockReplicas(4);
+            pipeline.setMaxThreads(8);
+            pipeline.add(source);
+            pipeline.run();
+
+            EXPECT_EQ(6, replicas);
+            EXPECT_EQ(TestSamplesCount, samples);
+            EXPECT_EQ(0, errors);
+            EXPECT_EQ(0, history_errors);
+            EXPECT_GT(concurrency.max_running.load(), 1);
+        }
+    }
+}
+
+TEST(Pipeline, SharedExecutor)
+{
+    EXPECT_EQ(nullptr, Pipeline().executor());
+
+    Executor executor(2);
+    EXPECT_EQ(2, executor.threadsCount());
+
+    // Pipelines run concurrently on the same threads, with and without hand-off.
+    std::vector<std::thread> threads;
+    for (bool consumer_hand_off: { false, true, false })
+    {
+        threads.emplace_back(
+            [&executor, consumer_hand_off]
+            {
+                Pipeline pipeline;
+                pipeline.setExecutor(&executor);
+                pipeline.setConsumerHandOff(consumer_hand_off);
+                runCountingPipeline(pipeline);
+            }
+        );
+    }
+
+    for (auto& thread: threads)
+    {
+        thread.join();
+    }
+
+    // Failures are propagated and don't affect other pipelines.
+    MapperFilter<decltype(&func)> source(&func);
+    NullSink<float> sink;
+    connect(source, sink);
+
+    Pipeline pipeline;
+    pipeline.setExecutor(&executor);
+    pipeline.add(source);
+    EXPECT_THROW(pipeline.run(), IoError);
+
+    Pipeline next_pipeline;
+    next_pipeline.setExecutor(&Executor::shared());
+    runCountingPipeline(next_pipeline);
+}
+
+TEST(Pipeline, Affinity)
+{
+    EXPECT_LE(1, numaNodesCount());
+    EXPECT_TRUE(numaNodeCpus(std::numeric_limits<std::size_t>::max()).empty());
+
+    std::vector<std::size_t> node_cpus = numaNodeCpus(0);
+
+    Pipeline pipeline;
+    EXPECT_TRUE(pipeline.cpuAffinity().empty());
+    EXPECT_EQ(-1, pipeline.numaNode());
+    pipeline.setCpuAffinity({ 0 });
+    runCountingPipeline(pipeline);
+
+    Pipeline numa_pipeline;
+    numa_pipeline.setNumaNode(0);
+    numa_pipeline.setCpuAffinity(node_cpus);
+    runCountingPipeline(numa_pipeline);
+
+    Executor executor(0, { 0 });
+    EXPECT_EQ(1, executor.threadsCount());
+
+    Pipeline executor_pipeline;
+    executor_pipeline.setExecutor(&executor);
+    executor_pipeline.setNumaNode(0);
+    runCountingPipeline(executor_pipeline);
+}
+
+TEST(Pipeline, BufferPlanning)
+{
+    // Unlimited budget without cache-aware sizing allocates the preferred sizes.
+    Pipeline unlimited_pipeline;
+    unlimited_pipeline.setCacheAwareBuffers(false);
+    runCountingPipeline(unlimited_pipeline);
+
+    std::size_t unlimited_size = 0;
+    for (auto& layout: unlimited_pipeline.bufferLayout())
+    {
+        EXPECT_LE(layout.min_size, layout.efficient_size);
+        EXPECT_LE(layout.efficient_size, layout.size);
+        unlimited_size += layout.size * layout.type_size;
+    }
+
+    // Budget between the efficient and the preferred sizes is respected.
+    Pipeline budget_pipeline;
+    budget_pipeline.setCacheAwareBuffers(false);
+    budget_pipeline.setBufferMemoryBudget(unlimited_size / 2);
+    EXPECT_EQ(unlimited_size / 2, budget_pipeline.bufferMemoryBudget());
+    runCountingPipeline(budget_pipeline);
+
+    std::size_t budget_size = 0;
+    for (auto& layout: budget_pipeline.bufferLayout())
+    {
+        EXPECT_LE(layout.efficient_size, layout.size);
+        budget_size += layout.size * layout.type_size;
+    }
+    EXPECT_LE(budget_size, unlimited_size / 2 + budget_pipeline.bufferLayout().size() * MaxSimdByteSize);
+
+    // Tiny budget falls back to the minimal sizes, which must still work.
+    Pipeline min_pipeline;
+    min_pipeline.setBufferMemoryBudget(1);
+    runCountingPipeline(min_pipeline);
+
+    for (auto& layout: min_pipeline.bufferLayout())
+    {
+        EXPECT_LE(layout.size, layout.min_size + MaxSimdByteSize);
+    }
+}
+
+TEST(Pipeline, MultipleGraphs)
+{
+    std::size_t samples[2] = { 0, 0 }, errors[2] = { 0, 0 };
+    CountingSource source0(TestSamplesCount), source1(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper0(&doubler), mapper1(&doubler);
+    MapperFilter<SequenceChecker>
+        checker0(SequenceChecker(2, samples[0], errors[0])),
+        checker1(SequenceChecker(2, samples[1], errors[1]));
+    connect(source0, mapper0, checker0);
+    connect(source1, mapper1, checker1);
+
+    // Blocks of the graph added first must survive adding the second one.
+    Pipeline pipeline;
+    pipeline.setBlockFusion(false);
+    pipeline.add(source0);
+    pipeline.add(source1);
+    pipeline.run();
+
+    for (std::size_t i = 0; i < 2; ++i)
+    {
+        EXPECT_EQ(TestSamplesCount, samples[i]);
+        EXPECT_EQ(0, errors[i]);
+    }
+}
+
+TEST(Pipeline, Stats)
+{
+    std::size_t samples = 0, errors = 0;
+    CountingSource source(TestSamplesCount);
+    MapperFilter<SequenceChecker> checker(SequenceChecker(1, samples, errors));
+    connect(source, checker);
+
+    Pipeline pipeline;
+    pipeline.add(source);
+    pipeline.run();
+
+    auto stats = pipeline.stats();
+    ASSERT_EQ(2, stats.size());
+
+    for (auto& block_stats: stats)
+    {
+        EXPECT_GT(block_stats.calls, 0);
+        EXPECT_GT(block_stats.wall_time.count(), 0);
+
+        if (block_stats.filter == &source)
+        {
+            ASSERT_EQ(1, block_stats.produced_samples.size());
+            EXPECT_EQ(TestSamplesCount, block_stats.produced_samples[0]);
+        }
+        else
+        {
+            EXPECT_EQ(&checker, block_stats.filter);
+            ASSERT_EQ(1, block_stats.consumed_samples.size());
+            EXPECT_EQ(TestSamplesCount, block_stats.consumed_samples[0]);
+        }
+    }
+}
+
+TEST(Pipeline, Tracing)
+{
+    std::size_t samples = 0, errors = 0;
+    CountingSource source(TestSamplesCount);
+    MapperFilter<SequenceChecker> checker(SequenceChecker(1, samples, errors));
+    connect(source, checker);
+
+    Pipeline pipeline;
+    pipeline.setTraceCapacity(1000000);
+    pipeline.add(source);
+    pipeline.run();
+
+    std::stringstream os;
+    pipeline.writeTrace(os);
+    std::string trace = os.str();
+
+    std::size_t events = 0;
+    for (std::size_t pos = trace.find("\"ph\":\"X\""); pos != std::string::npos; pos = trace.find("\"ph\":\"X\"", pos + 1))
+    {
+        ++events;
+    }
+
+    std::size_t calls = 0;
+    for (auto& block_stats: pipeline.stats())
+    {
+        calls += block_stats.calls;
+    }
+
+    EXPECT_EQ(0, trace.find("{\"displayTimeUnit\""));
+    EXPECT_EQ(calls, events);
+}
@@ -0,0 +1,125 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/filters/connect.h>
+#include <hvylya/filters/filter_generic.h>
+#include <hvylya/filters/mapper_filter.h>
+#include <hvylya/filters/null_sink.h>
+
+#include <hvylya/pipelines/async/static_schedule.h>
+
+#include <hvylya/core/tests/common.h>
+
+using namespace hvylya::filters;
+using namespace hvylya::pipelines::async;
+
+namespace {
+
+const std::size_t TestSuggestedSize = 64;
+
+// Replaces every input_rate samples with output_rate copies of the first one.
+class RateFilter:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<RateFilter>::Type Base;
+
+    RateFilter(std::size_t input_rate, std::size_t output_rate)
+    {
+        Base::inputState(0).setRate(input_rate);
+        Base::inputState(0).setRequiredSize(input_rate);
+        Base::inputState(0).setSuggestedSize(TestSuggestedSize);
+        Base::outputState(0).setRate(output_rate);
+        Base::outputState(0).setRequiredSize(output_rate);
+        Base::outputState(0).setSuggestedSize(TestSuggestedSize);
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& output) override
+    {
+        auto& input_data = std::get<0>(input);
+        auto& output_data = std::get<0>(output);
+        std::size_t input_rate = Base::inputState(0).rate(), output_rate = Base::outputState(0).rate();
+        std::size_t chunks = std::min(input_data.size() / input_rate, output_data.size() / output_rate);
+
+        for (std::size_t i = 0; i < chunks * output_rate; ++i)
+        {
+            output_data[i] = input_data[i / output_rate * input_rate];
+        }
+
+        input_data.advance(chunks * input_rate);
+        output_data.advance(chunks * output_rate);
+    }
+};
+
+void adder(const float& input0, const float& input1, float& output)
+{
+    output = input0 + input1;
+}
+
+std::unordered_set<IFilter*> filtersSet(std::initializer_list<IFilter*> filters)
+{
+    return std::unordered_set<IFilter*>(filters);
+}
+
+}
+
+TEST(StaticSchedule, Decimation)
+{
+    RateFilter decimator(4, 1), interpolator(1, 3), filter(1, 1);
+    connect(decimator, interpolator, filter);
+
+    auto schedules = findStaticSchedules(filtersSet({ &decimator, &interpolator, &filter }));
+    ASSERT_EQ(1, schedules.size());
+
+    auto& schedule = schedules[0];
+    EXPECT_EQ(std::vector<IFilter*>({ &decimator, &interpolator, &filter }), schedule.filters);
+
+    // Balance is 1 decimator chunk : 1 interpolator chunk : 3 filter chunks,
+    // scaled so that the decimator produces its suggested output size.
+    EXPECT_EQ(TestSuggestedSize, schedule.repetitions.at(&decimator));
+    EXPECT_EQ(TestSuggestedSize, schedule.repetitions.at(&interpolator));
+    EXPECT_EQ(3 * TestSuggestedSize, schedule.repetitions.at(&filter));
+    EXPECT_EQ(TestSuggestedSize, schedule.outputSize(decimator, 0));
+    EXPECT_EQ(3 * TestSuggestedSize, schedule.outputSize(interpolator, 0));
+}
+
+TEST(StaticSchedule, VariableRates)
+{
+    // Filters without the rates break the subgraph.
+    RateFilter decimator(2, 1);
+    NullSink<float> sink;
+    connect(decimator, sink);
+
+    EXPECT_TRUE(findStaticSchedules(filtersSet({ &decimator, &sink })).empty());
+}
+
+TEST(StaticSchedule, InconsistentRates)
+{
+    // Both branches merge after decimating by different factors, so
+    // the buffer of one of them would grow without bound.
+    RateFilter splitter(1, 1), decimator2(2, 1), decimator3(3, 1);
+    MapperFilter<decltype(&adder)> merger(&adder);
+    connect(splitter, decimator2);
+    connect(splitter, decimator3);
+    connect(decimator2, makeChannel<0>(merger));
+    connect(decimator3, makeChannel<1>(merger));
+
+    EXPECT_TRUE(findStaticSchedules(filtersSet({ &splitter, &decimator2, &decimator3, &merger })).empty());
+}
@@ -0,0 +1,115 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/tracer.h>
+
+#include <hvylya/pipelines/async/block.h>
+
+using namespace hvylya::pipelines::async;
+
+Tracer::Tracer(std::size_t workers_count, std::size_t io_threads_count, std::size_t max_events_per_thread):
+    workers_count_(workers_count),
+    max_events_per_thread_(max_events_per_thread),
+    start_time_(std::chrono::steady_clock::now())
+{
+    for (std::size_t i = 0; i < workers_count + io_threads_count; ++i)
+    {
+        auto thread_events = std::make_unique<ThreadEvents>();
+        thread_events->events.reset(new Event[max_events_per_thread_]);
+        thread_events->size.store(0);
+        thread_events->dropped.store(0);
+        threads_events_.push_back(std::move(thread_events));
+    }
+}
+
+void Tracer::record(
+    std::size_t thread_index,
+    const Block& block,
+    std::chrono::steady_clock::time_point begin_time,
+    std::chrono::steady_clock::time_point end_time,
+    std::size_t consumed_size,
+    std::size_t produced_size
+)
+{
+    CHECK_LT(thread_index, threads_events_.size());
+    ThreadEvents& thread_events = *threads_events_[thread_index];
+
+    std::size_t size = thread_events.size.load(std::memory_order_relaxed);
+    if (size == max_events_per_thread_)
+    {
+        thread_events.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    thread_events.events[size] =
+    {
+        &block,
+        std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(begin_time - start_time_).count()),
+        std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time_).count()),
+        consumed_size,
+        produced_size
+    };
+
+    // Publish the event to write().
+    thread_events.size.store(size + 1, std::memory_order_release);
+}
+
+void Tracer::write(std::ostream& os, const std::deque<Block>& blocks) const
+{
+    std::unordered_map<const Block*, std::size_t> blocks_indices;
+    for (std::size_t i = 0; i < blocks.size(); ++i)
+    {
+        blocks_indices[&blocks[i]] = i;
+    }
+
+    // Chrome trace timestamps are in microseconds.
+    os << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+
+    bool first = true;
+    for (std::size_t i = 0; i < threads_events_.size(); ++i)
+    {
+        const ThreadEvents& thread_events = *threads_events_[i];
+
+        os << (first ? "" : ",") <<
+            "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i <<
+            ",\"args\":{\"name\":\"" << (i < workers_count_ ? fmt::format("worker {0}", i) : fmt::format("io {0}", i - workers_count_)) << "\"}}";
+        first = false;
+
+        std::size_t size = thread_events.size.load(std::memory_order_acquire);
+        for (std::size_t j = 0; j < size; ++j)
+        {
+            const Event& event = thread_events.events[j];
+            CHECK(blocks_indices.count(event.block));
+
+            os << ",{\"name\":\"" << typeid(event.block->filter()).name() <<
+                "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i <<
+                ",\"ts\":" << fmt::format("{0:.3f}", double(event.begin_time) / 1000) <<
+                ",\"dur\":" << fmt::format("{0:.3f}", double(event.end_time - event.begin_time) / 1000) <<
+                ",\"args\":{\"block\":" << blocks_indices.at(event.block) <<
+                ",\"consumed\":" << event.consumed_size <<
+                ",\"produced\":" << event.produced_size << "}}";
+        }
+
+        std::size_t dropped = thread_events.dropped.load(std::memory_order_relaxed);
+        if (dropped)
+        {
+            LOG(WARNING) << "Thread " << i << " has dropped " << dropped << " trace events";
+        }
+    }
+
+    os << "]}" << std::endl;
+}
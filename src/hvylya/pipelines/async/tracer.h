@@ -0,0 +1,79 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+#include <chrono>
+#include <deque>
+#include <ostream>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+class Block;
+
+// Records block executions into fixed-size per-thread buffers: every buffer
+// is appended to by its own thread only, so recording needs no locking.
+// Events that don't fit into the buffer are dropped and counted.
+class Tracer: core::NonCopyable
+{
+  public:
+    // Worker threads come first, followed by the I/O threads.
+    Tracer(std::size_t workers_count, std::size_t io_threads_count, std::size_t max_events_per_thread);
+
+    // Can be called by the thread with the given index only.
+    void record(
+        std::size_t thread_index,
+        const Block& block,
+        std::chrono::steady_clock::time_point begin_time,
+        std::chrono::steady_clock::time_point end_time,
+        std::size_t consumed_size,
+        std::size_t produced_size
+    );
+
+    // Writes the events in Chrome trace event format, see
+    // https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+    // Can be called concurrently with record(): the events recorded
+    // after the call has started might be missing from the output.
+    void write(std::ostream& os, const std::deque<Block>& blocks) const;
+
+  private:
+    struct Event
+    {
+        const Block* block;
+        std::uint64_t begin_time, end_time;
+        std::size_t consumed_size, produced_size;
+    };
+
+    struct ThreadEvents
+    {
+        std::unique_ptr<Event[]> events;
+        alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> size;
+        std::atomic<std::size_t> dropped;
+    };
+
+    std::vector<std::unique_ptr<ThreadEvents>> threads_events_;
+    std::size_t workers_count_, max_events_per_thread_;
+    std::chrono::steady_clock::time_point start_time_;
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
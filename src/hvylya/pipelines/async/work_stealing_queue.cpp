@@ -0,0 +1,107 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/async/work_stealing_queue.h>
+
+using namespace hvylya::pipelines::async;
+
+// The implementation follows "Correct and Efficient Work-Stealing for Weak
+// Memory Models" by Le, Pop, Cohen & Zappa Nardelli, minus the buffer growth.
+
+WorkStealingQueue::WorkStealingQueue(std::size_t capacity):
+    slots_(new std::atomic<Block*>[core::roundUpToPowerOfTwo(capacity)]),
+    mask_(std::int64_t(core::roundUpToPowerOfTwo(capacity)) - 1)
+{
+    clear();
+}
+
+void WorkStealingQueue::clear()
+{
+    for (std::int64_t i = 0; i <= mask_; ++i)
+    {
+        slots_[std::size_t(i)].store(nullptr, std::memory_order_relaxed);
+    }
+
+    top_.store(0);
+    bottom_.store(0);
+}
+
+bool WorkStealingQueue::empty() const
+{
+    return bottom_.load(std::memory_order_acquire) <= top_.load(std::memory_order_acquire);
+}
+
+void WorkStealingQueue::push(Block* block)
+{
+    std::int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    std::int64_t top = top_.load(std::memory_order_acquire);
+    CHECK_LE(bottom - top, mask_) << "Work stealing queue overflow";
+
+    slots_[std::size_t(bottom & mask_)].store(block, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+}
+
+Block* WorkStealingQueue::pop()
+{
+    std::int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom)
+    {
+        // The queue is empty.
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    Block* block = slots_[std::size_t(bottom & mask_)].load(std::memory_order_relaxed);
+
+    if (top == bottom)
+    {
+        // The last element - compete with thieves for it.
+        if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            block = nullptr;
+        }
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    return block;
+}
+
+Block* WorkStealingQueue::steal()
+{
+    std::int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t bottom = bottom_.load(std::memory_order_acquire);
+
+    if (top >= bottom)
+    {
+        return nullptr;
+    }
+
+    Block* block = slots_[std::size_t(top & mask_)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+    {
+        // Lost the race either to the owner or to another thief.
+        return nullptr;
+    }
+
+    return block;
+}
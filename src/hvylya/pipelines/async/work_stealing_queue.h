@@ -0,0 +1,62 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/common.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace async {
+
+class Block;
+
+// Chase-Lev deque: the owning worker pushes and pops blocks at the bottom,
+// all other workers steal them from the top.
+//
+// The deque never grows: every block can be queued at most once at any
+// given time, so the number of blocks in the pipeline is an upper bound
+// on the number of queued elements.
+class WorkStealingQueue: core::NonCopyable
+{
+  public:
+    WorkStealingQueue(std::size_t capacity);
+
+    bool empty() const;
+
+    // Can be called by the owning worker only.
+    void push(Block* block);
+
+    // Can be called by the owning worker only.
+    Block* pop();
+
+    // Can be called by any thread.
+    Block* steal();
+
+    // Must not be called concurrently with any other operation.
+    void clear();
+
+  private:
+    std::unique_ptr<std::atomic<Block*>[]> slots_;
+    std::int64_t mask_;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> top_;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::int64_t> bottom_;
+};
+
+} // namespace async
+} // namespace pipelines
+} // namespace hvylya
@@ -0,0 +1,359 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/pipelines/sync/pipeline.h>
+
+#include <hvylya/filters/io_states.h>
+
+#include <deque>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+using namespace hvylya::pipelines::sync;
+
+namespace {
+
+// Collects the filters in the order they are reached from the top filter, so that
+// the resulting schedule doesn't depend on where the filters are in memory.
+std::vector<IFilter*> linkedFilters(IFilter& top_filter)
+{
+    std::vector<IFilter*> filters(1, &top_filter);
+    std::unordered_set<IFilter*> visited(filters.begin(), filters.end());
+
+    for (std::size_t index = 0; index < filters.size(); ++index)
+    {
+        IFilter& filter = *filters[index];
+        std::vector<IFilter*> linked_filters;
+
+        for (std::size_t i = 0; i < filter.inputChannelsCount(); ++i)
+        {
+            for (auto& source: filter.sources(i))
+            {
+                linked_filters.push_back(&std::get<0>(source));
+            }
+        }
+
+        for (std::size_t i = 0; i < filter.outputChannelsCount(); ++i)
+        {
+            for (auto& sink: filter.sinks(i))
+            {
+                linked_filters.push_back(&std::get<0>(sink));
+            }
+        }
+
+        for (auto linked_filter: linked_filters)
+        {
+            if (visited.insert(linked_filter).second)
+            {
+                filters.push_back(linked_filter);
+            }
+        }
+    }
+
+    return filters;
+}
+
+// Orders the filters so that the producers come first.
+std::vector<IFilter*> sortFilters(const std::vector<IFilter*>& filters)
+{
+    std::unordered_map<IFilter*, std::size_t> sources_count;
+    std::deque<IFilter*> ready;
+
+    for (auto filter: filters)
+    {
+        for (std::size_t i = 0; i < filter->inputChannelsCount(); ++i)
+        {
+            sources_count[filter] += filter->sources(i).size();
+        }
+
+        if (!sources_count[filter])
+        {
+            ready.push_back(filter);
+        }
+    }
+
+    std::vector<IFilter*> sorted_filters;
+    while (!ready.empty())
+    {
+        IFilter* filter = ready.front();
+        ready.pop_front();
+        sorted_filters.push_back(filter);
+
+        for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+        {
+            for (auto& sink: filter->sinks(i))
+            {
+                if (!--sources_count[&std::get<0>(sink)])
+                {
+                    ready.push_back(&std::get<0>(sink));
+                }
+            }
+        }
+    }
+
+    CHECK_EQ(filters.size(), sorted_filters.size()) << "Filters must not form cycles";
+
+    return sorted_filters;
+}
+
+std::size_t availableSize(std::size_t write_position, std::size_t read_position)
+{
+    return write_position > read_position ? write_position - read_position : 0;
+}
+
+} // anonymous namespace
+
+Pipeline::Pipeline()
+{
+}
+
+void Pipeline::add(IFilter& top_filter)
+{
+    CHECK_EQ(0, top_filter.inputChannelsCount());
+
+    std::vector<IFilter*> filters = sortFilters(linkedFilters(top_filter));
+    std::unordered_map<IFilter*, std::size_t> blocks_map;
+
+    std::size_t first_block = blocks_.size();
+    for (auto filter: filters)
+    {
+        blocks_map[filter] = blocks_.size();
+
+        Block block;
+        block.filter = filter;
+        block.inputs.resize(filter->inputChannelsCount(), Input{std::numeric_limits<std::size_t>::max(), 0});
+        block.budgets.resize(filter->inputChannelsCount() ? 0 : filter->outputChannelsCount());
+        block.input_slices.resize(filter->inputChannelsCount());
+        block.output_slices.resize(filter->outputChannelsCount());
+        blocks_.push_back(std::move(block));
+    }
+
+    for (auto filter: filters)
+    {
+        for (std::size_t i = 0; i < filter->outputChannelsCount(); ++i)
+        {
+            const OutputState& state = filter->outputState(i);
+
+            Buffer buffer;
+            buffer.type_size = state.typeSize();
+            buffer.alignment = buffer.type_size < MaxSimdByteSize && !(MaxSimdByteSize % buffer.type_size) ? MaxSimdByteSize / buffer.type_size : 1;
+            buffer.output_size = std::max(state.requiredSize(), state.suggestedSize());
+            buffer.write_position = 0;
+
+            std::size_t padding = state.padding(), max_input_size = 0;
+            for (auto& sink: filter->sinks(i))
+            {
+                IFilter* sink_filter = &std::get<0>(sink);
+                std::size_t input_channel = std::get<1>(sink);
+                const InputState& sink_state = sink_filter->inputState(input_channel);
+
+                blocks_[blocks_map[sink_filter]].inputs[input_channel] = Input{buffers_.size(), buffer.readers.size()};
+                buffer.readers.push_back(Reader{sink_state.historySize(), sink_state.delay(), 0});
+
+                padding = std::max(padding, sink_state.padding());
+                max_input_size =
+                    std::max(max_input_size, sink_state.historySize() + std::max(sink_state.requiredSize(), sink_state.suggestedSize()));
+            }
+
+            // Unread data never exceeds the largest input, so the writer always has
+            // the space for the suggested output once that data is moved back.
+            buffer.data_size = roundUp(2 * max_input_size + buffer.output_size, buffer.alignment);
+            buffer.data.resize((buffer.data_size + padding) * buffer.type_size);
+
+            blocks_[blocks_map[filter]].outputs.push_back(buffers_.size());
+            buffers_.push_back(std::move(buffer));
+        }
+    }
+
+    for (std::size_t index = first_block; index < blocks_.size(); ++index)
+    {
+        for (auto& input: blocks_[index].inputs)
+        {
+            CHECK_NE(std::numeric_limits<std::size_t>::max(), input.buffer) << "All inputs must be connected";
+        }
+    }
+
+    reset();
+}
+
+void Pipeline::reset()
+{
+    for (auto& block: blocks_)
+    {
+        block.filter->reset();
+        std::fill(block.budgets.begin(), block.budgets.end(), 0);
+    }
+
+    for (auto& buffer: buffers_)
+    {
+        std::size_t max_history_size = 0;
+        for (auto& reader: buffer.readers)
+        {
+            max_history_size = std::max(max_history_size, reader.history_size);
+        }
+
+        // Start writing after the longest history, so that all readers
+        // get zero-filled history initially.
+        std::fill(buffer.data.begin(), buffer.data.end(), 0);
+        buffer.write_position = roundUp(max_history_size, buffer.alignment);
+        CHECK_LT(buffer.write_position, buffer.data_size);
+
+        for (auto& reader: buffer.readers)
+        {
+            reader.position = buffer.write_position + reader.delay - reader.history_size;
+        }
+    }
+}
+
+bool Pipeline::step(std::size_t samples)
+{
+    for (auto& block: blocks_)
+    {
+        std::fill(block.budgets.begin(), block.budgets.end(), samples);
+    }
+
+    bool processed = false;
+
+    // Keep going over the whole graph, as consumers free the space the producers before them need.
+    for (bool progress = true; progress; )
+    {
+        progress = false;
+        for (auto& block: blocks_)
+        {
+            while (runBlock(block))
+            {
+                progress = processed = true;
+            }
+        }
+    }
+
+    return processed;
+}
+
+void Pipeline::run()
+{
+    reset();
+    while (step(std::numeric_limits<std::size_t>::max()))
+    {
+    }
+}
+
+bool Pipeline::runBlock(Block& block)
+{
+    IFilter& filter = *block.filter;
+
+    for (std::size_t i = 0; i < block.inputs.size(); ++i)
+    {
+        const InputState& state = filter.inputState(i);
+        Buffer& buffer = buffers_[block.inputs[i].buffer];
+        Reader& reader = buffer.readers[block.inputs[i].reader];
+        std::size_t available_size = availableSize(buffer.write_position, reader.position);
+
+        if (available_size < state.historySize() + state.requiredSize())
+        {
+            return false;
+        }
+
+        block.input_slices[i] = UntypedSlice(&buffer.data[reader.position * buffer.type_size], available_size);
+    }
+
+    for (std::size_t i = 0; i < block.outputs.size(); ++i)
+    {
+        const OutputState& state = filter.outputState(i);
+        Buffer& buffer = buffers_[block.outputs[i]];
+
+        if (state.eof())
+        {
+            return false;
+        }
+
+        compactBuffer(buffer);
+
+        std::size_t available_size = buffer.data_size - buffer.write_position;
+        if (!block.budgets.empty())
+        {
+            available_size = std::min(available_size, block.budgets[i]);
+        }
+
+        if (available_size < state.requiredSize())
+        {
+            return false;
+        }
+
+        block.output_slices[i] = UntypedSlice(&buffer.data[buffer.write_position * buffer.type_size], available_size);
+    }
+
+    filter.process(block.input_slices.size() ? &block.input_slices[0] : nullptr, block.output_slices.size() ? &block.output_slices[0] : nullptr);
+
+    bool advanced = false;
+
+    for (std::size_t i = 0; i < block.inputs.size(); ++i)
+    {
+        std::size_t advance_size = block.input_slices[i].advancedSize();
+        CHECK(
+            filter.inputState(i).mayConsumeNothing() ||
+            (advance_size && !(advance_size % filter.inputState(i).requiredSize()))
+        );
+
+        buffers_[block.inputs[i].buffer].readers[block.inputs[i].reader].position += advance_size;
+        advanced = advanced || advance_size > 0;
+    }
+
+    for (std::size_t i = 0; i < block.outputs.size(); ++i)
+    {
+        std::size_t advance_size = block.output_slices[i].advancedSize();
+        CHECK(advance_size >= filter.outputState(i).providedSize() || filter.outputState(i).eof());
+
+        buffers_[block.outputs[i]].write_position += advance_size;
+        if (!block.budgets.empty())
+        {
+            block.budgets[i] -= advance_size;
+        }
+        advanced = advanced || advance_size > 0;
+    }
+
+    return advanced;
+}
+
+void Pipeline::compactBuffer(Buffer& buffer)
+{
+    if (buffer.data_size - buffer.write_position >= buffer.output_size)
+    {
+        return;
+    }
+
+    std::size_t min_position = buffer.write_position;
+    for (auto& reader: buffer.readers)
+    {
+        min_position = std::min(min_position, reader.position);
+    }
+
+    // Keep the data aligned the same way it was written.
+    std::size_t shift = roundDown(min_position, buffer.alignment);
+    if (!shift)
+    {
+        return;
+    }
+
+    std::memmove(&buffer.data[0], &buffer.data[shift * buffer.type_size], (buffer.write_position - shift) * buffer.type_size);
+
+    buffer.write_position -= shift;
+    for (auto& reader: buffer.readers)
+    {
+        reader.position -= shift;
+    }
+}
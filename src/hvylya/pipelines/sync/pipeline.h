@@ -0,0 +1,95 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <hvylya/core/aligned_vector.h>
+#include <hvylya/core/untyped_slice.h>
+#include <hvylya/filters/ifilter.h>
+
+namespace hvylya {
+namespace pipelines {
+namespace sync {
+
+// Runs the filters on the calling thread in topological order, sources first, with no
+// threads, locks or atomics of its own, which suits small graphs as well as embedding
+// the processing into an external event loop. Each filter runs for as long as it has
+// enough input data and output space before the next one gets its turn, so the results
+// are reproducible as long as the filters themselves are deterministic. I/O bound and
+// polled filters are called directly and may block the calling thread.
+class Pipeline: core::NonCopyable
+{
+  public:
+    Pipeline();
+
+    // Allocates the buffers for all filters linked to the given source and resets them.
+    void add(filters::IFilter& top_filter);
+
+    // Resets all the filters and buffers, so that the next step starts from scratch.
+    void reset();
+
+    // Lets each source produce up to the given number of samples on each of its outputs
+    // and runs the filters until none of them can make progress anymore. Returns whether
+    // any of the filters made progress.
+    bool step(std::size_t samples);
+
+    // Resets the pipeline and runs it until the sources reach the end of their data
+    // and everything they've produced is processed.
+    void run();
+
+  private:
+    struct Reader
+    {
+        std::size_t history_size, delay, position;
+    };
+
+    // Linear buffer that moves the unread data back to its beginning once
+    // the writer runs out of space, rather than wrapping around.
+    struct Buffer
+    {
+        std::size_t type_size, alignment, data_size, output_size, write_position;
+        core::AlignedVector<std::int8_t> data;
+        std::vector<Reader> readers;
+    };
+
+    struct Input
+    {
+        std::size_t buffer, reader;
+    };
+
+    struct Block
+    {
+        filters::IFilter* filter;
+        std::vector<Input> inputs;
+        std::vector<std::size_t> outputs;
+        // Samples the source can still produce on each of its outputs within the current step.
+        std::vector<std::size_t> budgets;
+        std::vector<core::UntypedSlice> input_slices, output_slices;
+    };
+
+    std::vector<Block> blocks_;
+    std::vector<Buffer> buffers_;
+
+    bool runBlock(Block& block);
+
+    // Makes as much space as possible for the writer, if it's short of the suggested size.
+    void compactBuffer(Buffer& buffer);
+};
+
+} // namespace sync
+} // namespace pipelines
+} // namespace hvylya
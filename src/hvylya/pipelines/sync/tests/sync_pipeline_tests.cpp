@@ -0,0 +1,212 @@
+// Hvylya - software-defined radio framework, see https://endl.ch/projects/hvylya
+//
+// Copyright (C) 2019 - 2020 Alexander Tsvyashchenko <sdr@endl.ch>
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <hvylya/filters/connect.h>
+#include <hvylya/filters/mapper_filter.h>
+
+#include <hvylya/pipelines/sync/pipeline.h>
+
+#include <hvylya/core/tests/common.h>
+
+using namespace hvylya::core;
+using namespace hvylya::filters;
+using namespace hvylya::pipelines::sync;
+
+namespace {
+
+const std::size_t TestSamplesCount = 10000 * TEST_LOAD_FACTOR;
+
+void doubler(const float& input, float& output)
+{
+    output = 2 * input;
+}
+
+// Produces the sequence 0, 1, 2, ... of the specified length.
+class CountingSource:
+    public FilterGeneric<
+        TypeList<>,
+        TypeList<float>
+    >
+{
+  public:
+    typedef FilterBaseType<CountingSource>::Type Base;
+
+    CountingSource(std::size_t samples):
+        samples_(samples),
+        current_sample_(0)
+    {
+    }
+
+    virtual void reset() override
+    {
+        current_sample_ = 0;
+        Base::outputState(0).setEof(false);
+    }
+
+    virtual void process(const Base::Inputs& /* input */, Base::Outputs& output) override
+    {
+        auto& output_data = std::get<0>(output);
+        std::size_t output_size = std::min(output_data.size(), samples_ - current_sample_);
+
+        for (std::size_t i = 0; i < output_size; ++i)
+        {
+            output_data[i] = float(current_sample_ + i);
+        }
+
+        current_sample_ += output_size;
+        output_data.advance(output_size);
+
+        if (current_sample_ == samples_)
+        {
+            Base::outputState(0).setEof(true);
+        }
+    }
+
+  private:
+    std::size_t samples_, current_sample_;
+};
+
+// Records the samples along with the history each input slice starts with,
+// consuming the input in uneven chunks.
+class HistoryRecorder:
+    public FilterGeneric<
+        TypeList<float>,
+        TypeList<>
+    >
+{
+  public:
+    typedef FilterBaseType<HistoryRecorder>::Type Base;
+
+    HistoryRecorder(std::size_t history_size, std::size_t required_size):
+        history_size_(history_size),
+        required_size_(required_size),
+        calls_(0),
+        errors_(0)
+    {
+        Base::inputState(0).setHistorySize(history_size);
+        Base::inputState(0).setRequiredSize(required_size);
+    }
+
+    virtual void reset() override
+    {
+        samples_.clear();
+        calls_ = 0;
+        errors_ = 0;
+    }
+
+    const std::vector<float>& samples() const
+    {
+        return samples_;
+    }
+
+    std::size_t errors() const
+    {
+        return errors_;
+    }
+
+    virtual void process(const Base::Inputs& input, Base::Outputs& /* output */) override
+    {
+        auto& input_data = std::get<0>(input);
+        std::size_t input_size = roundDown(input_data.size() - history_size_, required_size_);
+        std::size_t consumed_size = std::min(input_size, required_size_ * (1 + calls_++ % 7));
+
+        for (std::size_t i = 0; i < history_size_; ++i)
+        {
+            // History before the first sample is zero-filled.
+            std::size_t sample = samples_.size() + i;
+            if (input_data[i] != (sample >= history_size_ ? samples_[sample - history_size_] : 0))
+            {
+                ++errors_;
+            }
+        }
+
+        for (std::size_t i = 0; i < consumed_size; ++i)
+        {
+            samples_.push_back(input_data[history_size_ + i]);
+        }
+
+        input_data.advance(consumed_size);
+    }
+
+  private:
+    std::size_t history_size_, required_size_, calls_, errors_;
+    std::vector<float> samples_;
+};
+
+void expectDoubledSequence(const std::vector<float>& samples, std::size_t samples_count)
+{
+    ASSERT_EQ(samples_count, samples.size());
+    for (std::size_t i = 0; i < samples_count; ++i)
+    {
+        EXPECT_EQ(2 * float(i), samples[i]);
+    }
+}
+
+}
+
+TEST(SyncPipeline, Run)
+{
+    CountingSource source(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper(&doubler);
+    HistoryRecorder recorder0(100, 1), recorder1(1000, 16);
+    connect(source, mapper, recorder0);
+    connect(mapper, recorder1);
+
+    Pipeline pipeline;
+    pipeline.add(source);
+    pipeline.run();
+
+    // Data that doesn't fill the whole required chunk stays unprocessed.
+    expectDoubledSequence(recorder0.samples(), TestSamplesCount);
+    expectDoubledSequence(recorder1.samples(), roundDown(TestSamplesCount, std::size_t(16)));
+    EXPECT_EQ(0, recorder0.errors());
+    EXPECT_EQ(0, recorder1.errors());
+
+    // Runs from scratch and with the same results every time.
+    std::vector<float> samples = recorder1.samples();
+    pipeline.run();
+    EXPECT_EQ(samples, recorder1.samples());
+}
+
+TEST(SyncPipeline, Step)
+{
+    CountingSource source(TestSamplesCount);
+    MapperFilter<decltype(&doubler)> mapper(&doubler);
+    HistoryRecorder recorder(10, 1);
+    connect(source, mapper, recorder);
+
+    Pipeline pipeline;
+    pipeline.add(source);
+
+    // Everything the source produces within the step is processed by its end.
+    EXPECT_TRUE(pipeline.step(100));
+    expectDoubledSequence(recorder.samples(), 100);
+
+    EXPECT_FALSE(pipeline.step(0));
+    expectDoubledSequence(recorder.samples(), 100);
+
+    EXPECT_TRUE(pipeline.step(TestSamplesCount));
+    expectDoubledSequence(recorder.samples(), TestSamplesCount);
+    EXPECT_EQ(0, recorder.errors());
+
+    // Source has reached the end of its data.
+    EXPECT_FALSE(pipeline.step(TestSamplesCount));
+
+    pipeline.reset();
+    EXPECT_TRUE(pipeline.step(10));
+    expectDoubledSequence(recorder.samples(), 10);
+}